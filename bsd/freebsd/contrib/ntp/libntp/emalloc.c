@@ -53,7 +53,13 @@ ereallocz(
 	else
 		allocsz = newsz;
 
+#if !defined(__rtems__) || defined(EREALLOC_CALLSITE)
 	mem = EREALLOC_IMPL(ptr, allocsz, file, line);
+#else /* __rtems__ */
+	/* Account the block to the caller, see the progstat command */
+	mem = rtems_bsd_program_realloc_site(ptr, allocsz,
+	    __builtin_return_address(0));
+#endif /* __rtems__ */
 	if (NULL == mem) {
 		msyslog_term = TRUE;
 #ifndef EREALLOC_CALLSITE
@@ -48,6 +48,17 @@
 
 __BEGIN_DECLS
 
+/*
+ * Snapshot of the data of a program, see
+ * rtems_bsd_program_data_snapshot_init().  The members are private.
+ */
+struct rtems_bsd_program_data_snapshot {
+	void	*data;
+	void	*copy;
+	size_t	size;
+	bool	copy_allocated;
+};
+
 int
 rtems_bsd_program_call(const char *name, int (*prog)(void *), void *context);
 
@@ -55,11 +66,33 @@ int
 rtems_bsd_program_call_main(const char *name, int (*main)(int, char **),
     int argc, char **argv);
 
+int
+rtems_bsd_program_call_with_arena(const char *name, int (*prog)(void *),
+    void *context, size_t chunk_size);
+
+int
+rtems_bsd_program_call_main_with_arena(const char *name,
+    int (*main)(int, char **), int argc, char **argv, size_t chunk_size);
+
 int
 rtems_bsd_program_call_main_with_data_restore(const char *name,
     int (*main)(int, char **), int argc, char **argv,
     void *data_buf, const size_t data_size);
 
+int
+rtems_bsd_program_data_snapshot_init(
+    struct rtems_bsd_program_data_snapshot *snapshot, void *data_buf,
+    size_t data_size, void *copy_buf);
+
+void
+rtems_bsd_program_data_snapshot_destroy(
+    struct rtems_bsd_program_data_snapshot *snapshot);
+
+int
+rtems_bsd_program_call_main_with_data_snapshot(const char *name,
+    int (*main)(int, char **), int argc, char **argv,
+    struct rtems_bsd_program_data_snapshot *snapshot);
+
 void *
 rtems_bsd_program_add_destructor(void (*destructor)(void *), void *arg);
 
@@ -75,6 +108,9 @@ rtems_bsd_program_error(const char *, ...) __attribute__ ((__format__ (__printf_
 const char *
 rtems_bsd_program_get_name(void);
 
+int
+rtems_bsd_program_print_statistics(FILE *file, const char *name);
+
 void *
 rtems_bsd_program_get_context(void) __pure2;
 
@@ -109,6 +145,9 @@ rtems_bsd_program_calloc(size_t nelem, size_t elsize);
 void *
 rtems_bsd_program_realloc(void *ptr, size_t size);
 
+void *
+rtems_bsd_program_realloc_site(void *ptr, size_t size, const void *site);
+
 void *
 rtems_bsd_program_reallocf(void *ptr, size_t size);
 
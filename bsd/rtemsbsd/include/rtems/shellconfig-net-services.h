@@ -47,6 +47,7 @@ extern "C" {
  */
 extern rtems_shell_cmd_t rtems_shell_NTPQ_Command;
 extern rtems_shell_cmd_t rtems_shell_NTPSV_Command;
+extern rtems_shell_cmd_t rtems_shell_PROGSTAT_Command;
 
 #ifdef __cplusplus
 }
@@ -42,24 +42,86 @@
 #include <sys/queue.h>
 
 #include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
 
 __BEGIN_DECLS
 
-struct program_fd_item {
-	int	fd;
-	LIST_ENTRY(program_fd_item) entries;
-};
+#define PROGRAM_FD_MAP_BITS 32
 
-struct program_file_item {
-	FILE	*file;
-	LIST_ENTRY(program_file_item) entries;
-};
+#define PROGRAM_FD_MAP_WORDS(count) \
+	(((count) + PROGRAM_FD_MAP_BITS - 1) / PROGRAM_FD_MAP_BITS)
 
+/*
+ * Header in front of each block allocated by a program.  The magic number
+ * depends on the address of the header, so that a free() of a block which
+ * was not allocated through the program wrapper is detected.
+ */
 struct program_allocmem_item {
-	void	*ptr;
 	LIST_ENTRY(program_allocmem_item) entries;
+	size_t	size;
+	uint32_t	site;
+	uintptr_t	magic;
+};
+
+#define PROGRAM_ALLOCMEM_MAGIC ((uintptr_t)0x5a3c96e1)
+
+#define PROGRAM_ALLOCMEM_ALIGNMENT _Alignof(max_align_t)
+
+#define PROGRAM_ALIGN_UP(size) \
+	(((size) + PROGRAM_ALLOCMEM_ALIGNMENT - 1) & \
+	~(PROGRAM_ALLOCMEM_ALIGNMENT - 1))
+
+#define PROGRAM_ALLOCMEM_HEADER_SIZE \
+	PROGRAM_ALIGN_UP(sizeof(struct program_allocmem_item))
+
+/*
+ * Chunk of the arena of a program, see rtems_bsd_program_call_with_arena().
+ * The blocks are allocated from the free area in the order of the requests.
+ */
+struct program_arena_chunk {
+	struct program_arena_chunk *next;
+	char	*free_area;
+	char	*end;
+};
+
+/* Header in front of each block allocated from an arena */
+struct program_arena_block {
+	size_t	size;
+	uint32_t	site;
+	uintptr_t	magic;
 };
 
+#define PROGRAM_ARENA_MAGIC ((uintptr_t)0xa7e4a5c3)
+
+#define PROGRAM_ARENA_DEFAULT_CHUNK_SIZE 4096
+
+#define PROGRAM_ARENA_CHUNK_HEADER_SIZE \
+	PROGRAM_ALIGN_UP(sizeof(struct program_arena_chunk))
+
+#define PROGRAM_ARENA_BLOCK_HEADER_SIZE \
+	PROGRAM_ALIGN_UP(sizeof(struct program_arena_block))
+
+/*
+ * Allocation totals of a call site, identified by the return address of the
+ * allocation function.  The bytes are the sum of all allocations and the
+ * live bytes the ones not freed yet.
+ */
+struct program_alloc_site {
+	const void *caller;
+	uint32_t	count;
+	size_t	bytes;
+	size_t	live;
+};
+
+/*
+ * Number of call sites tracked per program.  The allocations of further call
+ * sites are accounted to an extra site with a caller of NULL.
+ */
+#define PROGRAM_ALLOC_SITE_BITS 5
+
+#define PROGRAM_ALLOC_SITES (1 << PROGRAM_ALLOC_SITE_BITS)
+
 struct program_destructor {
 	void	(*destructor)(void *);
 	void	*arg;
@@ -71,14 +133,35 @@ struct rtems_bsd_program_control {
 	int exit_code;
 	const char *name;
 	jmp_buf return_context;
-	LIST_HEAD(, program_fd_item) open_fd;
-	LIST_HEAD(, program_file_item) open_file;
+	/*
+	 * The descriptor tables are indexed by the file descriptor and have
+	 * fd_count entries, see rtems_libio_number_iops.  The open_fd bitmap
+	 * tells the descriptors opened by the program, the open_file array
+	 * the streams by the descriptor of the stream.
+	 */
+	int fd_count;
+	uint32_t *open_fd;
+	FILE **open_file;
 	LIST_HEAD(, program_allocmem_item) allocated_mem;
+	struct program_arena_chunk *arena;
+	size_t arena_chunk_size;
 	LIST_HEAD(, program_destructor) destructors;
+	LIST_ENTRY(rtems_bsd_program_control) programs;
+	/* Statistics, see rtems_bsd_program_print_statistics() */
+	size_t mem_current;
+	size_t mem_peak;
+	uint32_t mem_blocks;
+	uint32_t alloc_count;
+	uint32_t free_count;
+	int fd_live;
+	int file_live;
+	struct program_alloc_site alloc_sites[PROGRAM_ALLOC_SITES + 1];
 };
 
 struct rtems_bsd_program_control *rtems_bsd_program_get_control_or_null(void);
 
 int rtems_bsd_program_set_control(struct rtems_bsd_program_control *);
 
+int rtems_bsd_program_fd_insert(struct rtems_bsd_program_control *, int fd);
+
 __END_DECLS
@@ -467,8 +467,12 @@ int rtems_ntpq_query(
   prog_main_argv[0] = (char*) cmd;
   prog_main_argv[1] = (char*) &pcmd;
   prog_main_argv[2] = (char*) rtems_ntpq_outputfp;
-  (void) rtems_bsd_program_call_main(
-    "ntpq", rtems_ntpq_query_main, 3, prog_main_argv);
+  /*
+   * A query allocates many small blocks which are all released when it
+   * returns, so take them from an arena.
+   */
+  (void) rtems_bsd_program_call_main_with_arena(
+    "ntpq", rtems_ntpq_query_main, 3, prog_main_argv, 0);
   memcpy(output, rtems_ntpq_output_buf, min(size, rtems_ntpq_output_buf_size));
   output[size - 1] = '\0';
   rtems_recursive_mutex_unlock(&ntpq_lock);
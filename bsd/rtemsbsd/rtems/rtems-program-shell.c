@@ -0,0 +1,72 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/**
+ * @file
+ *
+ * @ingroup rtems_bsd_rtems
+ *
+ * @brief BSD Program Statistics Shell Command
+ */
+
+/*
+ * Copyright (C) 2026 The RTEMS Project
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <machine/rtems-bsd-program.h>
+
+#include <rtems/shellconfig-net-services.h>
+
+static int rtems_shell_progstat_command(int argc, char **argv) {
+  const char *name = NULL;
+
+  if (argc > 2 || (argc == 2 && strcmp(argv[1], "help") == 0)) {
+    printf("usage: %s [name]\n", argv[0]);
+    return argc == 2 ? 0 : 1;
+  }
+
+  if (argc == 2) {
+    name = argv[1];
+  }
+
+  if (rtems_bsd_program_print_statistics(stdout, name) == 0) {
+    printf("no running program%s%s\n", name != NULL ? " " : "",
+      name != NULL ? name : "");
+    return name != NULL ? 1 : 0;
+  }
+
+  return 0;
+}
+
+rtems_shell_cmd_t rtems_shell_PROGSTAT_Command =
+{
+    "progstat",
+    "[name]",
+    "misc",
+    rtems_shell_progstat_command,
+    NULL,
+    NULL
+};
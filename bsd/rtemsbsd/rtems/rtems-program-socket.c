@@ -40,11 +40,11 @@
 #include <sys/socket.h>
 
 #include <errno.h>
-#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #define RTEMS_BSD_PROGRAM_NO_SOCKET_WRAP
-#define RTEMS_BSD_PROGRAM_NO_CALLOC_WRAP
-#define RTEMS_BSD_PROGRAM_NO_FREE_WRAP
+#define RTEMS_BSD_PROGRAM_NO_CLOSE_WRAP
 #include <machine/rtems-bsd-program.h>
 
 #include "program-internal.h"
@@ -53,7 +53,6 @@ int
 rtems_bsd_program_socket(int domain, int type, int protocol)
 {
 	struct rtems_bsd_program_control *prog_ctrl;
-	struct program_fd_item *item;
 	int fd;
 
 	prog_ctrl = rtems_bsd_program_get_control_or_null();
@@ -62,17 +61,11 @@ rtems_bsd_program_socket(int domain, int type, int protocol)
 		return (-1);
 	}
 
-	item = calloc(1, sizeof(*item));
-	if (item == NULL) {
-		return (-1);
-	}
-
 	fd = socket(domain, type, protocol);
-	if (fd >= 0) {
-		item->fd = fd;
-		LIST_INSERT_HEAD(&prog_ctrl->open_fd, item, entries);
-	} else {
-		free(item);
+	if (fd >= 0 && rtems_bsd_program_fd_insert(prog_ctrl, fd) != 0) {
+		(void)close(fd);
+		errno = EMFILE;
+		fd = -1;
 	}
 
 	return (fd);
@@ -42,12 +42,19 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <syslog.h>
 #include <unistd.h>
 
+#include <rtems/libio_.h>
+#include <rtems/thread.h>
+
 #define RTEMS_BSD_PROGRAM_NO_OPEN_WRAP
 #define RTEMS_BSD_PROGRAM_NO_CLOSE_WRAP
 #define RTEMS_BSD_PROGRAM_NO_FOPEN_WRAP
@@ -63,24 +70,57 @@
 
 #include "program-internal.h"
 
+/* The programs running, see rtems_bsd_program_print_statistics() */
+static LIST_HEAD(, rtems_bsd_program_control) program_list =
+    LIST_HEAD_INITIALIZER(program_list);
+
+static rtems_mutex program_list_mutex =
+    RTEMS_MUTEX_INITIALIZER("BSD Program List");
+
+int
+rtems_bsd_program_fd_insert(struct rtems_bsd_program_control *prog_ctrl,
+    int fd)
+{
+	uint32_t *word;
+	uint32_t bit;
+
+	if (fd < 0 || fd >= prog_ctrl->fd_count) {
+		return (-1);
+	}
+
+	/*
+	 * The bit may be still set if the descriptor was closed outside of the
+	 * wrapper and the number is reused.
+	 */
+	word = &prog_ctrl->open_fd[fd / PROGRAM_FD_MAP_BITS];
+	bit = UINT32_C(1) << (fd % PROGRAM_FD_MAP_BITS);
+	if ((*word & bit) == 0) {
+		*word |= bit;
+		++prog_ctrl->fd_live;
+	}
+
+	return (0);
+}
+
 static int
 fd_remove(struct rtems_bsd_program_control *prog_ctrl, int fd)
 {
-	struct program_fd_item *current;
-	int rv = -1;
+	uint32_t *word;
+	uint32_t bit;
 
-	for (current = prog_ctrl->open_fd.lh_first;
-	    current != NULL;
-	    current = current->entries.le_next) {
-		if (current->fd == fd) {
-			LIST_REMOVE(current, entries);
-			free(current);
-			rv = 0;
-			break;
-		}
+	if (fd < 0 || fd >= prog_ctrl->fd_count) {
+		return (-1);
 	}
 
-	return rv;
+	word = &prog_ctrl->open_fd[fd / PROGRAM_FD_MAP_BITS];
+	bit = UINT32_C(1) << (fd % PROGRAM_FD_MAP_BITS);
+	if ((*word & bit) == 0) {
+		return (-1);
+	}
+
+	*word &= ~bit;
+	--prog_ctrl->fd_live;
+	return (0);
 }
 
 static int
@@ -99,41 +139,57 @@ fd_close_remove(struct rtems_bsd_program_control *prog_ctrl, int fd)
 static void
 fd_close_all(struct rtems_bsd_program_control *prog_ctrl)
 {
-	while(prog_ctrl->open_fd.lh_first != NULL) {
-		struct program_fd_item *current;
-		int fd;
-		int rv;
+	int i;
 
-		current = prog_ctrl->open_fd.lh_first;
-		fd = current->fd;
+	for (i = 0; i < PROGRAM_FD_MAP_WORDS(prog_ctrl->fd_count); ++i) {
+		uint32_t word;
 
-		rv = fd_close_remove(prog_ctrl, fd);
-		if (rv != 0) {
-			syslog(LOG_ERR,
-			    "BSD Program: Could not close file %d or could not remove it from list of open files",
-			    fd);
+		while ((word = prog_ctrl->open_fd[i]) != 0) {
+			int fd;
+			int rv;
+
+			fd = i * PROGRAM_FD_MAP_BITS + ffs((int)word) - 1;
+
+			rv = fd_close_remove(prog_ctrl, fd);
+			if (rv != 0) {
+				syslog(LOG_ERR,
+				    "BSD Program: Could not close file %d or could not remove it from list of open files",
+				    fd);
+			}
 		}
 	}
 }
 
+static int
+file_insert(struct rtems_bsd_program_control *prog_ctrl, FILE *file)
+{
+	int fd = fileno(file);
+
+	if (fd < 0 || fd >= prog_ctrl->fd_count) {
+		return (EOF);
+	}
+
+	if (prog_ctrl->open_file[fd] == NULL) {
+		++prog_ctrl->file_live;
+	}
+
+	prog_ctrl->open_file[fd] = file;
+	return (0);
+}
+
 static int
 file_remove(struct rtems_bsd_program_control *prog_ctrl, FILE *file)
 {
-	struct program_file_item *current;
-	int rv = EOF;
+	int fd = fileno(file);
 
-	for (current = prog_ctrl->open_file.lh_first;
-	    current != NULL;
-	    current = current->entries.le_next) {
-		if (current->file == file) {
-			LIST_REMOVE(current, entries);
-			free(current);
-			rv = 0;
-			break;
-		}
+	if (fd < 0 || fd >= prog_ctrl->fd_count ||
+	    prog_ctrl->open_file[fd] != file) {
+		return (EOF);
 	}
 
-	return rv;
+	prog_ctrl->open_file[fd] = NULL;
+	--prog_ctrl->file_live;
+	return (0);
 }
 
 static int
@@ -152,13 +208,16 @@ file_close_remove(struct rtems_bsd_program_control *prog_ctrl, FILE *file)
 static void
 file_close_all(struct rtems_bsd_program_control *prog_ctrl)
 {
-	while(prog_ctrl->open_file.lh_first != NULL) {
-		struct program_file_item *current;
+	int fd;
+
+	for (fd = 0; fd < prog_ctrl->fd_count; ++fd) {
 		FILE *file;
 		int rv;
 
-		current = prog_ctrl->open_file.lh_first;
-		file = current->file;
+		file = prog_ctrl->open_file[fd];
+		if (file == NULL) {
+			continue;
+		}
 
 		rv = file_close_remove(prog_ctrl, file);
 		if (rv != 0) {
@@ -169,33 +228,108 @@ file_close_all(struct rtems_bsd_program_control *prog_ctrl)
 	}
 }
 
-static int
-allocmem_remove(struct rtems_bsd_program_control *prog_ctrl, void *ptr)
+/*
+ * Returns the index of the call site in the statistics of the program.  The
+ * call sites are kept in a hash table with linear probing.  The index is
+ * taken from the high bits of the Fibonacci hash, the low bits of the
+ * product depend only on the low bits of the address.
+ */
+static uint32_t
+alloc_site(struct rtems_bsd_program_control *prog_ctrl, const void *caller)
 {
-	struct program_allocmem_item *current;
-	int rv = -1;
+	uint32_t index;
+	uint32_t i;
 
-	for (current = prog_ctrl->allocated_mem.lh_first;
-	    current != NULL;
-	    current = current->entries.le_next) {
-		if (current->ptr == ptr) {
-			LIST_REMOVE(current, entries);
-			rv = 0;
-			break;
+	if (caller == NULL) {
+		return (PROGRAM_ALLOC_SITES);
+	}
+
+	index = ((uint32_t)((uintptr_t)caller >> 2) * UINT32_C(2654435761)) >>
+	    (32 - PROGRAM_ALLOC_SITE_BITS);
+
+	for (i = 0; i < PROGRAM_ALLOC_SITES; ++i) {
+		struct program_alloc_site *site =
+		    &prog_ctrl->alloc_sites[index];
+
+		if (site->caller == caller) {
+			return (index);
+		}
+
+		if (site->caller == NULL) {
+			site->caller = caller;
+			return (index);
 		}
+
+		index = (index + 1) % PROGRAM_ALLOC_SITES;
 	}
 
-	return rv;
+	return (PROGRAM_ALLOC_SITES);
+}
+
+static void
+alloc_account(struct rtems_bsd_program_control *prog_ctrl, uint32_t index,
+    size_t size)
+{
+	struct program_alloc_site *site = &prog_ctrl->alloc_sites[index];
+
+	++prog_ctrl->alloc_count;
+	prog_ctrl->mem_current += size;
+	if (prog_ctrl->mem_current > prog_ctrl->mem_peak) {
+		prog_ctrl->mem_peak = prog_ctrl->mem_current;
+	}
+
+	++site->count;
+	site->bytes += size;
+	site->live += size;
+}
+
+static void
+free_account(struct rtems_bsd_program_control *prog_ctrl, uint32_t index,
+    size_t size)
+{
+	prog_ctrl->mem_current -= size;
+	prog_ctrl->alloc_sites[index].live -= size;
+}
+
+static void
+allocmem_insert(struct rtems_bsd_program_control *prog_ctrl,
+    struct program_allocmem_item *item)
+{
+	item->magic = (uintptr_t)item ^ PROGRAM_ALLOCMEM_MAGIC;
+	LIST_INSERT_HEAD(&prog_ctrl->allocated_mem, item, entries);
+}
+
+/*
+ * The list linkage is in the header in front of the block, so the removal
+ * does not need to search the list.
+ */
+static struct program_allocmem_item *
+allocmem_remove(void *ptr)
+{
+	struct program_allocmem_item *item;
+
+	item = (struct program_allocmem_item *)
+	    ((char *)ptr - PROGRAM_ALLOCMEM_HEADER_SIZE);
+	if (item->magic != ((uintptr_t)item ^ PROGRAM_ALLOCMEM_MAGIC)) {
+		return (NULL);
+	}
+
+	item->magic = 0;
+	LIST_REMOVE(item, entries);
+	return (item);
 }
 
 static int
 allocmem_free_remove(struct rtems_bsd_program_control *prog_ctrl, void *ptr)
 {
+	struct program_allocmem_item *item;
 	int rv = -1;
 
-	rv = allocmem_remove(prog_ctrl, ptr);
-	if (rv == 0) {
-		free(ptr);
+	item = allocmem_remove(ptr);
+	if (item != NULL) {
+		free_account(prog_ctrl, item->site, item->size);
+		free(item);
+		rv = 0;
 	}
 
 	return rv;
@@ -204,24 +338,185 @@ allocmem_free_remove(struct rtems_bsd_program_control *prog_ctrl, void *ptr)
 static void
 allocmem_free_all(struct rtems_bsd_program_control *prog_ctrl)
 {
-	while(prog_ctrl->allocated_mem.lh_first != NULL) {
-		struct program_allocmem_item *current;
-		void *ptr;
-		int rv;
+	struct program_allocmem_item *item;
+	struct program_allocmem_item *tmp;
+
+	LIST_FOREACH_SAFE(item, &prog_ctrl->allocated_mem, entries, tmp) {
+		free(item);
+	}
 
-		current = prog_ctrl->allocated_mem.lh_first;
-		ptr = current->ptr;
+	LIST_INIT(&prog_ctrl->allocated_mem);
+}
 
-		rv = allocmem_free_remove(prog_ctrl, ptr);
-		if (rv != 0) {
-			/* This should never happen. It would mean that someone
-			 * changed the allocmem list while we are removing the
-			 * element. */
-			syslog(LOG_ERR,
-			    "BSD Program: Could not remove %p from list of allocated memory",
-			    ptr);
+/*
+ * Adds a chunk.  A chunk for a single block is added behind the first chunk,
+ * so that the first chunk is kept for the next blocks.
+ */
+static struct program_arena_chunk *
+arena_add_chunk(struct rtems_bsd_program_control *prog_ctrl, size_t size,
+    bool single)
+{
+	struct program_arena_chunk *chunk;
+	struct program_arena_chunk *head = prog_ctrl->arena;
+
+	chunk = malloc(PROGRAM_ARENA_CHUNK_HEADER_SIZE + size);
+	if (chunk == NULL) {
+		return (NULL);
+	}
+
+	chunk->free_area = (char *)chunk + PROGRAM_ARENA_CHUNK_HEADER_SIZE;
+	chunk->end = chunk->free_area + size;
+
+	if (head != NULL && single) {
+		chunk->next = head->next;
+		head->next = chunk;
+	} else {
+		chunk->next = head;
+		prog_ctrl->arena = chunk;
+	}
+
+	return (chunk);
+}
+
+/*
+ * Allocates the block from the first chunk.  A block which is larger than a
+ * quarter of a chunk and does not fit into the first chunk gets a chunk of
+ * its own, so that the rest of the first chunk is not wasted.
+ */
+static struct program_arena_block *
+arena_alloc(struct rtems_bsd_program_control *prog_ctrl, size_t size)
+{
+	struct program_arena_chunk *chunk = prog_ctrl->arena;
+	struct program_arena_block *block;
+	size_t need;
+
+	if (size > SIZE_MAX - PROGRAM_ARENA_CHUNK_HEADER_SIZE -
+	    PROGRAM_ARENA_BLOCK_HEADER_SIZE - PROGRAM_ALLOCMEM_ALIGNMENT) {
+		errno = ENOMEM;
+		return (NULL);
+	}
+
+	need = PROGRAM_ARENA_BLOCK_HEADER_SIZE + PROGRAM_ALIGN_UP(size);
+
+	if (chunk == NULL || (size_t)(chunk->end - chunk->free_area) < need) {
+		bool single = need > prog_ctrl->arena_chunk_size / 4;
+
+		chunk = arena_add_chunk(prog_ctrl,
+		    single ? need : prog_ctrl->arena_chunk_size, single);
+		if (chunk == NULL) {
+			errno = ENOMEM;
+			return (NULL);
+		}
+	}
+
+	block = (struct program_arena_block *)chunk->free_area;
+	chunk->free_area += need;
+	block->size = size;
+	block->magic = (uintptr_t)block ^ PROGRAM_ARENA_MAGIC;
+	return (block);
+}
+
+static struct program_arena_block *
+arena_block(void *ptr)
+{
+	struct program_arena_block *block;
+
+	block = (struct program_arena_block *)
+	    ((char *)ptr - PROGRAM_ARENA_BLOCK_HEADER_SIZE);
+	if (block->magic != ((uintptr_t)block ^ PROGRAM_ARENA_MAGIC)) {
+		return (NULL);
+	}
+
+	return (block);
+}
+
+/* Returns true if the block is the last one allocated from the first chunk */
+static bool
+arena_is_last(struct rtems_bsd_program_control *prog_ctrl,
+    struct program_arena_block *block)
+{
+	struct program_arena_chunk *chunk = prog_ctrl->arena;
+
+	return (chunk != NULL && (char *)block +
+	    PROGRAM_ARENA_BLOCK_HEADER_SIZE + PROGRAM_ALIGN_UP(block->size) ==
+	    chunk->free_area);
+}
+
+/*
+ * The space of a block is only reused if it was the last one allocated,
+ * everything else is released with the arena.
+ */
+static int
+arena_free(struct rtems_bsd_program_control *prog_ctrl, void *ptr)
+{
+	struct program_arena_block *block;
+
+	block = arena_block(ptr);
+	if (block == NULL) {
+		return (-1);
+	}
+
+	if (arena_is_last(prog_ctrl, block)) {
+		prog_ctrl->arena->free_area = (char *)block;
+	}
+
+	free_account(prog_ctrl, block->site, block->size);
+	block->magic = 0;
+	return (0);
+}
+
+static void *
+arena_realloc(struct rtems_bsd_program_control *prog_ctrl, void *org_ptr,
+    size_t size)
+{
+	struct program_arena_block *org_block = NULL;
+	struct program_arena_block *block;
+	void *ptr;
+
+	if (org_ptr != NULL) {
+		org_block = arena_block(org_ptr);
+		assert(org_block != NULL);
+
+		if (arena_is_last(prog_ctrl, org_block) &&
+		    size <= (size_t)(prog_ctrl->arena->end -
+		    (char *)org_ptr) &&
+		    PROGRAM_ALIGN_UP(size) <= (size_t)(prog_ctrl->arena->end -
+		    (char *)org_ptr)) {
+			/* Grow or shrink in place */
+			prog_ctrl->arena->free_area = (char *)org_ptr +
+			    PROGRAM_ALIGN_UP(size);
+			org_block->size = size;
+			return (org_ptr);
 		}
 	}
+
+	block = arena_alloc(prog_ctrl, size);
+	if (block == NULL) {
+		return (NULL);
+	}
+
+	ptr = (char *)block + PROGRAM_ARENA_BLOCK_HEADER_SIZE;
+	if (org_block != NULL) {
+		memcpy(ptr, org_ptr,
+		    org_block->size < size ? org_block->size : size);
+		org_block->magic = 0;
+	}
+
+	return (ptr);
+}
+
+static void
+arena_free_all(struct rtems_bsd_program_control *prog_ctrl)
+{
+	struct program_arena_chunk *chunk;
+	struct program_arena_chunk *next;
+
+	for (chunk = prog_ctrl->arena; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+
+	prog_ctrl->arena = NULL;
 }
 
 static void
@@ -236,14 +531,19 @@ call_destructors(struct rtems_bsd_program_control *prog_ctrl)
 	}
 }
 
-int
-rtems_bsd_program_call(const char *name, int (*prog)(void *), void *context)
+static int
+program_call(const char *name, int (*prog)(void *), void *context,
+    size_t arena_chunk_size)
 {
 	struct rtems_bsd_program_control *prog_ctrl;
+	int fd_count = (int)rtems_libio_number_iops;
 	int error;
 	int exit_code;
 
-	prog_ctrl = calloc(1, sizeof(*prog_ctrl));
+	/* The descriptor tables follow the control */
+	prog_ctrl = calloc(1, sizeof(*prog_ctrl) +
+	    fd_count * sizeof(*prog_ctrl->open_file) +
+	    PROGRAM_FD_MAP_WORDS(fd_count) * sizeof(*prog_ctrl->open_fd));
 	if (prog_ctrl == NULL) {
 		errno = ENOMEM;
 		return (EXIT_FAILURE);
@@ -259,12 +559,18 @@ rtems_bsd_program_call(const char *name, int (*prog)(void *), void *context)
 	prog_ctrl->context = context;
 	prog_ctrl->name = name;
 	prog_ctrl->exit_code = EXIT_FAILURE;
+	prog_ctrl->arena_chunk_size = arena_chunk_size;
+	prog_ctrl->fd_count = fd_count;
+	prog_ctrl->open_file = (FILE **)(prog_ctrl + 1);
+	prog_ctrl->open_fd = (uint32_t *)(prog_ctrl->open_file + fd_count);
 
-	LIST_INIT(&prog_ctrl->open_fd);
-	LIST_INIT(&prog_ctrl->open_file);
 	LIST_INIT(&prog_ctrl->allocated_mem);
 	LIST_INIT(&prog_ctrl->destructors);
 
+	rtems_mutex_lock(&program_list_mutex);
+	LIST_INSERT_HEAD(&program_list, prog_ctrl, programs);
+	rtems_mutex_unlock(&program_list_mutex);
+
 	if (setjmp(prog_ctrl->return_context) == 0) {
 		exit_code = (*prog)(context);
 	} else {
@@ -272,14 +578,40 @@ rtems_bsd_program_call(const char *name, int (*prog)(void *), void *context)
 	}
 
 	rtems_bsd_program_set_control(NULL);
+	rtems_mutex_lock(&program_list_mutex);
+	LIST_REMOVE(prog_ctrl, programs);
+	rtems_mutex_unlock(&program_list_mutex);
 	fd_close_all(prog_ctrl);
 	file_close_all(prog_ctrl);
 	allocmem_free_all(prog_ctrl);
+	arena_free_all(prog_ctrl);
 	call_destructors(prog_ctrl);
 	free(prog_ctrl);
 	return (exit_code);
 }
 
+int
+rtems_bsd_program_call(const char *name, int (*prog)(void *), void *context)
+{
+	return (program_call(name, prog, context, 0));
+}
+
+/*
+ * The allocations of the program come from chunks of the given size and are
+ * released all at once when the program returns.  This is meant for short
+ * programs which allocate many small blocks.
+ */
+int
+rtems_bsd_program_call_with_arena(const char *name, int (*prog)(void *),
+    void *context, size_t chunk_size)
+{
+	if (chunk_size == 0) {
+		chunk_size = PROGRAM_ARENA_DEFAULT_CHUNK_SIZE;
+	}
+
+	return (program_call(name, prog, context, chunk_size));
+}
+
 void *
 rtems_bsd_program_add_destructor(void (*destructor)(void *), void *arg)
 {
@@ -370,6 +702,131 @@ rtems_bsd_program_get_context(void)
 	return context;
 }
 
+struct program_statistics {
+	char name[32];
+	size_t mem_current;
+	size_t mem_peak;
+	uint32_t mem_blocks;
+	uint32_t alloc_count;
+	uint32_t free_count;
+	int fd_live;
+	int file_live;
+	struct program_alloc_site alloc_sites[PROGRAM_ALLOC_SITES + 1];
+};
+
+/*
+ * Copies the statistics of the running program with the given index, only
+ * programs with the given name count if the name is not NULL.  The program
+ * may end as soon as the mutex is released, so the statistics are copied.
+ */
+static bool
+program_get_statistics(int index, const char *name,
+    struct program_statistics *stats)
+{
+	struct rtems_bsd_program_control *prog_ctrl;
+	bool found = false;
+
+	rtems_mutex_lock(&program_list_mutex);
+
+	LIST_FOREACH(prog_ctrl, &program_list, programs) {
+		if (name != NULL && strcmp(prog_ctrl->name, name) != 0) {
+			continue;
+		}
+
+		if (index == 0) {
+			snprintf(stats->name, sizeof(stats->name), "%s",
+			    prog_ctrl->name);
+			stats->mem_current = prog_ctrl->mem_current;
+			stats->mem_peak = prog_ctrl->mem_peak;
+			stats->mem_blocks = prog_ctrl->mem_blocks;
+			stats->alloc_count = prog_ctrl->alloc_count;
+			stats->free_count = prog_ctrl->free_count;
+			stats->fd_live = prog_ctrl->fd_live;
+			stats->file_live = prog_ctrl->file_live;
+			memcpy(stats->alloc_sites, prog_ctrl->alloc_sites,
+			    sizeof(stats->alloc_sites));
+			found = true;
+			break;
+		}
+
+		--index;
+	}
+
+	rtems_mutex_unlock(&program_list_mutex);
+	return (found);
+}
+
+/* Orders the call sites by live bytes and then by all bytes */
+static int
+alloc_site_compare(const void *a, const void *b)
+{
+	const struct program_alloc_site *sa = a;
+	const struct program_alloc_site *sb = b;
+
+	if (sa->live != sb->live) {
+		return (sa->live < sb->live ? 1 : -1);
+	}
+
+	if (sa->bytes != sb->bytes) {
+		return (sa->bytes < sb->bytes ? 1 : -1);
+	}
+
+	return (0);
+}
+
+/*
+ * Prints the memory, descriptor and call site statistics of the running
+ * programs, or of the ones with the given name.  The call sites are the
+ * return addresses of the allocations, use addr2line to find the source
+ * lines.  Returns the number of programs printed.
+ */
+int
+rtems_bsd_program_print_statistics(FILE *file, const char *name)
+{
+	struct program_statistics stats;
+	int n;
+
+	for (n = 0; program_get_statistics(n, name, &stats); ++n) {
+		size_t i;
+
+		fprintf(file,
+		    "%s:\n"
+		    "  memory: %zu bytes in %" PRIu32 " blocks, peak %zu bytes\n"
+		    "  allocations: %" PRIu32 ", frees: %" PRIu32 "\n"
+		    "  descriptors: %d, streams: %d\n"
+		    "  %-18s %12s %12s %12s\n",
+		    stats.name, stats.mem_current, stats.mem_blocks,
+		    stats.mem_peak, stats.alloc_count, stats.free_count,
+		    stats.fd_live, stats.file_live, "call site",
+		    "allocations", "bytes", "live bytes");
+
+		qsort(stats.alloc_sites, PROGRAM_ALLOC_SITES + 1,
+		    sizeof(stats.alloc_sites[0]), alloc_site_compare);
+
+		for (i = 0; i < PROGRAM_ALLOC_SITES + 1; ++i) {
+			const struct program_alloc_site *site =
+			    &stats.alloc_sites[i];
+			char caller[24];
+
+			if (site->count == 0) {
+				continue;
+			}
+
+			if (site->caller != NULL) {
+				snprintf(caller, sizeof(caller), "%p",
+				    site->caller);
+			} else {
+				snprintf(caller, sizeof(caller), "other");
+			}
+
+			fprintf(file, "  %-18s %12" PRIu32 " %12zu %12zu\n",
+			    caller, site->count, site->bytes, site->live);
+		}
+	}
+
+	return (n);
+}
+
 struct main_context {
 	int argc;
 	char **argv;
@@ -384,9 +841,9 @@ call_main(void *ctx)
 	return (*mc->main)(mc->argc, mc->argv);
 }
 
-int
-rtems_bsd_program_call_main(const char *name, int (*main)(int, char **),
-    int argc, char **argv)
+static int
+program_call_main(const char *name, int (*main)(int, char **),
+    int argc, char **argv, size_t arena_chunk_size)
 {
 	struct main_context mc = {
 		.argc = argc,
@@ -396,7 +853,8 @@ rtems_bsd_program_call_main(const char *name, int (*main)(int, char **),
 	int exit_code;
 
 	if (argv[argc] == NULL) {
-		exit_code = rtems_bsd_program_call(name, call_main, &mc);
+		exit_code = program_call(name, call_main, &mc,
+		    arena_chunk_size);
 	} else {
 		errno = EFAULT;
 		exit_code = EXIT_FAILURE;
@@ -405,6 +863,24 @@ rtems_bsd_program_call_main(const char *name, int (*main)(int, char **),
 	return exit_code;
 }
 
+int
+rtems_bsd_program_call_main(const char *name, int (*main)(int, char **),
+    int argc, char **argv)
+{
+	return (program_call_main(name, main, argc, argv, 0));
+}
+
+int
+rtems_bsd_program_call_main_with_arena(const char *name,
+    int (*main)(int, char **), int argc, char **argv, size_t chunk_size)
+{
+	if (chunk_size == 0) {
+		chunk_size = PROGRAM_ARENA_DEFAULT_CHUNK_SIZE;
+	}
+
+	return (program_call_main(name, main, argc, argv, chunk_size));
+}
+
 int
 rtems_bsd_program_call_main_with_data_restore(const char *name,
     int (*main)(int, char **), int argc, char **argv,
@@ -428,6 +904,59 @@ rtems_bsd_program_call_main_with_data_restore(const char *name,
 	return exit_code;
 }
 
+/*
+ * Takes the snapshot of the data once.  The copy buffer may be provided by
+ * the caller, otherwise it is allocated here.  All the data is restored
+ * after each call of the program.
+ */
+int
+rtems_bsd_program_data_snapshot_init(
+    struct rtems_bsd_program_data_snapshot *snapshot, void *data_buf,
+    size_t data_size, void *copy_buf)
+{
+	snapshot->copy_allocated = false;
+
+	if (copy_buf == NULL) {
+		copy_buf = malloc(data_size);
+		if (copy_buf == NULL) {
+			errno = ENOMEM;
+			return (-1);
+		}
+
+		snapshot->copy_allocated = true;
+	}
+
+	memcpy(copy_buf, data_buf, data_size);
+	snapshot->data = data_buf;
+	snapshot->copy = copy_buf;
+	snapshot->size = data_size;
+	return (0);
+}
+
+void
+rtems_bsd_program_data_snapshot_destroy(
+    struct rtems_bsd_program_data_snapshot *snapshot)
+{
+	if (snapshot->copy_allocated) {
+		free(snapshot->copy);
+	}
+
+	snapshot->copy = NULL;
+	snapshot->copy_allocated = false;
+}
+
+int
+rtems_bsd_program_call_main_with_data_snapshot(const char *name,
+    int (*main)(int, char **), int argc, char **argv,
+    struct rtems_bsd_program_data_snapshot *snapshot)
+{
+	int exit_code;
+
+	exit_code = rtems_bsd_program_call_main(name, main, argc, argv);
+	memcpy(snapshot->data, snapshot->copy, snapshot->size);
+	return exit_code;
+}
+
 int
 rtems_bsd_program_open(const char *path, int oflag, ...)
 {
@@ -438,26 +967,18 @@ rtems_bsd_program_open(const char *path, int oflag, ...)
 	int fd = -1;
 
 	if (prog_ctrl != NULL) {
-		struct program_fd_item *item =
-		    malloc(sizeof(*item));
+		va_start(list, oflag);
+		mode = va_arg(list, mode_t);
 
-		if (item != NULL) {
-			va_start(list, oflag);
-			mode = va_arg(list, mode_t);
-
-			fd = open(path, oflag, mode);
+		fd = open(path, oflag, mode);
 
-			va_end(list);
+		va_end(list);
 
-			if (fd != -1) {
-				item->fd = fd;
-				LIST_INSERT_HEAD(&(prog_ctrl->open_fd),
-				    item, entries);
-			} else {
-				free(item);
-			}
-		} else {
-			errno = ENOMEM;
+		if (fd != -1 &&
+		    rtems_bsd_program_fd_insert(prog_ctrl, fd) != 0) {
+			(void)close(fd);
+			errno = EMFILE;
+			fd = -1;
 		}
 	}
 
@@ -487,21 +1008,12 @@ rtems_bsd_program_fopen(const char *restrict filename,
 	    rtems_bsd_program_get_control_or_null();
 
 	if (prog_ctrl != NULL) {
-		struct program_file_item *item = malloc(sizeof(*item));
-
-		if (item != NULL) {
-			file = fopen(filename, mode);
+		file = fopen(filename, mode);
 
-			if (file != NULL) {
-				item->file = file;
-				LIST_INSERT_HEAD(
-				    &(prog_ctrl->open_file), item,
-				    entries);
-			} else {
-				free(item);
-			}
-		} else {
-			errno = ENOMEM;
+		if (file != NULL && file_insert(prog_ctrl, file) != 0) {
+			(void)fclose(file);
+			errno = EMFILE;
+			file = NULL;
 		}
 	}
 
@@ -523,38 +1035,70 @@ rtems_bsd_program_fclose(FILE *file)
 }
 
 static void *
-rtems_bsd_program_alloc(size_t size, void *org_ptr)
+rtems_bsd_program_alloc(size_t size, void *org_ptr, const void *caller)
 {
 	struct rtems_bsd_program_control *prog_ctrl =
 	    rtems_bsd_program_get_control_or_null();
+	struct program_allocmem_item *org_item = NULL;
+	struct program_allocmem_item *item;
 	void *ptr = NULL;
-	size_t size_with_list;
-	size_t size_alligned;
-	size_t alignment = sizeof(void*);
 
-	if (prog_ctrl != NULL) {
-		/* align the end to the next word address */
-		size_alligned = size;
-		if ((size_alligned & (alignment - 1)) != 0) {
-			size_alligned = (size_alligned | (alignment - 1)) + 1;
+	if (prog_ctrl != NULL && prog_ctrl->arena_chunk_size != 0) {
+		struct program_arena_block *block;
+		size_t org_size = 0;
+		uint32_t org_site = 0;
+
+		if (org_ptr != NULL) {
+			block = arena_block(org_ptr);
+			assert(block != NULL);
+			org_size = block->size;
+			org_site = block->site;
+		}
+
+		ptr = arena_realloc(prog_ctrl, org_ptr, size);
+
+		if (ptr != NULL) {
+			if (org_ptr != NULL) {
+				free_account(prog_ctrl, org_site, org_size);
+			} else {
+				++prog_ctrl->mem_blocks;
+			}
+
+			block = arena_block(ptr);
+			block->site = alloc_site(prog_ctrl, caller);
+			alloc_account(prog_ctrl, block->site, size);
+		}
+	} else if (prog_ctrl != NULL) {
+		if (size > SIZE_MAX - PROGRAM_ALLOCMEM_HEADER_SIZE) {
+			errno = ENOMEM;
+			return (NULL);
 		}
-		size_with_list = size_alligned +
-		    sizeof(struct program_allocmem_item);
 
 		if (org_ptr != NULL) {
-			/* It's a reallocation. So first remove the old pointer
+			/* It's a reallocation. So first remove the old block
 			 * from the list */
-			allocmem_remove(prog_ctrl, org_ptr);
+			org_item = allocmem_remove(org_ptr);
+			assert(org_item != NULL);
 		}
 
-		ptr = realloc(org_ptr, size_with_list);
+		item = realloc(org_item, PROGRAM_ALLOCMEM_HEADER_SIZE + size);
 
-		if (ptr != NULL) {
-			struct program_allocmem_item *item;
-			item = ptr + size_alligned;
-			item->ptr = ptr;
-			LIST_INSERT_HEAD(&(prog_ctrl->allocated_mem),
-			    item, entries);
+		if (item != NULL) {
+			if (org_item != NULL) {
+				/* The header moved along with the block */
+				free_account(prog_ctrl, item->site, item->size);
+			} else {
+				++prog_ctrl->mem_blocks;
+			}
+
+			item->size = size;
+			item->site = alloc_site(prog_ctrl, caller);
+			alloc_account(prog_ctrl, item->site, size);
+			allocmem_insert(prog_ctrl, item);
+			ptr = (char *)item + PROGRAM_ALLOCMEM_HEADER_SIZE;
+		} else if (org_item != NULL) {
+			/* The old block is still valid */
+			allocmem_insert(prog_ctrl, org_item);
 		}
 	}
 
@@ -564,7 +1108,8 @@ rtems_bsd_program_alloc(size_t size, void *org_ptr)
 void *
 rtems_bsd_program_malloc(size_t size)
 {
-	return rtems_bsd_program_alloc(size, NULL);
+	return rtems_bsd_program_alloc(size, NULL,
+	    __builtin_return_address(0));
 }
 
 void *
@@ -573,7 +1118,8 @@ rtems_bsd_program_calloc(size_t nelem, size_t elsize)
 	void *ptr;
 	size_t size = elsize * nelem;
 
-	ptr = rtems_bsd_program_alloc(size, NULL);
+	ptr = rtems_bsd_program_alloc(size, NULL,
+	    __builtin_return_address(0));
 	if (ptr != NULL) {
 		memset(ptr, 0, size);
 	}
@@ -584,15 +1130,27 @@ rtems_bsd_program_calloc(size_t nelem, size_t elsize)
 void *
 rtems_bsd_program_realloc(void *ptr, size_t size)
 {
-	return rtems_bsd_program_alloc(size, ptr);
+	return rtems_bsd_program_alloc(size, ptr,
+	    __builtin_return_address(0));
+}
+
+/*
+ * Accounts the block to the given call site instead of the caller, for
+ * allocation functions which wrap realloc() like ereallocz() of NTP.
+ */
+void *
+rtems_bsd_program_realloc_site(void *ptr, size_t size, const void *site)
+{
+	return rtems_bsd_program_alloc(size, ptr, site);
 }
 
 void *
 rtems_bsd_program_reallocf(void *ptr, size_t size)
 {
-	void *ret = rtems_bsd_program_alloc(size, ptr);
+	void *ret = rtems_bsd_program_alloc(size, ptr,
+	    __builtin_return_address(0));
 	if (ret == NULL) {
-		free(ptr);
+		rtems_bsd_program_free(ptr);
 	}
 	return ret;
 }
@@ -604,7 +1162,7 @@ rtems_bsd_program_strdup(const char *s)
 	void *s2;
 
 	size = strlen(s) + 1;
-	s2 = rtems_bsd_program_alloc(size, NULL);
+	s2 = rtems_bsd_program_alloc(size, NULL, __builtin_return_address(0));
 	if (s2 == NULL) {
 		return (NULL);
 	}
@@ -615,19 +1173,23 @@ rtems_bsd_program_strdup(const char *s)
 char *
 rtems_bsd_program_strndup(const char *s, size_t size)
 {
-	void *s2;
+	char *s2;
 
-	size = strnlen(s, size) + 1;
-	s2 = rtems_bsd_program_alloc(size, NULL);
+	size = strnlen(s, size);
+	s2 = rtems_bsd_program_alloc(size + 1, NULL,
+	    __builtin_return_address(0));
 	if (s2 == NULL) {
 		return (NULL);
 	}
 
-	return (memcpy(s2, s, size));
+	memcpy(s2, s, size);
+	s2[size] = '\0';
+	return (s2);
 }
 
-int
-rtems_bsd_program_vasprintf(char **strp, const char *fmt, va_list ap)
+static int
+program_vasprintf(char **strp, const char *fmt, va_list ap,
+    const void *caller)
 {
 	va_list aq;
 	int size;
@@ -638,7 +1200,7 @@ rtems_bsd_program_vasprintf(char **strp, const char *fmt, va_list ap)
 	va_end(aq);
 
 	size += 1; /* Add space for terminating null byte */
-	*strp = rtems_bsd_program_alloc(size, NULL);
+	*strp = rtems_bsd_program_alloc(size, NULL, caller);
 
 	if (*strp != NULL) {
 		rv = vsnprintf(*strp, size, fmt, ap);
@@ -647,6 +1209,13 @@ rtems_bsd_program_vasprintf(char **strp, const char *fmt, va_list ap)
 	return rv;
 }
 
+int
+rtems_bsd_program_vasprintf(char **strp, const char *fmt, va_list ap)
+{
+	return (program_vasprintf(strp, fmt, ap,
+	    __builtin_return_address(0)));
+}
+
 int
 rtems_bsd_program_asprintf(char **strp, const char *fmt, ...)
 {
@@ -655,7 +1224,7 @@ rtems_bsd_program_asprintf(char **strp, const char *fmt, ...)
 
 	va_start(ap, fmt);
 
-	rv = rtems_bsd_program_vasprintf(strp, fmt, ap);
+	rv = program_vasprintf(strp, fmt, ap, __builtin_return_address(0));
 
 	va_end(ap);
 
@@ -669,9 +1238,16 @@ rtems_bsd_program_free(void *ptr)
 		struct rtems_bsd_program_control *prog_ctrl =
 		    rtems_bsd_program_get_control_or_null();
 
-		if (prog_ctrl != NULL) {
+		if (prog_ctrl != NULL && prog_ctrl->arena_chunk_size != 0) {
+			int rv = arena_free(prog_ctrl, ptr);
+			assert(rv == 0);
+			--prog_ctrl->mem_blocks;
+			++prog_ctrl->free_count;
+		} else if (prog_ctrl != NULL) {
 			int rv = allocmem_free_remove(prog_ctrl, ptr);
 			assert(rv == 0);
+			--prog_ctrl->mem_blocks;
+			++prog_ctrl->free_count;
 		} else {
 			/* Outside of program context. Just free it. */
 			free(ptr);
@@ -245,7 +245,7 @@ def build(bld):
 
     ttcp_incl = inc + ['ttcp/include']
 
-    ttcp_source_files = ['ttcp/ttcp.c']
+    ttcp_source_files = ['ttcp/ttcp.c', 'ttcp/ttcp-cpu.c']
 
     ttcp_no_warnings = [
         '-Wno-implicit-function-declaration', '-Wno-int-conversion'
@@ -270,7 +270,8 @@ def build(bld):
 
     telnetd_source_files = [
         "telnetd/check_passwd.c", "telnetd/des.c", "telnetd/pty.c",
-        "telnetd/telnetd-init.c", "telnetd/telnetd.c"
+        "telnetd/pty-nvt.c", "telnetd/telnetd-init.c",
+        "telnetd/telnetd-shell.c", "telnetd/telnetd.c"
     ]
 
     bld.stlib(features='c',
@@ -335,3 +336,17 @@ def build(bld):
                 install_path=None,
                 lib=libs,
                 use=['telnetd', net_use])
+
+    tlnt_bench_incl = inc + ['testsuites', 'telnetd/include', 'telnetd']
+    tlnt_bench_sources = ['testsuites/telnetd02/init.c']
+    tlnt_bench_sources += [net_adapter_source]
+
+    bld.program(features='c',
+                target='telnetd02.exe',
+                source=tlnt_bench_sources,
+                cflags=cflags,
+                defines=[net_def],
+                includes=tlnt_bench_incl,
+                install_path=None,
+                lib=libs,
+                use=['telnetd', net_use])
@@ -85,6 +85,29 @@
 #include "des.h"
 #include <rtems/passwd.h>
 
+/*
+ * Compares the encrypted passphrases in a time which does not depend on the
+ * position of the first difference.
+ */
+static bool check_passwd_equal(const char *crypted, const char *pw)
+{
+  size_t n = strlen(pw);
+  unsigned char diff;
+  size_t i;
+
+  if (crypted == NULL || strlen(crypted) != n) {
+    return false;
+  }
+
+  diff = 0;
+
+  for (i = 0; i < n; ++i) {
+    diff |= (unsigned char) (crypted[i] ^ pw[i]);
+  }
+
+  return diff == 0;
+}
+
 /**
  * @brief Standard Telnet login check that uses DES to encrypt the passphrase.
  *
@@ -112,8 +135,8 @@ bool rtems_telnetd_login_check(
   strncpy( salt, pw, 2);
   salt [2] = '\0';
 
-  return strcmp(
+  return check_passwd_equal(
     __des_crypt_r( passphrase, salt, cryptbuf, sizeof( cryptbuf)),
     pw
-  ) == 0;
+  );
 }
@@ -71,6 +71,7 @@
 #include <pwd.h>
 #include <crypt.h>
 #endif
+#include <pthread.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -113,9 +114,12 @@ u_int32_t comp_maskl[8][128], comp_maskr[8][128];
 
 /* These need to be maintained per-process */
 struct Des_Context {
+/* Round keys for the even (l) and odd (r) S-box inputs, see do_des() */
 u_int32_t en_keysl[16], en_keysr[16];
 u_int32_t de_keysl[16], de_keysr[16];
 u_int32_t saltbits;
+/* Salt masks for the even and odd S-box inputs */
+u_int32_t saltl, saltr;
 u_int32_t old_salt;
 u_int32_t old_rawkey0, old_rawkey1;
 };
@@ -124,11 +128,27 @@ u_int32_t old_rawkey0, old_rawkey1;
 static struct Des_Context single;
 #endif
 
+/*
+ * Salt masks of the last crypt of each thread, see setup_salt().  Repeated
+ * logins against one stored password use the same salt.  The key schedule
+ * stays on the stack of __des_crypt_r(), so no key material is kept.  The
+ * zero initial state is the one of salt 0.
+ */
+struct Des_Salt {
+u_int32_t salt;
+u_int32_t bits;
+u_int32_t maskl, maskr;
+};
+
+static __thread struct Des_Salt des_salt_cache;
+
 #define en_keysl des_ctx->en_keysl
 #define en_keysr des_ctx->en_keysr
 #define de_keysl des_ctx->de_keysl
 #define de_keysr des_ctx->de_keysr
 #define saltbits des_ctx->saltbits
+#define saltl des_ctx->saltl
+#define saltr des_ctx->saltr
 #define old_salt des_ctx->old_salt
 #define old_rawkey0 des_ctx->old_rawkey0
 #define old_rawkey1 des_ctx->old_rawkey1
@@ -137,8 +157,7 @@ static struct Des_Context single;
  * being initialized, and therefore doesn't need to be made
  * reentrant. */
 static u_char	init_perm[64], final_perm[64];
-static u_char	m_sbox[4][4096];
-static u_int32_t psbox[4][256];
+static u_int32_t sp_box[8][64];
 
 
 
@@ -266,33 +285,25 @@ ascii_to_bin(char ch)
 }
 
 static struct Des_Context *
-des_ctx_init(void)
+des_ctx_init(struct Des_Context *des_ctx)
 {
-struct Des_Context *des_ctx;
-#ifdef REENTRANT
-  des_ctx = malloc(sizeof(*des_ctx));
-#else
-  des_ctx = &single;
-#endif
   old_rawkey0 = old_rawkey1 = 0L;
-  saltbits = 0L;
-  old_salt = 0L;
+  saltbits = des_salt_cache.bits;
+  saltl = des_salt_cache.maskl;
+  saltr = des_salt_cache.maskr;
+  old_salt = des_salt_cache.salt;
 
   return des_ctx;
 }
 
 static void
-des_init(void)
+des_init_once(void)
 {
   int	i, j, b, k, inbit, obit;
   u_int32_t	*p, *il, *ir, *fl, *fr;
-  static int des_initialised = 0;
-
-  if (des_initialised==1)
-      return;
 
 #ifndef REENTRANT
-  des_ctx_init();
+  des_ctx_init(&single);
 #endif
 
   bits24 = (bits28 = bits32 + 4) + 4;
@@ -306,17 +317,6 @@ des_init(void)
       u_sbox[i][j] = sbox[i][b];
     }
 
-  /*
-   * Convert the inverted S-boxes into 4 arrays of 8 bits.
-   * Each will handle 12 bits of the S-box input.
-   */
-  for (b = 0; b < 4; b++)
-    for (i = 0; i < 64; i++)
-      for (j = 0; j < 64; j++)
-        m_sbox[b][(i << 6) | j] =
-          (u_char)((u_sbox[(b << 1)][i] << 4) |
-          u_sbox[(b << 1) + 1][j]);
-
   /*
    * Set up the initial & final permutations into a useful form, and
    * initialise the inverted key permutation.
@@ -397,22 +397,32 @@ des_init(void)
   }
 
   /*
-   * Invert the P-box permutation, and convert into OR-masks for
-   * handling the output of the S-box arrays setup above.
+   * Invert the P-box permutation, and merge it with the inverted
+   * S-boxes.  Each S-box maps its 6 input bits directly to the
+   * permuted output bits, so a round needs one lookup per S-box
+   * from 2KiB of tables.
    */
   for (i = 0; i < 32; i++)
     un_pbox[pbox[i] - 1] = (u_char)i;
 
-  for (b = 0; b < 4; b++)
-    for (i = 0; i < 256; i++) {
-      *(p = &psbox[b][i]) = 0L;
-      for (j = 0; j < 8; j++) {
-        if (i & bits8[j])
-          *p |= bits32[un_pbox[8 * b + j]];
+  for (b = 0; b < 8; b++)
+    for (i = 0; i < 64; i++) {
+      *(p = &sp_box[b][i]) = 0L;
+      for (j = 0; j < 4; j++) {
+        if (u_sbox[b][i] & (8 >> j))
+          *p |= bits32[un_pbox[4 * b + j]];
       }
+      /* Rotated like the halves in do_des() */
+      *p = (*p >> 1) | (*p << 31);
     }
+}
+
+static void
+des_init(void)
+{
+  static pthread_once_t des_initialised = PTHREAD_ONCE_INIT;
 
-  des_initialised = 1;
+  (void)pthread_once(&des_initialised, des_init_once);
 }
 
 
@@ -435,6 +445,18 @@ setup_salt(long salt, struct Des_Context *des_ctx)
     saltbit <<= 1;
     obit >>= 1;
   }
+
+  /*
+   * The salt swaps bits of the inputs of S-box i and i + 4.  Both
+   * are 16 bits apart in the layout used by do_des().
+   */
+  saltl = (((saltbits >> 18) & 0x3f) << 10) | (((saltbits >> 6) & 0x3f) << 2);
+  saltr = (((saltbits >> 12) & 0x3f) << 10) | ((saltbits & 0x3f) << 2);
+
+  des_salt_cache.salt = old_salt;
+  des_salt_cache.bits = saltbits;
+  des_salt_cache.maskl = saltl;
+  des_salt_cache.maskr = saltr;
 }
 
 
@@ -487,15 +509,14 @@ des_setkey(const char *key, struct Des_Context *des_ctx)
    */
   shifts = 0;
   for (round = 0; round < 16; round++) {
-    u_int32_t	t0, t1;
+    u_int32_t	t0, t1, kl, kr;
 
     shifts += key_shifts[round];
 
     t0 = (k0 << shifts) | (k0 >> (28 - shifts));
     t1 = (k1 << shifts) | (k1 >> (28 - shifts));
 
-    de_keysl[15 - round] =
-    en_keysl[round] = comp_maskl[0][(t0 >> 21) & 0x7f]
+    kl = comp_maskl[0][(t0 >> 21) & 0x7f]
         | comp_maskl[1][(t0 >> 14) & 0x7f]
         | comp_maskl[2][(t0 >> 7) & 0x7f]
         | comp_maskl[3][t0 & 0x7f]
@@ -504,8 +525,7 @@ des_setkey(const char *key, struct Des_Context *des_ctx)
         | comp_maskl[6][(t1 >> 7) & 0x7f]
         | comp_maskl[7][t1 & 0x7f];
 
-    de_keysr[15 - round] =
-    en_keysr[round] = comp_maskr[0][(t0 >> 21) & 0x7f]
+    kr = comp_maskr[0][(t0 >> 21) & 0x7f]
         | comp_maskr[1][(t0 >> 14) & 0x7f]
         | comp_maskr[2][(t0 >> 7) & 0x7f]
         | comp_maskr[3][t0 & 0x7f]
@@ -513,6 +533,22 @@ des_setkey(const char *key, struct Des_Context *des_ctx)
         | comp_maskr[5][(t1 >> 14) & 0x7f]
         | comp_maskr[6][(t1 >> 7) & 0x7f]
         | comp_maskr[7][t1 & 0x7f];
+
+    /*
+     * Distribute the 6-bit subkeys of the S-boxes to the even and odd
+     * S-box input words of do_des().
+     */
+    de_keysl[15 - round] =
+    en_keysl[round] = (((kl >> 18) & 0x3f) << 26)
+        | (((kl >> 6) & 0x3f) << 18)
+        | (((kr >> 18) & 0x3f) << 10)
+        | (((kr >> 6) & 0x3f) << 2);
+
+    de_keysr[15 - round] =
+    en_keysr[round] = (((kl >> 12) & 0x3f) << 26)
+        | ((kl & 0x3f) << 18)
+        | (((kr >> 12) & 0x3f) << 10)
+        | ((kr & 0x3f) << 2);
   }
   return(0);
 }
@@ -525,7 +561,7 @@ do_des(	u_int32_t l_in, u_int32_t r_in, u_int32_t *l_out, u_int32_t *r_out, int
    *	l_in, r_in, l_out, and r_out are in pseudo-"big-endian" format.
    */
   u_int32_t	l, r, *kl, *kr, *kl1, *kr1;
-  u_int32_t	f, r48l, r48r;
+  u_int32_t	f, u, t;
   int		round;
 
   if (count == 0) {
@@ -565,6 +601,15 @@ do_des(	u_int32_t l_in, u_int32_t r_in, u_int32_t *l_out, u_int32_t *r_out, int
     | ip_maskr[6][(r_in >> 8) & 0xff]
     | ip_maskr[7][r_in & 0xff];
 
+  /*
+   * Both halves are kept rotated right by one bit.  The inputs of the
+   * even S-boxes are then at bits 31..26, 23..18, 15..10 and 7..2 of
+   * the half, the inputs of the odd S-boxes at the same bits of the
+   * half rotated left by four bits.  This replaces the E-box.
+   */
+  l = (l >> 1) | (l << 31);
+  r = (r >> 1) | (r << 31);
+
   while (count--) {
     /*
      * Do each round.
@@ -573,35 +618,28 @@ do_des(	u_int32_t l_in, u_int32_t r_in, u_int32_t *l_out, u_int32_t *r_out, int
     kr = kr1;
     round = 16;
     while (round--) {
-      /*
-       * Expand R to 48 bits (simulate the E-box).
-       */
-      r48l	= ((r & 0x00000001) << 23)
-        | ((r & 0xf8000000) >> 9)
-        | ((r & 0x1f800000) >> 11)
-        | ((r & 0x01f80000) >> 13)
-        | ((r & 0x001f8000) >> 15);
-
-      r48r	= ((r & 0x0001f800) << 7)
-        | ((r & 0x00001f80) << 5)
-        | ((r & 0x000001f8) << 3)
-        | ((r & 0x0000001f) << 1)
-        | ((r & 0x80000000) >> 31);
+      u = r;
+      t = (r << 4) | (r >> 28);
       /*
        * Do salting for crypt() and friends, and
        * XOR with the permuted key.
        */
-      f = (r48l ^ r48r) & saltbits;
-      r48l ^= f ^ *kl++;
-      r48r ^= f ^ *kr++;
+      f = (u ^ (u >> 16)) & saltl;
+      u ^= f ^ (f << 16) ^ *kl++;
+      f = (t ^ (t >> 16)) & saltr;
+      t ^= f ^ (f << 16) ^ *kr++;
       /*
        * Do sbox lookups (which shrink it back to 32 bits)
        * and do the pbox permutation at the same time.
        */
-      f = psbox[0][m_sbox[0][r48l >> 12]]
-        | psbox[1][m_sbox[1][r48l & 0xfff]]
-        | psbox[2][m_sbox[2][r48r >> 12]]
-        | psbox[3][m_sbox[3][r48r & 0xfff]];
+      f = sp_box[0][u >> 26]
+        | sp_box[2][(u >> 18) & 0x3f]
+        | sp_box[4][(u >> 10) & 0x3f]
+        | sp_box[6][(u >> 2) & 0x3f]
+        | sp_box[1][t >> 26]
+        | sp_box[3][(t >> 18) & 0x3f]
+        | sp_box[5][(t >> 10) & 0x3f]
+        | sp_box[7][(t >> 2) & 0x3f];
       /*
        * Now that we've permuted things, complete f().
        */
@@ -612,6 +650,8 @@ do_des(	u_int32_t l_in, u_int32_t r_in, u_int32_t *l_out, u_int32_t *r_out, int
     r = l;
     l = f;
   }
+  l = (l << 1) | (l >> 31);
+  r = (r << 1) | (r >> 31);
   /*
    * Do final permutation (inverse of IP).
    */
@@ -715,6 +755,7 @@ char *
 __des_crypt_r(const char *key, const char *setting, char *output, int sz)
 {
   char *rval = 0;
+  struct Des_Context des_ctx_storage;
   struct Des_Context *des_ctx;
   u_int32_t	count, salt, l, r0, r1, keybuf[2];
   u_char		*p, *q;
@@ -723,7 +764,7 @@ __des_crypt_r(const char *key, const char *setting, char *output, int sz)
     return NULL;
 
   des_init();
-  des_ctx = des_ctx_init();
+  des_ctx = des_ctx_init(&des_ctx_storage);
 
   /*
    * Copy the key, shifting each character up by one bit
@@ -832,7 +873,6 @@ __des_crypt_r(const char *key, const char *setting, char *output, int sz)
 
   rval = output;
 bailout:
-  free(des_ctx);
   return rval;
 }
 
@@ -58,6 +58,29 @@ typedef void (*rtems_telnetd_command)(
   void * /* arg */
 );
 
+/**
+ * @brief Telnet session output overflow policy.
+ *
+ * It selects what happens to session output if the output buffer is full and
+ * the client does not accept more data.
+ */
+typedef enum {
+  /**
+   * @brief The session task blocks until the client accepts more data.
+   */
+  RTEMS_TELNETD_OVERFLOW_BLOCK,
+
+  /**
+   * @brief Output which does not fit into the output buffer is discarded.
+   */
+  RTEMS_TELNETD_OVERFLOW_DROP,
+
+  /**
+   * @brief The connection to the client is shut down.
+   */
+  RTEMS_TELNETD_OVERFLOW_DISCONNECT
+} rtems_telnetd_overflow_policy;
+
 /**
  * @brief Telnet configuration structure.
  */
@@ -118,6 +141,114 @@ typedef struct {
    * Use 0 for the default value.
    */
   uint16_t port;
+
+  /**
+   * @brief Size of the per-session output buffer in bytes.
+   *
+   * Session output is collected in this buffer and sent to the client in
+   * larger chunks.  The buffer is flushed if it is full, after a burst of
+   * output lines, before the session waits for input, and after the flush
+   * latency.  Use 0 for the default value.
+   */
+  size_t output_buffer_size;
+
+  /**
+   * @brief Maximum time in milliseconds session output may stay in the output
+   * buffer.
+   *
+   * Without multiplexed I/O, the output is sent by a flush task of the server
+   * which uses the task priority and stack size of the sessions.  With
+   * multiplexed I/O, the I/O task sends it.  Use 0 for the default value.
+   */
+  uint32_t output_flush_latency;
+
+  /**
+   * @brief Policy if the output buffer is full and the client does not accept
+   * more data.
+   */
+  rtems_telnetd_overflow_policy output_overflow;
+
+  /**
+   * @brief If true, then one I/O task services all sessions.
+   *
+   * The I/O task accepts the connections and waits for input and output
+   * readiness of all session sockets with select().  A session task is only
+   * created while a client is connected, so an idle session costs no task
+   * stack.  If false, then each session has its own task for the lifetime of
+   * the Telnet server which reads its socket directly.
+   */
+  bool multiplex_io;
+
+  /**
+   * @brief Count of sessions prepared by rtems_telnetd_start().
+   *
+   * The PTY and, without multiplexed I/O, the task of the other sessions are
+   * created when a client connects to a session for the first time.  Use 0 to
+   * prepare all sessions on demand.  The count is limited to the maximum
+   * client count.
+   */
+  uint16_t client_prewarm;
+
+  /**
+   * @brief Maximum count of connections waiting for a free session.
+   *
+   * If no session is free, then a new connection waits in the accept queue
+   * until a session is released.  If the accept queue is full, then the
+   * client gets a busy message and the connection is closed.  Use 0 for the
+   * default value which is the maximum client count.
+   */
+  uint16_t accept_queue_size;
+
+  /**
+   * @brief Time in seconds after which a session without input from the
+   * client is closed.
+   *
+   * Use 0 to disable the idle timeout.
+   */
+  uint32_t idle_timeout;
+
+  /**
+   * @brief If true, then the Telnet LINEMODE option (RFC 1184) is offered to
+   * the client.
+   *
+   * While an application reads in canonical mode, the client edits the input
+   * lines locally and sends complete lines, which saves a round trip and a
+   * segment per keystroke.  Applications which read in raw mode, for example
+   * the shell with its own line editor, get the character mode.
+   */
+  bool linemode;
+
+  /**
+   * @brief If true, then the compression of the output (MCCP2, Telnet option
+   * COMPRESS2) is offered to the client.
+   *
+   * This saves time on slow links for large outputs.  The output is
+   * compressed into the output buffer and each flush of the output buffer
+   * completes the compressed block, so the output latency stays the same.
+   * The compression needs an output buffer of at least 64 bytes and about
+   * 24KiB of heap per compressed connection.
+   */
+  bool compress;
+
+  /**
+   * @brief Maximum count of login attempts per minute from one client
+   * address.
+   *
+   * A short burst of attempts is allowed, further attempts are rejected
+   * without a password check until the rate drops below the limit.  This
+   * bounds the time spent in the password check and slows down password
+   * guessing.  Use 0 to disable the limit.
+   */
+  uint16_t login_rate_limit;
+
+  /**
+   * @brief If true, then the echo latency histogram of the sessions is
+   * recorded.
+   *
+   * Each burst of input costs one clock read on reception and one on the next
+   * output sent to the client.
+   */
+  bool echo_latency;
 } rtems_telnetd_config_table;
 
 /**
@@ -133,6 +264,192 @@ typedef struct {
  */
 rtems_status_code rtems_telnetd_start(const rtems_telnetd_config_table *config);
 
+/**
+ * @brief Telnet server statistics.
+ */
+typedef struct {
+  /**
+   * @brief Server port.
+   */
+  uint16_t port;
+
+  /**
+   * @brief Count of sessions in use.
+   */
+  uint16_t sessions_active;
+
+  /**
+   * @brief Count of connections waiting in the accept queue.
+   */
+  uint16_t connections_pending;
+
+  /**
+   * @brief Count of accepted connections.
+   */
+  uint32_t connections_accepted;
+
+  /**
+   * @brief Count of connections which had to wait in the accept queue.
+   */
+  uint32_t connections_queued;
+
+  /**
+   * @brief Count of connections rejected since the accept queue was full.
+   */
+  uint32_t connections_rejected;
+
+  /**
+   * @brief Count of sessions closed by the idle timeout.
+   */
+  uint32_t sessions_timed_out;
+
+  /**
+   * @brief Count of login attempts rejected by the login rate limit.
+   */
+  uint32_t logins_throttled;
+} rtems_telnetd_statistics;
+
+/**
+ * @brief Gets the statistics of the running Telnet servers.
+ *
+ * @param[out] stats is the array for the statistics.
+ * @param count is the element count of the array.
+ *
+ * @return Returns the count of running Telnet servers.  This may be greater
+ *   than @a count, in this case only the first @a count servers are reported.
+ */
+size_t rtems_telnetd_get_statistics(
+  rtems_telnetd_statistics *stats,
+  size_t                    count
+);
+
+/**
+ * @brief Count of buckets of the echo latency histogram.
+ */
+#define RTEMS_TELNETD_ECHO_LATENCY_BUCKETS 12
+
+/**
+ * @brief Telnet I/O statistics.
+ */
+typedef struct {
+  /**
+   * @brief Count of bytes received from the client.
+   */
+  uint32_t bytes_received;
+
+  /**
+   * @brief Count of socket read calls.
+   */
+  uint32_t receive_calls;
+
+  /**
+   * @brief Count of Telnet commands received from the client.
+   *
+   * Each IAC sequence except an escaped data byte counts as one command.
+   */
+  uint32_t iac_commands;
+
+  /**
+   * @brief Count of bytes produced by the session for the client.
+   */
+  uint32_t bytes_produced;
+
+  /**
+   * @brief Count of bytes sent to the client.
+   *
+   * With compression, this is less than the count of bytes produced.
+   */
+  uint32_t bytes_sent;
+
+  /**
+   * @brief Count of socket send calls.
+   */
+  uint32_t send_calls;
+
+  /**
+   * @brief Count of output bytes discarded by the overflow policy or since
+   *   the connection was lost.
+   */
+  uint32_t bytes_dropped;
+
+  /**
+   * @brief Time in nanoseconds the session was blocked in writes to a slow
+   *   client.
+   */
+  uint64_t write_blocked_ns;
+
+  /**
+   * @brief Histogram of the time from the reception of input to the next
+   *   output sent to the client.
+   *
+   * In character mode, this is the keystroke to echo latency.  Bucket i
+   * counts the latencies below 2^(i + 17) nanoseconds, this is 131us for
+   * the first bucket.  The last bucket counts the latencies of 134ms and
+   * more.  The histogram is only recorded if enabled in the configuration.
+   */
+  uint32_t echo_latency[RTEMS_TELNETD_ECHO_LATENCY_BUCKETS];
+} rtems_telnetd_io_statistics;
+
+/**
+ * @brief Telnet session statistics.
+ */
+typedef struct {
+  /**
+   * @brief Port of the Telnet server.
+   */
+  uint16_t port;
+
+  /**
+   * @brief Index of the session in the Telnet server.
+   */
+  uint16_t session;
+
+  /**
+   * @brief If true, then a client is connected to the session.
+   */
+  bool connected;
+
+  /**
+   * @brief If true, then the output to the client is compressed.
+   */
+  bool compressed;
+
+  /**
+   * @brief Address of the connected or last client.
+   */
+  char peername[16];
+
+  /**
+   * @brief I/O statistics of the connected or last client.
+   */
+  rtems_telnetd_io_statistics connection;
+
+  /**
+   * @brief I/O statistics of all connections served by the session.
+   */
+  rtems_telnetd_io_statistics total;
+} rtems_telnetd_session_statistics;
+
+/**
+ * @brief Gets the statistics of the prepared sessions of the running Telnet
+ * servers.
+ *
+ * @param[out] stats is the array for the statistics.
+ * @param count is the element count of the array.
+ *
+ * @return Returns the count of prepared sessions.  This may be greater than
+ *   @a count, in this case only the first @a count sessions are reported.
+ */
+size_t rtems_telnetd_get_session_statistics(
+  rtems_telnetd_session_statistics *stats,
+  size_t                            count
+);
+
+/**
+ * @brief Shell command to show the Telnet server statistics.
+ */
+extern rtems_shell_cmd_t rtems_shell_TELNETD_Command;
+
 /**
  * @brief Telnet configuration.
  *
@@ -0,0 +1,324 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/**
+ * @file
+ *
+ * @brief Buffered Telnet pseudo-terminal used by the Telnet server
+ */
+
+/*
+ * Copyright (C) 2026 The RTEMS Project
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TELNETD_PTY_INTERNAL_H
+#define _TELNETD_PTY_INTERNAL_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <rtems.h>
+#include <rtems/pty.h>
+#include <rtems/telnetd.h>
+#include <rtems/thread.h>
+
+#include <zlib.h>
+
+#include "pty-nvt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Size of the per-session receive ring in bytes.
+ *
+ * Must be a power of two.
+ */
+#define TELNETD_PTY_RX_SIZE 512
+
+/**
+ * @brief Number of complete output lines which trigger an output flush.
+ */
+#define TELNETD_PTY_TX_BURST_LINES 8
+
+/**
+ * @brief Base two logarithm of the compression window size.
+ *
+ * The compressor of a session needs about 2^(window bits + 2) +
+ * 2^(memory level + 9) bytes plus a few KiB of state, so the defaults keep
+ * it below 24KiB instead of the 256KiB of the zlib defaults.
+ */
+#define TELNETD_PTY_COMPRESS_WINDOW_BITS 11
+
+/**
+ * @brief Memory level of the compressor, see deflateInit2().
+ */
+#define TELNETD_PTY_COMPRESS_MEM_LEVEL 4
+
+/**
+ * @brief Minimum output buffer size to offer the compression.
+ */
+#define TELNETD_PTY_COMPRESS_MIN_BUFFER 64
+
+/**
+ * @brief Event sent to the flush task if output waits for the flush latency.
+ */
+#define TELNETD_PTY_FLUSH_EVENT RTEMS_EVENT_0
+
+/**
+ * @brief Telnet pseudo-terminal with a receive ring and an output buffer.
+ *
+ * The socket is read in blocks into the receive ring and the Telnet protocol
+ * is processed from memory, so termios no longer costs one read() per input
+ * character.  The reader decodes the received data in place in blocks, see
+ * telnetd_nvt_decode().  Output is coalesced in the output buffer, see
+ * telnetd_pty_set_output().  The standard rtems_pty_context is the first
+ * member, so the rtems_pty_*() functions may be used on the pty member.
+ *
+ * With the LINEMODE option, see telnetd_pty_set_linemode(), the edit mode
+ * follows the canonical mode of termios.  While the client echoes the input,
+ * the echo of termios is suppressed for the characters just read.
+ *
+ * With the COMPRESS2 option (MCCP2), see telnetd_pty_set_compression(), the
+ * output is compressed into the output buffer.  The tx_produced counter
+ * tells the output of the session and tx_bytes the bytes sent to the client.
+ *
+ * The I/O counters are cumulative for all connections, see
+ * telnetd_pty_get_statistics().  If enabled, see
+ * telnetd_pty_set_echo_latency(), the reception of input records a time stamp
+ * in rx_echo_stamp and the next output sent to the client takes it to update
+ * the echo latency histogram.
+ *
+ * In multiplexed mode, see telnetd_pty_set_multiplexed(), the receive ring
+ * is filled by an I/O task through telnetd_pty_receive() and the reader waits
+ * on a semaphore.  The ring is then a single producer, single consumer queue.
+ */
+typedef struct {
+  rtems_pty_context             pty;
+  unsigned char                 rx_buf[TELNETD_PTY_RX_SIZE];
+  atomic_uint_least32_t         rx_head;
+  atomic_uint_least32_t         rx_tail;
+  atomic_bool                   rx_eof;
+  uint32_t                      rx_dec_next;
+  uint32_t                      rx_dec_end;
+  uint32_t                      rx_dec_raw_end;
+  bool                          rx_mux;
+  rtems_binary_semaphore        rx_sem;
+  atomic_bool                   rx_waiting;
+  uint32_t                      rx_syscalls;
+  uint32_t                      rx_bytes;
+  rtems_interval                rx_last;
+  rtems_interval                rx_idle_timeout;
+  bool                          rx_timed_out;
+  telnetd_nvt_options           rx_nvt;
+  atomic_uint_least32_t         rx_echo_stamp;
+  bool                          rx_echo_latency;
+  rtems_id                      rx_reader;
+  uint8_t                       rx_echo_skip;
+  rtems_mutex                   tx_mtx;
+  unsigned char                *tx_buf;
+  size_t                        tx_size;
+  size_t                        tx_len;
+  uint32_t                      tx_lines;
+  bool                          tx_busy;
+  bool                          tx_flush_armed;
+  rtems_interval                tx_deadline;
+  rtems_interval                tx_latency;
+  rtems_id                      tx_flusher;
+  rtems_telnetd_overflow_policy tx_overflow;
+  uint32_t                      tx_syscalls;
+  uint32_t                      tx_bytes;
+  uint32_t                      tx_produced;
+  uint32_t                      tx_dropped;
+  uint64_t                      tx_blocked_ns;
+  uint32_t                      tx_echo_latency[
+    RTEMS_TELNETD_ECHO_LATENCY_BUCKETS
+  ];
+  rtems_telnetd_io_statistics   stats_base;
+  z_stream                      tx_zstream;
+  bool                          tx_zactive;
+  bool                          tx_zsync;
+} telnetd_pty;
+
+/**
+ * @brief Initializes and installs a buffered Telnet pseudo-terminal.
+ *
+ * @return The device path of the PTY or @c NULL on failure.
+ */
+const char *telnetd_pty_initialize(telnetd_pty *tp, uintptr_t unique);
+
+/**
+ * @brief Enables the output buffer of the PTY.
+ *
+ * Without an output buffer, output is written to the socket immediately.
+ *
+ * @param buf is the output buffer.
+ * @param size is the size of the output buffer in bytes.
+ * @param latency is the maximum time in clock ticks output may stay in the
+ *   output buffer.  Use 0 to flush only if the buffer is full, after a burst
+ *   of lines, or if the session waits for input.
+ * @param overflow is the output overflow policy.
+ * @param flusher is the task which calls telnetd_pty_flush_expired() if it
+ *   receives the TELNETD_PTY_FLUSH_EVENT.  Use 0 if the caller of
+ *   telnetd_pty_flush_expired() polls for the flush deadlines without an
+ *   event, like the I/O task in multiplexed mode.
+ */
+void telnetd_pty_set_output(
+  telnetd_pty                   *tp,
+  unsigned char                 *buf,
+  size_t                         size,
+  rtems_interval                 latency,
+  rtems_telnetd_overflow_policy  overflow,
+  rtems_id                       flusher
+);
+
+/**
+ * @brief Lets an I/O task fill the receive ring of the PTY.
+ *
+ * The reader no longer reads the socket and the socket is no longer closed
+ * by the PTY.  telnetd_pty_close_socket() only shuts the connection down, the
+ * I/O task closes the socket with rtems_pty_close_socket().
+ */
+void telnetd_pty_set_multiplexed(telnetd_pty *tp);
+
+/**
+ * @brief Attaches a connected socket to the PTY and resets the receive ring.
+ */
+void telnetd_pty_set_socket(telnetd_pty *tp, int socket);
+
+/**
+ * @brief Flushes pending output and closes the socket of the PTY.
+ *
+ * In multiplexed mode, the connection is shut down instead.
+ */
+void telnetd_pty_close_socket(telnetd_pty *tp);
+
+/**
+ * @brief Sets the time in clock ticks after which a connection without input
+ * is shut down.
+ *
+ * Use 0 to disable the idle timeout.
+ */
+void telnetd_pty_set_idle_timeout(telnetd_pty *tp, rtems_interval timeout);
+
+/**
+ * @brief Enables or disables the LINEMODE option for the next connections.
+ */
+void telnetd_pty_set_linemode(telnetd_pty *tp, bool enable);
+
+/**
+ * @brief Enables or disables the COMPRESS2 option for the next connections.
+ *
+ * The compression needs the output buffer, see telnetd_pty_set_output().
+ */
+void telnetd_pty_set_compression(telnetd_pty *tp, bool enable);
+
+/**
+ * @brief Enables or disables the recording of the echo latency histogram.
+ */
+void telnetd_pty_set_echo_latency(telnetd_pty *tp, bool enable);
+
+/**
+ * @brief Gets the I/O statistics of the PTY.
+ *
+ * @param[out] connection is the statistics of the current or last
+ *   connection.
+ * @param[out] total is the statistics of all connections.
+ */
+void telnetd_pty_get_statistics(
+  const telnetd_pty           *tp,
+  rtems_telnetd_io_statistics *connection,
+  rtems_telnetd_io_statistics *total
+);
+
+/**
+ * @brief Shuts the connection down if the idle timeout expired.
+ *
+ * In multiplexed mode, the I/O task has to call this function periodically.
+ * Otherwise, the reader checks the idle timeout by itself.
+ *
+ * @retval true The idle timeout expired.
+ * @retval false Otherwise.
+ */
+bool telnetd_pty_check_idle(telnetd_pty *tp);
+
+/**
+ * @brief Returns the free space of the receive ring in bytes.
+ */
+size_t telnetd_pty_receive_space(const telnetd_pty *tp);
+
+/**
+ * @brief Reads the socket into the receive ring and wakes up the reader.
+ *
+ * This function is used by the I/O task in multiplexed mode if the socket is
+ * readable.
+ *
+ * @retval true The connection is still usable.
+ * @retval false The connection was closed by the client or an error
+ *   occurred.  The reader gets an end of file condition.
+ */
+bool telnetd_pty_receive(telnetd_pty *tp);
+
+/**
+ * @brief Returns true if output is waiting in the output buffer.
+ */
+bool telnetd_pty_output_pending(telnetd_pty *tp);
+
+/**
+ * @brief Sends buffered output without blocking.
+ */
+void telnetd_pty_flush_output(telnetd_pty *tp);
+
+/**
+ * @brief Returns true if the reader waits for input in multiplexed mode.
+ *
+ * The output buffer was flushed before the reader started to wait, so the
+ * session produces no new output until it gets input.
+ */
+bool telnetd_pty_reader_waits(telnetd_pty *tp);
+
+/**
+ * @brief Sends buffered output without blocking if the flush latency expired.
+ *
+ * This function is called by the flush task or by the I/O task in
+ * multiplexed mode, see telnetd_pty_set_output().
+ *
+ * @param now is the clock tick count since boot.
+ *
+ * @return The clock ticks until the output of the PTY is due, or 0 if no
+ *   output waits for the flush latency.
+ */
+rtems_interval telnetd_pty_flush_expired(telnetd_pty *tp, rtems_interval now);
+
+/**
+ * @brief Releases the resources of the PTY and removes the device.
+ */
+void telnetd_pty_destroy(telnetd_pty *tp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TELNETD_PTY_INTERNAL_H */
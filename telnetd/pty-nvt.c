@@ -0,0 +1,507 @@
+/**
+ * @file
+ *
+ * @brief Telnet network virtual terminal input processing
+ *
+ * This file has no dependencies on the RTEMS termios implementation, so that
+ * it can be built on the host for tests and benchmarks.
+ */
+
+/*
+ * Copyright (c) 2001 Fernando Ruiz Casas <fruizcasas@gmail.com>
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ *  Till Straumann <strauman@slac.stanford.edu>
+ *
+ *   - NAWS support
+ *
+ *  The state machine was moved here from pty.c and a block decoder was
+ *  added.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#define DEBUG_WH    (1<<0)
+#define DEBUG_DETAIL  (1<<1)
+
+/* #define DEBUG DEBUG_WH */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pty-nvt.h"
+
+static ssize_t
+nvtWrite(rtems_pty_context *pty, telnetd_nvt_options *opt, const void *buf,
+  size_t len)
+{
+  if (opt!=NULL && opt->write!=NULL)
+    return (*opt->write)(pty, buf, len);
+
+  return write(pty->socket, buf, len);
+}
+
+static int
+nvtSendIac(rtems_pty_context *pty, telnetd_nvt_options *opt,
+  unsigned char mode, unsigned char option)
+{
+  unsigned char buf[3];
+
+  buf[0] = IAC_ESC;
+  buf[1] = mode;
+  buf[2] = option;
+  return nvtWrite(pty, opt, buf, sizeof(buf));
+}
+
+int telnetd_nvt_send_iac(
+  rtems_pty_context *pty,
+  unsigned char      mode,
+  unsigned char      option
+)
+{
+  return nvtSendIac(pty, NULL, mode, option);
+}
+
+/*-----------------------------------------------------------*/
+/*
+ * The NVT terminal is negociated in PollRead and PollWrite
+ * with every BYTE sendded or received.
+ * A litle status machine in the pty_read_byte(int minor)
+ *
+ */
+static const char IAC_AYT_RSP[]="\r\nAYT? Yes, RTEMS-SHELL is here\r\n";
+static const char IAC_BRK_RSP[]="<*Break*>";
+static const char IAC_IP_RSP []="<*Interrupt*>";
+
+static void
+nvtSendLinemodeMode(rtems_pty_context *pty, telnetd_nvt_options *opt)
+{
+  telnetd_nvt_linemode *lm = &opt->linemode;
+  unsigned char buf[7];
+
+  buf[0]=IAC_ESC;
+  buf[1]=IAC_SB;
+  buf[2]=TELOPT_LINEMODE;
+  buf[3]=LM_MODE;
+  buf[4]=lm->mode;
+  buf[5]=IAC_ESC;
+  buf[6]=IAC_SE;
+  nvtWrite(pty, opt, buf, sizeof(buf));
+  lm->mode_sent=lm->mode;
+}
+
+static void
+nvtSendLinemodeOption(rtems_pty_context *pty, telnetd_nvt_options *opt,
+  unsigned char mode, unsigned char option)
+{
+  unsigned char buf[7];
+
+  buf[0]=IAC_ESC;
+  buf[1]=IAC_SB;
+  buf[2]=TELOPT_LINEMODE;
+  buf[3]=mode;
+  buf[4]=option;
+  buf[5]=IAC_ESC;
+  buf[6]=IAC_SE;
+  nvtWrite(pty, opt, buf, sizeof(buf));
+}
+
+/* The side which does not echo tells the client about it */
+static void
+nvtSyncEcho(rtems_pty_context *pty, telnetd_nvt_options *opt)
+{
+  telnetd_nvt_linemode *lm = &opt->linemode;
+
+  if (lm->client_echo != lm->client_echo_sent) {
+    nvtSendIac(pty, opt, lm->client_echo ? IAC_WONT : IAC_WILL,
+      TELOPT_ECHO);
+    lm->client_echo_sent=lm->client_echo;
+  }
+}
+
+static void
+handleLinemodeSB(rtems_pty_context *pty, telnetd_nvt_options *opt)
+{
+  telnetd_nvt_linemode *lm;
+
+  if (opt==NULL || !opt->linemode.active || pty->sb_ind < 2)
+    return;
+
+  lm = &opt->linemode;
+
+  switch (pty->sb_buf[1]) {
+    case LM_MODE:
+      if (pty->sb_ind < 3)
+        break;
+
+      /* Insist on our mode if the client proposes a different one */
+      if ((pty->sb_buf[2] & LM_MODE_ACK)==0
+        && (pty->sb_buf[2] & ~LM_MODE_ACK)!=lm->mode)
+        nvtSendLinemodeMode(pty, opt);
+      break;
+    case IAC_DO:
+      if (pty->sb_ind >= 3 && pty->sb_buf[2]==LM_FORWARDMASK)
+        nvtSendLinemodeOption(pty, opt, IAC_WONT, LM_FORWARDMASK);
+      break;
+    case IAC_WILL:
+      if (pty->sb_ind >= 3 && pty->sb_buf[2]==LM_FORWARDMASK)
+        nvtSendLinemodeOption(pty, opt, IAC_DONT, LM_FORWARDMASK);
+      break;
+    default:
+      /* The client keeps its own special characters (SLC) */
+      break;
+  }
+}
+
+static int
+handleSB(rtems_pty_context *pty, telnetd_nvt_options *opt)
+{
+  switch (pty->sb_buf[0]) {
+    case TELOPT_LINEMODE:
+      handleLinemodeSB(pty, opt);
+      break;
+    case 31:  /* NAWS */
+      pty->width  = (pty->sb_buf[1]<<8) + pty->sb_buf[2];
+      pty->height = (pty->sb_buf[3]<<8) + pty->sb_buf[4];
+#if DEBUG & DEBUG_WH
+      fprintf(stderr,
+          "Setting width/height to %ix%i\n",
+          pty->width,
+          pty->height);
+#endif
+      break;
+    default:
+      break;
+  }
+  return 0;
+}
+
+static inline int
+nvtProcessByte(rtems_pty_context *pty, telnetd_nvt_options *opt,
+  unsigned char value)
+{
+   telnetd_nvt_linemode *lm;
+   unsigned int  omod;
+   int      result;
+
+   lm=opt!=NULL ? &opt->linemode : NULL;
+   omod=pty->iac_mode;
+   pty->iac_mode=0;
+   switch(omod & 0xff) {
+       case IAC_ESC:
+           /* The SE ends the SB command */
+           if (opt!=NULL && value!=IAC_ESC && value!=IAC_SE)
+              ++opt->commands;
+           switch(value) {
+               case IAC_ESC :
+                   /* in case this is an ESC ESC sequence in SB mode */
+                   pty->iac_mode = omod>>8;
+                   if (pty->iac_mode==IAC_SB) {
+                     if (pty->sb_ind < SB_MAX)
+                       pty->sb_buf[pty->sb_ind++]=value;
+                     return -1;
+                   }
+                   return IAC_ESC;
+               case IAC_DONT:
+               case IAC_DO  :
+               case IAC_WONT:
+               case IAC_WILL:
+                   pty->iac_mode=value;
+                   return -1;
+               case IAC_SB  :
+#if DEBUG & DEBUG_DETAIL
+                   printk("SB\n");
+#endif
+                   pty->iac_mode=value;
+                   pty->sb_ind=0;
+                   return -100;
+               case IAC_GA  :
+                   return -1;
+               case IAC_EL  :
+                   return 0x03; /* Ctrl-C*/
+               case IAC_EC  :
+                   return '\b';
+               case IAC_AYT :
+                   nvtWrite(pty,opt,IAC_AYT_RSP,strlen(IAC_AYT_RSP));
+                   return -1;
+               case IAC_AO  :
+                   return -1;
+               case IAC_IP  :
+                   nvtWrite(pty,opt,IAC_IP_RSP,strlen(IAC_IP_RSP));
+                   return -1;
+               case IAC_BRK :
+                   nvtWrite(pty,opt,IAC_BRK_RSP,strlen(IAC_BRK_RSP));
+                   return -1;
+               case IAC_DMARK:
+                   return -2;
+               case IAC_NOP :
+                   return -1;
+               case IAC_SE  :
+#if DEBUG & DEBUG_DETAIL
+                  {
+                  int i;
+                  printk("SE");
+                  for (i=0; i<pty->sb_ind; i++)
+                    printk(" %02x",pty->sb_buf[i]);
+                  printk("\n");
+                  }
+#endif
+                  handleSB(pty, opt);
+               return -101;
+               case IAC_EOR :
+                   return -102;
+               default      :
+                   return -1;
+           };
+           break;
+
+       case IAC_SB:
+           pty->iac_mode=omod;
+           if (IAC_ESC==value) {
+             pty->iac_mode=(omod<<8)|value;
+           } else {
+             if (pty->sb_ind < SB_MAX)
+               pty->sb_buf[pty->sb_ind++]=value;
+           }
+           return -1;
+
+       case IAC_WILL:
+           if (value==TELOPT_LINEMODE && lm!=NULL && lm->enabled) {
+              /* We asked for it, so this is the answer */
+              if (!lm->active) {
+                 lm->active=true;
+                 nvtSendLinemodeMode(pty, opt);
+                 nvtSyncEcho(pty, opt);
+              }
+           } else if (value==34){
+              nvtSendIac(pty,opt,IAC_DONT,   34);  /*LINEMODE*/
+              nvtSendIac(pty,opt,IAC_DO  ,    1);  /*ECHO    */
+           } else if (value==31) {
+              nvtSendIac(pty,opt,IAC_DO  ,   31);  /*NAWS    */
+#if DEBUG & DEBUG_DETAIL
+              printk("replied DO NAWS\n");
+#endif
+           } else {
+              nvtSendIac(pty,opt,IAC_DONT,value);
+           }
+           return -1;
+       case IAC_DONT:
+           if (value==TELOPT_COMPRESS2 && opt!=NULL)
+              opt->compress_request=false;
+           return -1;
+       case IAC_DO  :
+           if (value==3) {
+              nvtSendIac(pty,opt,IAC_WILL,    3);  /* GO AHEAD*/
+           } else  if (value==TELOPT_COMPRESS2 && opt!=NULL
+             && opt->compress_enabled) {
+              /* The driver starts the compression at the next output */
+              if (!opt->compress_active)
+                 opt->compress_request=true;
+           } else  if (value==1) {
+              /* The client echoes while it edits the lines */
+              if (lm!=NULL && lm->active && lm->client_echo_sent)
+                 nvtSendIac(pty,opt,IAC_WONT,    1);
+              else
+                 nvtSendIac(pty,opt,IAC_WILL,    1);  /* ECHO */
+           } else {
+              nvtSendIac(pty,opt,IAC_WONT,value);
+           };
+           return -1;
+       case IAC_WONT:
+           if (value==TELOPT_LINEMODE && lm!=NULL && lm->enabled) {
+             /* The client refused our request, stay in character mode */
+             lm->active=false;
+           } else if (value==1) {
+             nvtSendIac(pty,opt,IAC_WILL,    1);
+           } else { /* ECHO */
+             nvtSendIac(pty,opt,IAC_WONT,value);
+           }
+           return -1;
+       default:
+           if (value==IAC_ESC) {
+              pty->iac_mode=value;
+              return -1;
+           } else {
+              result=value;
+              if ( 0
+                /* map CRLF to CR for symmetry */
+                 || ((value=='\n') && pty->last_cr)
+                /* map telnet CRNUL to CR down here */
+                 || ((value==0) && pty->last_cr)
+                ) result=-1;
+               pty->last_cr=(value=='\r');
+               return result;
+           };
+   };
+  /* should never get here but keep compiler happy */
+  return -1;
+}
+
+
+int telnetd_nvt_process_byte(rtems_pty_context *pty, unsigned char value)
+{
+  return nvtProcessByte(pty, NULL, value);
+}
+
+void telnetd_nvt_start(rtems_pty_context *pty, telnetd_nvt_options *opt)
+{
+  telnetd_nvt_linemode *lm = &opt->linemode;
+
+  opt->compress_request = false;
+
+  if (opt->compress_enabled) {
+    nvtSendIac(pty, opt, IAC_WILL, TELOPT_COMPRESS2);
+  }
+
+  lm->active = false;
+  lm->mode_sent = 0;
+  lm->client_echo_sent = false;
+
+  if (lm->enabled) {
+    nvtSendIac(pty, opt, IAC_DO, TELOPT_LINEMODE);
+  }
+}
+
+void telnetd_nvt_linemode_update(
+  rtems_pty_context   *pty,
+  telnetd_nvt_options *opt,
+  unsigned char        mode,
+  bool                 client_echo
+)
+{
+  telnetd_nvt_linemode *lm = &opt->linemode;
+
+  lm->mode = mode;
+  lm->client_echo = client_echo;
+
+  if (!lm->active) {
+    return;
+  }
+
+  if (lm->mode != lm->mode_sent) {
+    nvtSendLinemodeMode(pty, opt);
+  }
+
+  nvtSyncEcho(pty, opt);
+}
+
+#define NVT_ONES  ((uintptr_t) -1 / 0xff)
+#define NVT_HIGHS (NVT_ONES * 0x80)
+
+/* Returns non-zero if one of the bytes of the word is zero */
+static inline uintptr_t nvtHasZeroByte(uintptr_t word)
+{
+  return (word - NVT_ONES) & ~word & NVT_HIGHS;
+}
+
+/* Returns true if a full word without an IAC or CR starts at the position */
+static inline bool
+nvtIsPlainWord(const unsigned char *p, const unsigned char *end)
+{
+  uintptr_t word;
+
+  if ((size_t) (end - p) < sizeof(word)) {
+    return false;
+  }
+
+  memcpy(&word, p, sizeof(word));
+  return nvtHasZeroByte(word ^ (NVT_ONES * IAC_ESC)) == 0
+    && nvtHasZeroByte(word ^ (NVT_ONES * '\r')) == 0;
+}
+
+/*
+ * Returns the first IAC or CR in the buffer or the end of the buffer.  These
+ * are the only bytes which need the state machine in the data mode.
+ */
+static const unsigned char *
+nvtScanSpecial(const unsigned char *p, const unsigned char *end)
+{
+  while ((size_t) (end - p) >= sizeof(uintptr_t)) {
+    uintptr_t word;
+
+    memcpy(&word, p, sizeof(word));
+
+    if (
+      nvtHasZeroByte(word ^ (NVT_ONES * IAC_ESC))
+        || nvtHasZeroByte(word ^ (NVT_ONES * '\r'))
+    ) {
+      break;
+    }
+
+    p += sizeof(word);
+  }
+
+  while (p < end && *p != IAC_ESC && *p != '\r') {
+    ++p;
+  }
+
+  return p;
+}
+
+size_t telnetd_nvt_decode(
+  rtems_pty_context   *pty,
+  telnetd_nvt_options *opt,
+  unsigned char       *buf,
+  size_t               len
+)
+{
+  const unsigned char *in;
+  const unsigned char *end;
+  unsigned char       *out;
+
+  in = buf;
+  end = buf + len;
+  out = buf;
+
+  while (in < end) {
+    int result;
+
+    result = nvtProcessByte(pty, opt, *in);
+    ++in;
+
+    if (result < 0) {
+      continue;
+    }
+
+    *out = (unsigned char) result;
+    ++out;
+
+    /*
+     * Pass the plain data which follows a character in bulk.  If an IAC or CR
+     * is within the next word, the byte state machine is faster than the
+     * scan, so stay with it.
+     */
+    if (pty->iac_mode == 0 && !pty->last_cr && nvtIsPlainWord(in, end)) {
+      const unsigned char *stop;
+      size_t               n;
+
+      stop = nvtScanSpecial(in, end);
+      n = (size_t) (stop - in);
+
+      if (out == in) {
+        out += n;
+      } else if (n < 16) {
+        /* Short runs between escapes are not worth a library call */
+        while (in != stop) {
+          *out = *in;
+          ++out;
+          ++in;
+        }
+      } else {
+        memmove(out, in, n);
+        out += n;
+      }
+
+      in = stop;
+    }
+  }
+
+  return (size_t) (out - buf);
+}
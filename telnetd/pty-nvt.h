@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/**
+ * @file
+ *
+ * @brief Telnet network virtual terminal input processing
+ */
+
+/*
+ * Copyright (C) 2026 The RTEMS Project
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TELNETD_PTY_NVT_H
+#define _TELNETD_PTY_NVT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <rtems/pty.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IAC_ESC    255
+#define IAC_DONT   254
+#define IAC_DO     253
+#define IAC_WONT   252
+#define IAC_WILL   251
+#define IAC_SB     250
+#define IAC_GA     249
+#define IAC_EL     248
+#define IAC_EC     247
+#define IAC_AYT    246
+#define IAC_AO     245
+#define IAC_IP     244
+#define IAC_BRK    243
+#define IAC_DMARK  242
+#define IAC_NOP    241
+#define IAC_SE     240
+#define IAC_EOR    239
+
+#define SB_MAX     RTEMS_PTY_SB_MAX
+
+#define TELOPT_ECHO      1
+#define TELOPT_LINEMODE  34
+#define TELOPT_COMPRESS2 86
+
+#define LM_MODE          1
+#define LM_FORWARDMASK   2
+#define LM_SLC           3
+
+#define LM_MODE_EDIT     0x01
+#define LM_MODE_TRAPSIG  0x02
+#define LM_MODE_ACK      0x04
+
+/**
+ * @brief Telnet LINEMODE (RFC 1184) state.
+ *
+ * In the EDIT mode, the client edits the input lines locally and sends
+ * complete lines.  Without the EDIT mode, the client sends each character.
+ * While the client edits, it also echoes the input, unless the server
+ * announces that it echoes.
+ */
+typedef struct {
+  /**
+   * @brief If true, then the LINEMODE option is negotiated.
+   */
+  bool          enabled;
+
+  /**
+   * @brief If true, then the client agreed to use the LINEMODE option.
+   */
+  bool          active;
+
+  /**
+   * @brief Mode requested by the server.
+   */
+  unsigned char mode;
+
+  /**
+   * @brief Mode last sent to the client.
+   */
+  unsigned char mode_sent;
+
+  /**
+   * @brief If true, then the client shall echo the input.
+   */
+  bool          client_echo;
+
+  /**
+   * @brief If true, then the client was told to echo the input.
+   */
+  bool          client_echo_sent;
+} telnetd_nvt_linemode;
+
+/**
+ * @brief Telnet option state of a connection.
+ */
+typedef struct {
+  /**
+   * @brief LINEMODE state.
+   */
+  telnetd_nvt_linemode linemode;
+
+  /**
+   * @brief Count of Telnet commands received.
+   */
+  uint32_t             commands;
+
+  /**
+   * @brief If true, then the COMPRESS2 option (MCCP2) is offered.
+   */
+  bool                 compress_enabled;
+
+  /**
+   * @brief Set if the client accepted the COMPRESS2 option.
+   *
+   * The driver starts the compressed stream and sets compress_active.
+   */
+  bool                 compress_request;
+
+  /**
+   * @brief If true, then the output to the client is compressed.
+   */
+  bool                 compress_active;
+
+  /**
+   * @brief Writes protocol replies to the client.
+   *
+   * If @c NULL, then replies are written to the socket of the PTY.
+   */
+  ssize_t            (*write)(rtems_pty_context *, const void *, size_t);
+} telnetd_nvt_options;
+
+/**
+ * @brief Sends a Telnet command with an option to the client.
+ */
+int telnetd_nvt_send_iac(
+  rtems_pty_context *pty,
+  unsigned char      mode,
+  unsigned char      option
+);
+
+/**
+ * @brief Feeds one byte received from the client through the NVT state
+ * machine.
+ *
+ * Replies to the client are written to the socket of the PTY.
+ *
+ * @return Returns the character for termios or a negative value if the byte
+ *   was consumed by the protocol.
+ */
+int telnetd_nvt_process_byte(rtems_pty_context *pty, unsigned char value);
+
+/**
+ * @brief Starts the option negotiation for a new connection.
+ *
+ * The server offers the COMPRESS2 option and asks the client to use the
+ * LINEMODE option if they are enabled.
+ */
+void telnetd_nvt_start(rtems_pty_context *pty, telnetd_nvt_options *opt);
+
+/**
+ * @brief Updates the mode and echo requested by the server.
+ *
+ * Changes are sent to the client if it agreed to use the LINEMODE option.
+ *
+ * @param mode is the LINEMODE mode mask.
+ * @param client_echo is true, if the client shall echo the input.
+ */
+void telnetd_nvt_linemode_update(
+  rtems_pty_context   *pty,
+  telnetd_nvt_options *opt,
+  unsigned char        mode,
+  bool                 client_echo
+);
+
+/**
+ * @brief Decodes a block of bytes received from the client in place.
+ *
+ * The result is the same as if each byte was fed through
+ * telnetd_nvt_process_byte() and the negative results were discarded.  Plain
+ * data runs of at least a word are scanned for the next IAC or CR word by word
+ * and copied in bulk, shorter runs go through the byte state machine.
+ *
+ * @param opt is the option state or @c NULL to refuse the LINEMODE and
+ *   COMPRESS2 options.
+ *
+ * @return Returns the count of characters for termios at the start of the
+ *   buffer.
+ */
+size_t telnetd_nvt_decode(
+  rtems_pty_context   *pty,
+  telnetd_nvt_options *opt,
+  unsigned char       *buf,
+  size_t               len
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TELNETD_PTY_NVT_H */
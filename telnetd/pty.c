@@ -44,26 +44,18 @@
 #include <string.h>
 #include <syslog.h>
 #include <unistd.h>
+#include <zlib.h>
 /*-----------------------------------------*/
-#define IAC_ESC    255
-#define IAC_DONT   254
-#define IAC_DO     253
-#define IAC_WONT   252
-#define IAC_WILL   251
-#define IAC_SB     250
-#define IAC_GA     249
-#define IAC_EL     248
-#define IAC_EC     247
-#define IAC_AYT    246
-#define IAC_AO     245
-#define IAC_IP     244
-#define IAC_BRK    243
-#define IAC_DMARK  242
-#define IAC_NOP    241
-#define IAC_SE     240
-#define IAC_EOR    239
-
-#define SB_MAX     RTEMS_PTY_SB_MAX
+#include "pty-internal.h"
+#include "pty-nvt.h"
+/*-----------------------------------------*/
+
+/* Echo skip windows, see ptyOpenEchoSkip() */
+#define PTY_ECHO_SKIP_NONE 0
+#define PTY_ECHO_SKIP_CHAR 1
+#define PTY_ECHO_SKIP_LINE 2
+#define PTY_ECHO_SKIP_ONE  3
+
 
 static bool ptyPollInitialize(rtems_termios_tty *,
   rtems_termios_device_context *, struct termios *,
@@ -86,26 +78,30 @@ static const rtems_termios_device_handler pty_handler = {
   .ioctl = my_pty_control
 };
 
-static
-int send_iac(rtems_pty_context *pty, unsigned char mode, unsigned char option)
-{
-  unsigned char buf[3];
+static int ptyBufferedPollRead(rtems_termios_device_context *);
+static void ptyBufferedWrite(rtems_termios_device_context *, const char *,
+  size_t);
+static void ptyBufferedShutdown(rtems_termios_tty *,
+  rtems_termios_device_context *, rtems_libio_open_close_args_t *);
 
-  buf[0]=IAC_ESC;
-  buf[1]=mode;
-  buf[2]=option;
-  return write(pty->socket, buf, sizeof(buf));
-}
+static const rtems_termios_device_handler telnetd_pty_handler = {
+  .first_open = ptyPollInitialize,
+  .last_close = ptyBufferedShutdown,
+  .poll_read = ptyBufferedPollRead,
+  .write = ptyBufferedWrite,
+  .set_attributes = ptySetAttributes,
+  .ioctl = my_pty_control
+};
 
-const char *rtems_pty_initialize(rtems_pty_context *pty, uintptr_t unique)
+static const char *pty_install(rtems_pty_context *pty, uintptr_t unique,
+  const rtems_termios_device_handler *handler)
 {
   rtems_status_code sc;
 
-  memset(pty, 0, sizeof(*pty));
   (void)snprintf(pty->name, sizeof(pty->name), "/dev/pty%" PRIuPTR, unique);
   rtems_termios_device_context_initialize(&pty->base, "pty");
   pty->socket = -1;
-  sc = rtems_termios_device_install(pty->name, &pty_handler, NULL, &pty->base);
+  sc = rtems_termios_device_install(pty->name, handler, NULL, &pty->base);
   if (sc != RTEMS_SUCCESSFUL) {
     return NULL;
   }
@@ -113,6 +109,54 @@ const char *rtems_pty_initialize(rtems_pty_context *pty, uintptr_t unique)
   return pty->name;
 }
 
+const char *rtems_pty_initialize(rtems_pty_context *pty, uintptr_t unique)
+{
+  memset(pty, 0, sizeof(*pty));
+  return pty_install(pty, unique, &pty_handler);
+}
+
+static ssize_t ptyNvtWrite(rtems_pty_context *, const void *, size_t);
+
+const char *telnetd_pty_initialize(telnetd_pty *tp, uintptr_t unique)
+{
+  memset(tp, 0, sizeof(*tp));
+  rtems_mutex_init(&tp->tx_mtx, "Telnet PTY");
+  tp->rx_nvt.write = ptyNvtWrite;
+  return pty_install(&tp->pty, unique, &telnetd_pty_handler);
+}
+
+void telnetd_pty_set_output(
+  telnetd_pty                   *tp,
+  unsigned char                 *buf,
+  size_t                         size,
+  rtems_interval                 latency,
+  rtems_telnetd_overflow_policy  overflow,
+  rtems_id                       flusher
+)
+{
+  tp->tx_buf = buf;
+  tp->tx_size = size;
+  tp->tx_len = 0;
+  tp->tx_lines = 0;
+  tp->tx_latency = latency;
+  tp->tx_flusher = flusher;
+  tp->tx_overflow = overflow;
+}
+
+void telnetd_pty_destroy(telnetd_pty *tp)
+{
+  if (tp->rx_mux) {
+    rtems_binary_semaphore_destroy(&tp->rx_sem);
+  }
+
+  if (tp->tx_zactive) {
+    (void)deflateEnd(&tp->tx_zstream);
+  }
+
+  rtems_mutex_destroy(&tp->tx_mtx);
+  (void)unlink(rtems_pty_get_path(&tp->pty));
+}
+
 void rtems_pty_close_socket(rtems_pty_context *pty)
 {
   if (pty->socket >= 0) {
@@ -134,185 +178,771 @@ void rtems_pty_set_socket(rtems_pty_context *pty, int socket)
   (void)setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &t, sizeof(t));
 
   /* inform the client that we will echo */
-  send_iac(pty, IAC_WILL, 1);
+  telnetd_nvt_send_iac(pty, IAC_WILL, 1);
+}
+
+void telnetd_pty_set_multiplexed(telnetd_pty *tp)
+{
+  rtems_binary_semaphore_init(&tp->rx_sem, "Telnet PTY");
+  tp->rx_mux = true;
+}
+
+void telnetd_pty_set_socket(telnetd_pty *tp, int socket)
+{
+  atomic_store_explicit(&tp->rx_head, 0, memory_order_relaxed);
+  atomic_store_explicit(&tp->rx_tail, 0, memory_order_relaxed);
+  atomic_store_explicit(&tp->rx_eof, false, memory_order_relaxed);
+  tp->rx_dec_next = 0;
+  tp->rx_dec_end = 0;
+  tp->rx_last = rtems_clock_get_ticks_since_boot();
+  tp->rx_timed_out = false;
+  tp->rx_echo_skip = PTY_ECHO_SKIP_NONE;
+  atomic_store_explicit(&tp->rx_echo_stamp, 0, memory_order_relaxed);
+  telnetd_pty_get_statistics(tp, &tp->stats_base, &tp->stats_base);
+  rtems_pty_set_socket(&tp->pty, socket);
+  telnetd_nvt_start(&tp->pty, &tp->rx_nvt);
+}
+
+void telnetd_pty_set_linemode(telnetd_pty *tp, bool enable)
+{
+  tp->rx_nvt.linemode.enabled = enable;
+}
+
+void telnetd_pty_set_compression(telnetd_pty *tp, bool enable)
+{
+  tp->rx_nvt.compress_enabled =
+    enable && tp->tx_size >= TELNETD_PTY_COMPRESS_MIN_BUFFER;
+}
+
+void telnetd_pty_set_echo_latency(telnetd_pty *tp, bool enable)
+{
+  tp->rx_echo_latency = enable;
+}
+
+void telnetd_pty_set_idle_timeout(telnetd_pty *tp, rtems_interval timeout)
+{
+  tp->rx_idle_timeout = timeout;
+}
+
+void telnetd_pty_get_statistics(
+  const telnetd_pty           *tp,
+  rtems_telnetd_io_statistics *connection,
+  rtems_telnetd_io_statistics *total
+)
+{
+  const rtems_telnetd_io_statistics *base;
+  size_t i;
+
+  total->bytes_received = tp->rx_bytes;
+  total->receive_calls = tp->rx_syscalls;
+  total->iac_commands = tp->rx_nvt.commands;
+  total->bytes_produced = tp->tx_produced;
+  total->bytes_sent = tp->tx_bytes;
+  total->send_calls = tp->tx_syscalls;
+  total->bytes_dropped = tp->tx_dropped;
+  total->write_blocked_ns = tp->tx_blocked_ns;
+  memcpy(
+    total->echo_latency,
+    tp->tx_echo_latency,
+    sizeof(total->echo_latency)
+  );
+
+  if (connection == total) {
+    return;
+  }
+
+  base = &tp->stats_base;
+  connection->bytes_received = total->bytes_received - base->bytes_received;
+  connection->receive_calls = total->receive_calls - base->receive_calls;
+  connection->iac_commands = total->iac_commands - base->iac_commands;
+  connection->bytes_produced = total->bytes_produced - base->bytes_produced;
+  connection->bytes_sent = total->bytes_sent - base->bytes_sent;
+  connection->send_calls = total->send_calls - base->send_calls;
+  connection->bytes_dropped = total->bytes_dropped - base->bytes_dropped;
+  connection->write_blocked_ns =
+    total->write_blocked_ns - base->write_blocked_ns;
+
+  for (i = 0; i < RTEMS_TELNETD_ECHO_LATENCY_BUCKETS; ++i) {
+    connection->echo_latency[i] =
+      total->echo_latency[i] - base->echo_latency[i];
+  }
+}
+
+bool telnetd_pty_check_idle(telnetd_pty *tp)
+{
+  if (tp->rx_timed_out) {
+    return true;
+  }
+
+  if (
+    tp->rx_idle_timeout == 0
+      || rtems_clock_get_ticks_since_boot() - tp->rx_last < tp->rx_idle_timeout
+  ) {
+    return false;
+  }
+
+  tp->rx_timed_out = true;
+  (void)shutdown(tp->pty.socket, SHUT_RDWR);
+  return true;
 }
 
 /*-----------------------------------------------------------*/
 /*
- * The NVT terminal is negociated in PollRead and PollWrite
- * with every BYTE sendded or received.
- * A litle status machine in the pty_read_byte(int minor)
- *
+ * Echo latency.  If enabled, the reception of input records a time stamp if
+ * none is pending and the next output sent to the client takes it.  The time stamps
+ * have a resolution of 1024ns, so that they fit into 32 bits and the bucket
+ * needs no division.  A time stamp of zero means no pending input.
  */
-static const char IAC_AYT_RSP[]="\r\nAYT? Yes, RTEMS-SHELL is here\r\n";
-static const char IAC_BRK_RSP[]="<*Break*>";
-static const char IAC_IP_RSP []="<*Interrupt*>";
+static uint32_t ptyEchoStamp(void)
+{
+  uint32_t stamp;
 
-static int
-handleSB(rtems_pty_context *pty)
+  stamp = (uint32_t)(rtems_clock_get_uptime_nanoseconds() >> 10);
+  return stamp != 0 ? stamp : 1;
+}
+
+static void ptyStampInput(telnetd_pty *tp)
 {
-  switch (pty->sb_buf[0]) {
-    case 31:  /* NAWS */
-      pty->width  = (pty->sb_buf[1]<<8) + pty->sb_buf[2];
-      pty->height = (pty->sb_buf[3]<<8) + pty->sb_buf[4];
-#if DEBUG & DEBUG_WH
-      fprintf(stderr,
-          "Setting width/height to %ix%i\n",
-          pty->width,
-          pty->height);
-#endif
+  if (!tp->rx_echo_latency) {
+    return;
+  }
+
+  if (atomic_load_explicit(&tp->rx_echo_stamp, memory_order_relaxed) == 0) {
+    atomic_store_explicit(
+      &tp->rx_echo_stamp,
+      ptyEchoStamp(),
+      memory_order_relaxed
+    );
+  }
+}
+
+static void ptyRecordEcho(telnetd_pty *tp)
+{
+  uint32_t stamp;
+  uint32_t delta;
+  size_t   bucket;
+
+  if (atomic_load_explicit(&tp->rx_echo_stamp, memory_order_relaxed) == 0) {
+    return;
+  }
+
+  stamp = atomic_exchange_explicit(&tp->rx_echo_stamp, 0, memory_order_relaxed);
+  if (stamp == 0) {
+    return;
+  }
+
+  /* The first bucket covers 2^7 time stamp units */
+  delta = (ptyEchoStamp() - stamp) >> 7;
+  bucket = 0;
+
+  while (delta != 0 && bucket < RTEMS_TELNETD_ECHO_LATENCY_BUCKETS - 1) {
+    delta >>= 1;
+    ++bucket;
+  }
+
+  ++tp->tx_echo_latency[bucket];
+}
+
+/*-----------------------------------------------------------*/
+/*
+ * Output coalescing.  Termios hands over output in small chunks, often a
+ * single character.  The chunks are collected in the output buffer which is
+ * flushed if it is full, after a burst of lines, before the session task
+ * waits for input, and by the flush task after the configured latency, see
+ * telnetd_pty_flush_expired().
+ *
+ * Only the session task appends to the output buffer.  The flush task uses
+ * non-blocking sends.  While the session task does a blocking send it
+ * releases the output mutex and sets tx_busy, so that the flush task is not
+ * stalled by a slow client.
+ *
+ * With the COMPRESS2 option, the output buffer contains the compressed
+ * stream.  Each flush completes the compressed block with a sync flush, so
+ * that the client can display all output produced so far.
+ */
+static bool ptySendOutput(telnetd_pty *tp, int flags)
+{
+  size_t done = 0;
+
+  while (done < tp->tx_len) {
+    ssize_t n;
+
+    n = send(tp->pty.socket, &tp->tx_buf[done], tp->tx_len - done, flags);
+    ++tp->tx_syscalls;
+    if (n <= 0) {
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+
+      /* The connection is gone, discard the output */
+      tp->tx_dropped += (uint32_t)(tp->tx_len - done);
+      done = tp->tx_len;
       break;
+    }
+
+    done += (size_t)n;
+    tp->tx_bytes += (uint32_t)n;
+    ptyRecordEcho(tp);
+  }
+
+  if (done > 0) {
+    memmove(tp->tx_buf, &tp->tx_buf[done], tp->tx_len - done);
+    tp->tx_len -= done;
+  }
+
+  if (tp->tx_len == 0) {
+    tp->tx_lines = 0;
+  }
+
+  return tp->tx_len == 0;
+}
+
+static void ptyCompressSync(telnetd_pty *tp)
+{
+  z_stream *z = &tp->tx_zstream;
+
+  if (!tp->tx_zsync || tp->tx_len == tp->tx_size) {
+    return;
+  }
+
+  z->next_out = &tp->tx_buf[tp->tx_len];
+  z->avail_out = (uInt)(tp->tx_size - tp->tx_len);
+  (void)deflate(z, Z_SYNC_FLUSH);
+  tp->tx_len = tp->tx_size - z->avail_out;
+
+  /* Otherwise, the flush has to be continued with more output space */
+  if (z->avail_out != 0) {
+    tp->tx_zsync = false;
+  }
+}
+
+static bool ptyFlushOutput(telnetd_pty *tp, int flags)
+{
+  bool done;
+
+  do {
+    ptyCompressSync(tp);
+    done = ptySendOutput(tp, flags);
+  } while (done && tp->tx_zsync);
+
+  return done;
+}
+
+static void ptyFlushOutputBlocking(telnetd_pty *tp)
+{
+  uint64_t t0;
+
+  tp->tx_busy = true;
+  rtems_mutex_unlock(&tp->tx_mtx);
+  t0 = rtems_clock_get_uptime_nanoseconds();
+  (void)ptyFlushOutput(tp, 0);
+  tp->tx_blocked_ns += rtems_clock_get_uptime_nanoseconds() - t0;
+  rtems_mutex_lock(&tp->tx_mtx);
+  tp->tx_busy = false;
+}
+
+static void ptyArmFlush(telnetd_pty *tp)
+{
+  if (
+    (tp->tx_len == 0 && !tp->tx_zsync)
+      || tp->tx_latency == 0
+      || tp->tx_flush_armed
+  ) {
+    return;
+  }
+
+  tp->tx_deadline = rtems_clock_get_ticks_since_boot() + tp->tx_latency;
+  tp->tx_flush_armed = true;
+
+  if (tp->tx_flusher != 0 && tp->tx_flusher != rtems_task_self()) {
+    (void)rtems_event_send(tp->tx_flusher, TELNETD_PTY_FLUSH_EVENT);
+  }
+}
+
+bool telnetd_pty_reader_waits(telnetd_pty *tp)
+{
+  return atomic_load_explicit(&tp->rx_waiting, memory_order_relaxed);
+}
+
+rtems_interval telnetd_pty_flush_expired(telnetd_pty *tp, rtems_interval now)
+{
+  rtems_interval remaining;
+
+  rtems_mutex_lock(&tp->tx_mtx);
+
+  if (tp->tx_flush_armed && (int32_t)(now - tp->tx_deadline) >= 0) {
+    tp->tx_flush_armed = false;
+
+    /* A blocking send in progress flushes the output anyway */
+    if (!tp->tx_busy) {
+      (void)ptyFlushOutput(tp, MSG_DONTWAIT);
+      ptyArmFlush(tp);
+    }
+  }
+
+  if (tp->tx_flush_armed) {
+    remaining = tp->tx_deadline - now;
+  } else {
+    remaining = 0;
+  }
+
+  rtems_mutex_unlock(&tp->tx_mtx);
+  return remaining;
+}
+
+/* Returns true if there is space in the output buffer afterwards */
+static bool ptyHandleOverflow(telnetd_pty *tp)
+{
+  if (ptyFlushOutput(tp, MSG_DONTWAIT) || tp->tx_len < tp->tx_size) {
+    return true;
+  }
+
+  switch (tp->tx_overflow) {
+    case RTEMS_TELNETD_OVERFLOW_BLOCK:
+      ptyFlushOutputBlocking(tp);
+      return tp->tx_len < tp->tx_size;
+    case RTEMS_TELNETD_OVERFLOW_DISCONNECT:
+      (void)shutdown(tp->pty.socket, SHUT_RDWR);
+      tp->tx_dropped += (uint32_t)tp->tx_len;
+      tp->tx_len = 0;
+      tp->tx_lines = 0;
+      return false;
     default:
-      break;
+      return false;
   }
-  return 0;
+}
+
+static void ptyFlushBeforeInput(telnetd_pty *tp)
+{
+  if (tp->tx_size == 0) {
+    return;
+  }
+
+  rtems_mutex_lock(&tp->tx_mtx);
+
+  if (!tp->tx_busy && !ptyFlushOutput(tp, MSG_DONTWAIT)) {
+    ptyArmFlush(tp);
+    if (!tp->tx_flush_armed) {
+      ptyFlushOutputBlocking(tp);
+    }
+  }
+
+  rtems_mutex_unlock(&tp->tx_mtx);
+}
+
+void telnetd_pty_close_socket(telnetd_pty *tp)
+{
+  rtems_mutex_lock(&tp->tx_mtx);
+
+  if (tp->tx_len > 0 || tp->tx_zsync) {
+    if (tp->tx_overflow == RTEMS_TELNETD_OVERFLOW_BLOCK) {
+      ptyFlushOutputBlocking(tp);
+    } else {
+      (void)ptyFlushOutput(tp, MSG_DONTWAIT);
+    }
+
+    tp->tx_dropped += (uint32_t)tp->tx_len;
+    tp->tx_len = 0;
+    tp->tx_lines = 0;
+  }
+
+  tp->tx_flush_armed = false;
+
+  if (tp->tx_zactive) {
+    (void)deflateEnd(&tp->tx_zstream);
+    tp->tx_zactive = false;
+    tp->tx_zsync = false;
+    tp->rx_nvt.compress_active = false;
+  }
+
+  if (tp->rx_mux) {
+    (void)shutdown(tp->pty.socket, SHUT_RDWR);
+  } else {
+    rtems_pty_close_socket(&tp->pty);
+  }
+
+  rtems_mutex_unlock(&tp->tx_mtx);
+}
+
+bool telnetd_pty_output_pending(telnetd_pty *tp)
+{
+  bool pending;
+
+  rtems_mutex_lock(&tp->tx_mtx);
+  pending = (tp->tx_len > 0 || tp->tx_zsync);
+  rtems_mutex_unlock(&tp->tx_mtx);
+
+  return pending;
+}
+
+void telnetd_pty_flush_output(telnetd_pty *tp)
+{
+  rtems_mutex_lock(&tp->tx_mtx);
+
+  if (!tp->tx_busy) {
+    (void)ptyFlushOutput(tp, MSG_DONTWAIT);
+  }
+
+  rtems_mutex_unlock(&tp->tx_mtx);
+}
+
+static int ptyEOF(rtems_pty_context *pty)
+{
+  /* Unfortunately, there is no way of passing an EOF
+   * condition through the termios driver. Hence, we
+   * resort to an ugly hack. Setting cindex>ccount
+   * causes the termios driver to return a read count
+   * of '0' which is what we want here. We leave
+   * 'errno' untouched.
+   */
+  pty->ttyp->cindex=pty->ttyp->ccount+1;
+  return pty->ttyp->termios.c_cc[VEOF];
 }
 
 static int ptyPollRead(rtems_termios_device_context *base)
 { /* Characters written to the client side*/
    rtems_pty_context *pty = (rtems_pty_context *)base;
    unsigned char  value;
-   unsigned int  omod;
    int      count;
-   int      result;
 
    count=read(pty->socket,&value,sizeof(value));
    if (count<0)
     return -1;
 
-   if (count<1) {
-      /* Unfortunately, there is no way of passing an EOF
-       * condition through the termios driver. Hence, we
-       * resort to an ugly hack. Setting cindex>ccount
-       * causes the termios driver to return a read count
-       * of '0' which is what we want here. We leave
-       * 'errno' untouched.
+   if (count<1)
+    return ptyEOF(pty);
+
+   return telnetd_nvt_process_byte(pty, value);
+}
+
+/*
+ * The receive ring indices run freely and are masked on access.  The head is
+ * only written by the producer (the reader itself or the I/O task in
+ * multiplexed mode), the tail only by the reader.
+ */
+size_t telnetd_pty_receive_space(const telnetd_pty *tp)
+{
+  uint32_t head;
+  uint32_t tail;
+
+  head = atomic_load_explicit(&tp->rx_head, memory_order_relaxed);
+  tail = atomic_load_explicit(&tp->rx_tail, memory_order_acquire);
+
+  return TELNETD_PTY_RX_SIZE - (head - tail);
+}
+
+/*
+ * Read as much as fits into the contiguous free space of the receive ring
+ * with a single system call.
+ */
+static ssize_t ptyFillReceiveRing(telnetd_pty *tp)
+{
+  uint32_t head;
+  uint32_t index;
+  size_t   space;
+  ssize_t  count;
+
+  head = atomic_load_explicit(&tp->rx_head, memory_order_relaxed);
+
+  /* Without a concurrent reader, an empty ring may start over */
+  if (!tp->rx_mux
+    && head == atomic_load_explicit(&tp->rx_tail, memory_order_relaxed)) {
+    head = 0;
+    atomic_store_explicit(&tp->rx_head, 0, memory_order_relaxed);
+    atomic_store_explicit(&tp->rx_tail, 0, memory_order_relaxed);
+  }
+
+  index = head & (TELNETD_PTY_RX_SIZE - 1);
+  space = telnetd_pty_receive_space(tp);
+  if (space > TELNETD_PTY_RX_SIZE - index)
+    space = TELNETD_PTY_RX_SIZE - index;
+
+  count = read(tp->pty.socket, &tp->rx_buf[index], space);
+  ++tp->rx_syscalls;
+  if (count > 0) {
+    atomic_store_explicit(
+      &tp->rx_head,
+      head + (uint32_t)count,
+      memory_order_release
+    );
+    tp->rx_bytes += (uint32_t)count;
+    tp->rx_last = rtems_clock_get_ticks_since_boot();
+    ptyStampInput(tp);
+  }
+
+  return count;
+}
+
+bool telnetd_pty_receive(telnetd_pty *tp)
+{
+  ssize_t count;
+
+  if (telnetd_pty_receive_space(tp) == 0) {
+    return true;
+  }
+
+  count = ptyFillReceiveRing(tp);
+  if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return true;
+  }
+
+  if (count <= 0) {
+    atomic_store_explicit(&tp->rx_eof, true, memory_order_release);
+  }
+
+  rtems_binary_semaphore_post(&tp->rx_sem);
+  return count > 0;
+}
+
+/*
+ * LINEMODE.  In the edit mode, the client echoes the input line while it is
+ * edited, so the echo of termios for the characters of the line has to be
+ * dropped.  Termios echoes a character in the reader task right after the
+ * poll read returned it.  The echo skip window opened for a character is
+ * closed by the next poll read.  A line terminator ends the read, so its
+ * window is closed by the echo of the new line.
+ */
+static void ptySyncLinemode(telnetd_pty *tp)
+{
+  const struct termios *t;
+  unsigned char         mode;
+  bool                  client_echo;
+
+  if (!tp->rx_nvt.linemode.active) {
+    return;
+  }
+
+  t = &tp->pty.ttyp->termios;
+  mode = (t->c_lflag & ICANON) != 0 ? LM_MODE_EDIT : 0;
+  client_echo = mode != 0 && (t->c_lflag & ECHO) != 0;
+  telnetd_nvt_linemode_update(&tp->pty, &tp->rx_nvt, mode, client_echo);
+}
+
+static void ptyOpenEchoSkip(telnetd_pty *tp, unsigned char value)
+{
+  const struct termios *t;
+  unsigned char         c;
+
+  if (!tp->rx_nvt.linemode.active || !tp->rx_nvt.linemode.client_echo_sent) {
+    return;
+  }
+
+  /* Map the character like the input processing of termios */
+  t = &tp->pty.ttyp->termios;
+  c = value;
+  if ((t->c_iflag & ISTRIP) != 0)
+    c &= 0x7f;
+  if (c == '\r') {
+    if ((t->c_iflag & IGNCR) != 0)
+      return;
+    if ((t->c_iflag & ICRNL) != 0)
+      c = '\n';
+  } else if (c == '\n' && (t->c_iflag & INLCR) != 0) {
+    c = '\r';
+  }
+
+  if (c == '\n') {
+    if ((t->c_lflag & (ECHO | ECHONL)) != 0)
+      tp->rx_echo_skip = PTY_ECHO_SKIP_LINE;
+  } else if (c == t->c_cc[VEOF]) {
+    /* Not echoed */
+  } else if ((t->c_lflag & ECHO) != 0) {
+    if (c == t->c_cc[VEOL] || c == t->c_cc[VEOL2])
+      tp->rx_echo_skip = PTY_ECHO_SKIP_ONE;
+    else
+      tp->rx_echo_skip = PTY_ECHO_SKIP_CHAR;
+  }
+}
+
+/* Returns true if the output is an echo the client already did */
+static bool ptySkipEcho(telnetd_pty *tp, const char *buf, size_t len)
+{
+  if (tp->rx_echo_skip == PTY_ECHO_SKIP_NONE
+    || rtems_task_self() != tp->rx_reader) {
+    return false;
+  }
+
+  switch (tp->rx_echo_skip) {
+    case PTY_ECHO_SKIP_LINE:
+      if (memchr(buf, '\n', len) != NULL)
+        tp->rx_echo_skip = PTY_ECHO_SKIP_NONE;
+      break;
+    case PTY_ECHO_SKIP_ONE:
+      tp->rx_echo_skip = PTY_ECHO_SKIP_NONE;
+      break;
+    default:
+      break;
+  }
+
+  return true;
+}
+
+/*
+ * COMPRESS2.  The client accepted the option, so everything after the start
+ * sequence is a zlib stream.  Output buffered so far is sent uncompressed.
+ */
+static void ptyStartCompression(telnetd_pty *tp)
+{
+  static const unsigned char start[] = {
+    IAC_ESC, IAC_SB, TELOPT_COMPRESS2, IAC_ESC, IAC_SE
+  };
+  static const unsigned char refuse[] = {
+    IAC_ESC, IAC_WONT, TELOPT_COMPRESS2
+  };
+  z_stream            *z = &tp->tx_zstream;
+  const unsigned char *seq;
+  size_t               size;
+  int                  rv;
+
+  tp->rx_nvt.compress_request = false;
+
+  memset(z, 0, sizeof(*z));
+  rv = deflateInit2(
+    z,
+    Z_DEFAULT_COMPRESSION,
+    Z_DEFLATED,
+    TELNETD_PTY_COMPRESS_WINDOW_BITS,
+    TELNETD_PTY_COMPRESS_MEM_LEVEL,
+    Z_DEFAULT_STRATEGY
+  );
+
+  /*
+   * The answer follows the output buffered so far, also if the compression
+   * is refused.
+   */
+  if (rv == Z_OK) {
+    seq = start;
+    size = sizeof(start);
+  } else {
+    seq = refuse;
+    size = sizeof(refuse);
+  }
+
+  rtems_mutex_lock(&tp->tx_mtx);
+
+  if (tp->tx_size - tp->tx_len < size) {
+    ptyFlushOutputBlocking(tp);
+  }
+
+  memcpy(&tp->tx_buf[tp->tx_len], seq, size);
+  tp->tx_len += size;
+
+  if (rv == Z_OK) {
+    tp->tx_zactive = true;
+    tp->rx_nvt.compress_active = true;
+  }
+
+  (void)ptyFlushOutput(tp, MSG_DONTWAIT);
+  ptyArmFlush(tp);
+
+  rtems_mutex_unlock(&tp->tx_mtx);
+}
+
+static int ptyBufferedPollRead(rtems_termios_device_context *base)
+{
+  telnetd_pty *tp = (telnetd_pty *)base;
+  ssize_t      count;
+
+  tp->rx_echo_skip = PTY_ECHO_SKIP_NONE;
+  tp->rx_reader = rtems_task_self();
+
+  while (true) {
+    uint32_t head;
+    uint32_t tail;
+
+    if (tp->rx_dec_next != tp->rx_dec_end) {
+      unsigned char value;
+
+      value = tp->rx_buf[tp->rx_dec_next & (TELNETD_PTY_RX_SIZE - 1)];
+      ++tp->rx_dec_next;
+
+      /* Give the decoded block back to the producer once it is consumed */
+      if (tp->rx_dec_next == tp->rx_dec_end) {
+        atomic_store_explicit(
+          &tp->rx_tail,
+          tp->rx_dec_raw_end,
+          memory_order_release
+        );
+      }
+
+      ptyOpenEchoSkip(tp, value);
+      return value;
+    }
+
+    head = atomic_load_explicit(&tp->rx_head, memory_order_acquire);
+    tail = atomic_load_explicit(&tp->rx_tail, memory_order_relaxed);
+
+    if (tail != head) {
+      uint32_t index;
+      size_t   raw;
+      size_t   cooked;
+
+      /*
+       * Decode the contiguous part of the received data in place.  Bytes
+       * consumed by the protocol are skipped here, otherwise termios would
+       * sleep for a clock tick on each of them.
        */
-      pty->ttyp->cindex=pty->ttyp->ccount+1;
-      return pty->ttyp->termios.c_cc[VEOF];
-   };
-
-   omod=pty->iac_mode;
-   pty->iac_mode=0;
-   switch(omod & 0xff) {
-       case IAC_ESC:
-           switch(value) {
-               case IAC_ESC :
-                   /* in case this is an ESC ESC sequence in SB mode */
-                   pty->iac_mode = omod>>8;
-                   return IAC_ESC;
-               case IAC_DONT:
-               case IAC_DO  :
-               case IAC_WONT:
-               case IAC_WILL:
-                   pty->iac_mode=value;
-                   return -1;
-               case IAC_SB  :
-#if DEBUG & DEBUG_DETAIL
-                   printk("SB\n");
-#endif
-                   pty->iac_mode=value;
-                   pty->sb_ind=0;
-                   return -100;
-               case IAC_GA  :
-                   return -1;
-               case IAC_EL  :
-                   return 0x03; /* Ctrl-C*/
-               case IAC_EC  :
-                   return '\b';
-               case IAC_AYT :
-                   write(pty->socket,IAC_AYT_RSP,strlen(IAC_AYT_RSP));
-                   return -1;
-               case IAC_AO  :
-                   return -1;
-               case IAC_IP  :
-                   write(pty->socket,IAC_IP_RSP,strlen(IAC_IP_RSP));
-                   return -1;
-               case IAC_BRK :
-                   write(pty->socket,IAC_BRK_RSP,strlen(IAC_BRK_RSP));
-                   return -1;
-               case IAC_DMARK:
-                   return -2;
-               case IAC_NOP :
-                   return -1;
-               case IAC_SE  :
-#if DEBUG & DEBUG_DETAIL
-                  {
-                  int i;
-                  printk("SE");
-                  for (i=0; i<pty->sb_ind; i++)
-                    printk(" %02x",pty->sb_buf[i]);
-                  printk("\n");
-                  }
-#endif
-                  handleSB(pty);
-               return -101;
-               case IAC_EOR :
-                   return -102;
-               default      :
-                   return -1;
-           };
-           break;
-
-       case IAC_SB:
-           pty->iac_mode=omod;
-           if (IAC_ESC==value) {
-             pty->iac_mode=(omod<<8)|value;
-           } else {
-             if (pty->sb_ind < SB_MAX)
-               pty->sb_buf[pty->sb_ind++]=value;
-           }
-           return -1;
-
-       case IAC_WILL:
-           if (value==34){
-              send_iac(pty,IAC_DONT,   34);  /*LINEMODE*/
-              send_iac(pty,IAC_DO  ,    1);  /*ECHO    */
-           } else if (value==31) {
-              send_iac(pty,IAC_DO  ,   31);  /*NAWS    */
-#if DEBUG & DEBUG_DETAIL
-              printk("replied DO NAWS\n");
-#endif
-           } else {
-              send_iac(pty,IAC_DONT,value);
-           }
-           return -1;
-       case IAC_DONT:
-           return -1;
-       case IAC_DO  :
-           if (value==3) {
-              send_iac(pty,IAC_WILL,    3);  /* GO AHEAD*/
-           } else  if (value==1) {
-              send_iac(pty,IAC_WILL,    1);  /* ECHO */
-           } else {
-              send_iac(pty,IAC_WONT,value);
-           };
-           return -1;
-       case IAC_WONT:
-           if (value==1) {
-             send_iac(pty,IAC_WILL,    1);
-           } else { /* ECHO */
-             send_iac(pty,IAC_WONT,value);
-           }
-           return -1;
-       default:
-           if (value==IAC_ESC) {
-              pty->iac_mode=value;
-              return -1;
-           } else {
-              result=value;
-              if ( 0
-                /* map CRLF to CR for symmetry */
-                 || ((value=='\n') && pty->last_cr)
-                /* map telnet CRNUL to CR down here */
-                 || ((value==0) && pty->last_cr)
-                ) result=-1;
-               pty->last_cr=(value=='\r');
-               return result;
-           };
-   };
-  /* should never get here but keep compiler happy */
-  return -1;
+      index = tail & (TELNETD_PTY_RX_SIZE - 1);
+      raw = head - tail;
+      if (raw > TELNETD_PTY_RX_SIZE - index)
+        raw = TELNETD_PTY_RX_SIZE - index;
+
+      cooked = telnetd_nvt_decode(
+        &tp->pty,
+        &tp->rx_nvt,
+        &tp->rx_buf[index],
+        raw
+      );
+
+      if (tp->rx_nvt.compress_request) {
+        ptyStartCompression(tp);
+      }
+
+      if (cooked == 0) {
+        atomic_store_explicit(
+          &tp->rx_tail,
+          tail + (uint32_t)raw,
+          memory_order_release
+        );
+      } else {
+        tp->rx_dec_next = tail;
+        tp->rx_dec_end = tail + (uint32_t)cooked;
+        tp->rx_dec_raw_end = tail + (uint32_t)raw;
+      }
+
+      continue;
+    }
+
+    ptySyncLinemode(tp);
+    ptyFlushBeforeInput(tp);
+
+    if (tp->rx_mux) {
+      if (atomic_load_explicit(&tp->rx_eof, memory_order_acquire)) {
+        /* Input received before the end of file is still in the ring */
+        if (atomic_load_explicit(&tp->rx_head, memory_order_acquire) != tail)
+          continue;
+
+        return ptyEOF(&tp->pty);
+      }
+
+      atomic_store_explicit(&tp->rx_waiting, true, memory_order_relaxed);
+      rtems_binary_semaphore_wait(&tp->rx_sem);
+      atomic_store_explicit(&tp->rx_waiting, false, memory_order_relaxed);
+      continue;
+    }
+
+    count = ptyFillReceiveRing(tp);
+    if (count < 0) {
+      /* The socket receive timeout lets us check the idle time */
+      if (telnetd_pty_check_idle(tp))
+        return ptyEOF(&tp->pty);
+
+      return -1;
+    }
+
+    if (count == 0)
+      return ptyEOF(&tp->pty);
+  }
 }
 
 /*-----------------------------------------------------------*/
@@ -348,6 +978,18 @@ ptyShutdown(rtems_termios_tty *ttyp,
   close(pty->socket);
 }
 /*-----------------------------------------------------------*/
+static void
+ptyBufferedShutdown(rtems_termios_tty *ttyp,
+  rtems_termios_device_context *base, rtems_libio_open_close_args_t *arg)
+{
+  telnetd_pty *tp = (telnetd_pty *)base;
+
+  /* In multiplexed mode, the socket belongs to the I/O task */
+  if (!tp->rx_mux) {
+    close(tp->pty.socket);
+  }
+}
+/*-----------------------------------------------------------*/
 /* Write Characters into pty device                          */
 /*-----------------------------------------------------------*/
 static void
@@ -366,6 +1008,159 @@ ptyPollWrite(rtems_termios_device_context *base, const char *buf, size_t len)
   }
 }
 
+/* Writes without an output buffer, this may block */
+static void ptyWriteDirect(telnetd_pty *tp, const void *buf, size_t len)
+{
+  uint64_t t0;
+
+  t0 = rtems_clock_get_uptime_nanoseconds();
+
+  while (len > 0) {
+    ssize_t n;
+
+    n = write(tp->pty.socket, buf, len);
+    ++tp->tx_syscalls;
+    if (n <= 0) {
+      tp->tx_dropped += (uint32_t)len;
+      break;
+    }
+
+    tp->tx_bytes += (uint32_t)n;
+    ptyRecordEcho(tp);
+    buf = (const char *)buf + (size_t)n;
+    len -= (size_t)n;
+  }
+
+  tp->tx_blocked_ns += rtems_clock_get_uptime_nanoseconds() - t0;
+}
+
+static uint32_t ptyCountLines(const char *buf, size_t len)
+{
+  const char *end = buf + len;
+  uint32_t    lines = 0;
+
+  while ((buf = memchr(buf, '\n', (size_t)(end - buf))) != NULL) {
+    ++lines;
+    ++buf;
+  }
+
+  return lines;
+}
+
+/* Must be called with the output mutex locked */
+static void ptyAppendCompressed(telnetd_pty *tp, const void *buf, size_t len)
+{
+  z_stream *z = &tp->tx_zstream;
+
+  z->next_in = (Bytef *)buf;
+  z->avail_in = (uInt)len;
+
+  while (z->avail_in > 0) {
+    if (tp->tx_len == tp->tx_size && !ptyHandleOverflow(tp)) {
+      /* Input not consumed by the compressor is dropped, the stream is fine */
+      tp->tx_dropped += (uint32_t)z->avail_in;
+      break;
+    }
+
+    /* An overflow flush may have compressed the remaining input */
+    if (z->avail_in == 0) {
+      break;
+    }
+
+    z->next_out = &tp->tx_buf[tp->tx_len];
+    z->avail_out = (uInt)(tp->tx_size - tp->tx_len);
+    (void)deflate(z, tp->tx_zsync ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+    tp->tx_len = tp->tx_size - z->avail_out;
+  }
+
+  z->next_in = NULL;
+  z->avail_in = 0;
+  tp->tx_zsync = true;
+}
+
+/* Must be called with the output mutex locked */
+static void ptyAppendOutput(telnetd_pty *tp, const char *buf, size_t len)
+{
+  if (tp->tx_zactive) {
+    ptyAppendCompressed(tp, buf, len);
+    tp->tx_lines += ptyCountLines(buf, len);
+    return;
+  }
+
+  while (len > 0) {
+    size_t n = tp->tx_size - tp->tx_len;
+
+    if (n == 0) {
+      if (!ptyHandleOverflow(tp)) {
+        tp->tx_dropped += (uint32_t)len;
+        break;
+      }
+
+      continue;
+    }
+
+    if (n > len) {
+      n = len;
+    }
+
+    memcpy(&tp->tx_buf[tp->tx_len], buf, n);
+    tp->tx_len += n;
+    tp->tx_lines += ptyCountLines(buf, n);
+    buf += n;
+    len -= n;
+  }
+}
+
+static void
+ptyBufferedWrite(rtems_termios_device_context *base, const char *buf,
+  size_t len)
+{
+  telnetd_pty *tp = (telnetd_pty *)base;
+
+  if (ptySkipEcho(tp, buf, len)) {
+    return;
+  }
+
+  tp->tx_produced += (uint32_t)len;
+
+  if (tp->tx_size == 0) {
+    ptyWriteDirect(tp, buf, len);
+    return;
+  }
+
+  rtems_mutex_lock(&tp->tx_mtx);
+  ptyAppendOutput(tp, buf, len);
+
+  if (tp->tx_lines >= TELNETD_PTY_TX_BURST_LINES) {
+    (void)ptyFlushOutput(tp, MSG_DONTWAIT);
+  }
+
+  ptyArmFlush(tp);
+  rtems_mutex_unlock(&tp->tx_mtx);
+}
+
+/*
+ * Protocol replies of the NVT.  With an output buffer, they are queued after
+ * the pending output and are sent at the latest before the session waits for
+ * input.  Once the output is compressed, they have to go through the
+ * compressor.
+ */
+static ssize_t ptyNvtWrite(rtems_pty_context *pty, const void *buf, size_t len)
+{
+  telnetd_pty *tp = (telnetd_pty *)pty;
+
+  if (tp->tx_size == 0) {
+    ptyWriteDirect(tp, buf, len);
+    return (ssize_t)len;
+  }
+
+  rtems_mutex_lock(&tp->tx_mtx);
+  ptyAppendOutput(tp, buf, len);
+  ptyArmFlush(tp);
+  rtems_mutex_unlock(&tp->tx_mtx);
+  return (ssize_t)len;
+}
+
 static int
 my_pty_control(rtems_termios_device_context *base,
   ioctl_command_t request, void *buffer)
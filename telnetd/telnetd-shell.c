@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/**
+ * @file
+ *
+ * @brief Shell command to show the Telnet server statistics
+ */
+
+/*
+ * Copyright (C) 2026 The RTEMS Project
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rtems/telnetd.h>
+
+static void rtems_shell_telnetd_add_io(
+  rtems_telnetd_io_statistics       *sum,
+  const rtems_telnetd_io_statistics *io
+)
+{
+  size_t i;
+
+  sum->bytes_received += io->bytes_received;
+  sum->receive_calls += io->receive_calls;
+  sum->iac_commands += io->iac_commands;
+  sum->bytes_produced += io->bytes_produced;
+  sum->bytes_sent += io->bytes_sent;
+  sum->send_calls += io->send_calls;
+  sum->bytes_dropped += io->bytes_dropped;
+  sum->write_blocked_ns += io->write_blocked_ns;
+
+  for (i = 0; i < RTEMS_TELNETD_ECHO_LATENCY_BUCKETS; ++i) {
+    sum->echo_latency[i] += io->echo_latency[i];
+  }
+}
+
+static void rtems_shell_telnetd_print_io(
+  const rtems_telnetd_io_statistics *io
+)
+{
+  unsigned ratio;
+  size_t i;
+
+  ratio = 0;
+  if (io->bytes_produced > 0) {
+    ratio = (unsigned) (((uint64_t) io->bytes_sent * 100) /
+      io->bytes_produced);
+  }
+
+  printf(
+    "  received %" PRIu32 " bytes in %" PRIu32 " reads, %" PRIu32
+      " commands\n"
+    "  produced %" PRIu32 " bytes, sent %" PRIu32 " bytes (%u%%) in %" PRIu32
+      " writes, %" PRIu32 " dropped\n"
+    "  blocked in write %" PRIu64 "ms, echo latency",
+    io->bytes_received,
+    io->receive_calls,
+    io->iac_commands,
+    io->bytes_produced,
+    io->bytes_sent,
+    ratio,
+    io->send_calls,
+    io->bytes_dropped,
+    io->write_blocked_ns / 1000000
+  );
+
+  for (i = 0; i < RTEMS_TELNETD_ECHO_LATENCY_BUCKETS; ++i) {
+    if (io->echo_latency[i] == 0) {
+      continue;
+    }
+
+    if (i < RTEMS_TELNETD_ECHO_LATENCY_BUCKETS - 1) {
+      printf(" <%uus:", (unsigned) ((UINT32_C(1) << (i + 17)) / 1000));
+    } else {
+      printf(" >=%uus:", (unsigned) ((UINT32_C(1) << (i + 16)) / 1000));
+    }
+
+    printf("%" PRIu32, io->echo_latency[i]);
+  }
+
+  printf("\n");
+}
+
+static int rtems_shell_telnetd_sessions(void)
+{
+  rtems_telnetd_session_statistics *stats;
+  rtems_telnetd_io_statistics total;
+  size_t count;
+  size_t n;
+  size_t i;
+
+  count = rtems_telnetd_get_session_statistics(NULL, 0);
+  if (count == 0) {
+    return 0;
+  }
+
+  stats = calloc(count, sizeof(*stats));
+  if (stats == NULL) {
+    fprintf(stderr, "telnetd: not enough memory\n");
+    return 1;
+  }
+
+  /* Sessions are prepared on demand, so their number may have grown */
+  n = rtems_telnetd_get_session_statistics(stats, count);
+  if (n < count) {
+    count = n;
+  }
+
+  memset(&total, 0, sizeof(total));
+
+  for (i = 0; i < count; ++i) {
+    const rtems_telnetd_session_statistics *st;
+
+    st = &stats[i];
+    rtems_shell_telnetd_add_io(&total, &st->total);
+
+    if (st->connected) {
+      printf(
+        "\nsession %" PRIu16 "/%" PRIu16 " from %s%s\n",
+        st->port,
+        st->session,
+        st->peername,
+        st->compressed ? ", compressed" : ""
+      );
+      rtems_shell_telnetd_print_io(&st->connection);
+    }
+  }
+
+  printf("\nall connections of %zu sessions\n", count);
+  rtems_shell_telnetd_print_io(&total);
+  free(stats);
+  return 0;
+}
+
+static int rtems_shell_telnetd_command(int argc, char **argv)
+{
+  rtems_telnetd_statistics *stats;
+  size_t count;
+  size_t n;
+  size_t i;
+
+  (void)argv;
+
+  if (argc != 1) {
+    fprintf(stderr, "usage: telnetd\n");
+    return 1;
+  }
+
+  count = rtems_telnetd_get_statistics(NULL, 0);
+  if (count == 0) {
+    printf("no Telnet server running\n");
+    return 0;
+  }
+
+  stats = calloc(count, sizeof(*stats));
+  if (stats == NULL) {
+    fprintf(stderr, "telnetd: not enough memory\n");
+    return 1;
+  }
+
+  /*
+   * The getter returns the number of servers, which may have grown since the
+   * array was allocated.
+   */
+  n = rtems_telnetd_get_statistics(stats, count);
+  if (n < count) {
+    count = n;
+  }
+
+  printf(
+    " PORT ACTIVE PENDING   ACCEPTED     QUEUED   REJECTED  TIMED OUT"
+      "  THROTTLED\n"
+  );
+
+  for (i = 0; i < count; ++i) {
+    const rtems_telnetd_statistics *st;
+
+    st = &stats[i];
+    printf(
+      "%5" PRIu16 " %6" PRIu16 " %7" PRIu16 " %10" PRIu32 " %10" PRIu32
+        " %10" PRIu32 " %10" PRIu32 " %10" PRIu32 "\n",
+      st->port,
+      st->sessions_active,
+      st->connections_pending,
+      st->connections_accepted,
+      st->connections_queued,
+      st->connections_rejected,
+      st->sessions_timed_out,
+      st->logins_throttled
+    );
+  }
+
+  free(stats);
+  return rtems_shell_telnetd_sessions();
+}
+
+rtems_shell_cmd_t rtems_shell_TELNETD_Command = {
+  "telnetd",
+  "telnetd",
+  "network",
+  rtems_shell_telnetd_command,
+  NULL,
+  NULL
+};
@@ -53,7 +53,9 @@
 #include "config.h"
 #endif
 
+#include <sys/param.h>
 #include <sys/queue.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -65,48 +67,259 @@
 #include <syslog.h>
 
 #include <rtems.h>
+#include <rtems/libio_.h>
 #include <rtems/pty.h>
 #include <rtems/shell.h>
 #include <rtems/telnetd.h>
 #include <rtems/thread.h>
 #include <rtems/userenv.h>
 
+#include "pty-internal.h"
+
+#ifdef RTEMS_NET_LWIP
+#define select lwip_select
+#endif
+
 #define TELNETD_EVENT_SUCCESS RTEMS_EVENT_0
 
 #define TELNETD_EVENT_ERROR RTEMS_EVENT_1
 
+/* Count of client addresses tracked by the login rate limit */
+#define TELNETD_LOGIN_PEERS 16
+
+/* Count of login attempts allowed in a burst by the login rate limit */
+#define TELNETD_LOGIN_BURST 3
+
 typedef struct telnetd_context telnetd_context;
 
+typedef enum {
+  TELNETD_SESSION_TASK_STARTING,
+  TELNETD_SESSION_TASK_READY,
+  TELNETD_SESSION_TASK_FAILED
+} telnetd_session_task_state;
+
 typedef struct telnetd_session {
-  rtems_pty_context            pty;
+  telnetd_pty                  pty;
   char                         peername[16];
   telnetd_context             *ctx;
   rtems_id                     task_id;
   LIST_ENTRY(telnetd_session)  link;
+
+  /* The PTY is installed, sessions are prepared on first use */
+  bool                         pty_ready;
+
+  /* Start up state of the session task, only used in thread mode */
+  telnetd_session_task_state   task_state;
+
+  /* The I/O task polls the socket, only used in multiplexed mode */
+  bool                         polling;
+
+  /* The session task runs, only used in multiplexed mode */
+  bool                         running;
 } telnetd_session;
 
+/* Login rate limit state of a client address */
+typedef struct {
+  char                         peername[16];
+
+  /* Theoretical arrival time of the next login attempt in clock ticks */
+  rtems_interval               tat;
+} telnetd_login_peer;
+
+/* A connection waiting for a free session */
+typedef struct {
+  int                          socket;
+  char                         peername[16];
+} telnetd_pending;
+
 struct telnetd_context {
   rtems_telnetd_config_table   config;
   int                          server_socket;
   rtems_id                     task_id;
+  rtems_id                     flush_task_id;
   rtems_mutex                  mtx;
+  uintptr_t                    pty_base;
+  rtems_interval               output_latency;
+  LIST_ENTRY(telnetd_context)  link;
   LIST_HEAD(, telnetd_session) free_sessions;
+  telnetd_pending             *pending;
+  uint16_t                     pending_head;
+  uint16_t                     pending_count;
+  uint32_t                     connections_accepted;
+  uint32_t                     connections_queued;
+  uint32_t                     connections_rejected;
+  uint32_t                     sessions_timed_out;
+  uint32_t                     logins_throttled;
+  rtems_interval               login_interval;
+  telnetd_login_peer           login_peers[TELNETD_LOGIN_PEERS];
+  fd_set                      *read_set;
+  fd_set                      *write_set;
+  size_t                       fd_set_size;
   telnetd_session              sessions[RTEMS_ZERO_LENGTH_ARRAY];
 };
 
+/*
+ * Protects the list of running Telnet servers and the PTY device numbers.
+ * Each Telnet server instance gets its own range of PTY device numbers.
+ */
+static rtems_mutex telnetd_mtx = RTEMS_MUTEX_INITIALIZER("Telnet");
+
+static uintptr_t telnetd_pty_next;
+
+static LIST_HEAD(, telnetd_context) telnetd_servers =
+  LIST_HEAD_INITIALIZER(telnetd_servers);
+
+static const char telnetd_busy_message[] =
+  "telnetd: too many connections, try again later\r\n";
+
 typedef union {
   struct sockaddr_in sin;
   struct sockaddr    sa;
 } telnetd_address;
 
+static void telnetd_session_task_started(
+  telnetd_session            *session,
+  telnetd_session_task_state  state
+)
+{
+  telnetd_context *ctx;
+
+  ctx = session->ctx;
+
+  rtems_mutex_lock(&ctx->mtx);
+  session->task_state = state;
+  rtems_mutex_unlock(&ctx->mtx);
+
+  (void)rtems_event_send(
+    ctx->task_id,
+    state == TELNETD_SESSION_TASK_READY ?
+      TELNETD_EVENT_SUCCESS : TELNETD_EVENT_ERROR
+  );
+}
+
 RTEMS_NO_RETURN static void telnetd_session_fatal_error(
-  const telnetd_context *ctx
+  telnetd_session *session
 )
 {
-  (void)rtems_event_send(ctx->task_id, TELNETD_EVENT_ERROR);
+  telnetd_session_task_started(session, TELNETD_SESSION_TASK_FAILED);
   rtems_task_exit();
 }
 
+static telnetd_session *telnetd_get_session_of_executing(void)
+{
+  telnetd_context *ctx;
+  rtems_id self;
+
+  self = rtems_task_self();
+  rtems_mutex_lock(&telnetd_mtx);
+
+  LIST_FOREACH(ctx, &telnetd_servers, link) {
+    uint16_t i;
+
+    for (i = 0; i < ctx->config.client_maximum; ++i) {
+      telnetd_session *session;
+
+      session = &ctx->sessions[i];
+
+      if (session->task_id == self) {
+        rtems_mutex_unlock(&telnetd_mtx);
+        return session;
+      }
+    }
+  }
+
+  rtems_mutex_unlock(&telnetd_mtx);
+  return NULL;
+}
+
+/*
+ * Uses the generic cell rate algorithm on the client address.  Each attempt
+ * moves the theoretical arrival time by the login interval.  An attempt is
+ * allowed if this time is less than the burst tolerance ahead of now.  If
+ * all addresses are in use, then the address with the earliest arrival time
+ * is replaced, which is the address closest to the end of its penalty.
+ */
+static bool telnetd_login_allowed(
+  telnetd_context *ctx,
+  const char      *peername
+)
+{
+  telnetd_login_peer *peer;
+  telnetd_login_peer *victim;
+  rtems_interval now;
+  rtems_interval tat;
+  bool allowed;
+  size_t i;
+
+  now = rtems_clock_get_ticks_since_boot();
+  peer = NULL;
+
+  rtems_mutex_lock(&ctx->mtx);
+  victim = &ctx->login_peers[0];
+
+  for (i = 0; i < TELNETD_LOGIN_PEERS; ++i) {
+    telnetd_login_peer *p;
+
+    p = &ctx->login_peers[i];
+
+    if (strcmp(p->peername, peername) == 0) {
+      peer = p;
+      break;
+    }
+
+    if ((int32_t) (p->tat - victim->tat) < 0) {
+      victim = p;
+    }
+  }
+
+  if (peer == NULL) {
+    peer = victim;
+    strlcpy(peer->peername, peername, sizeof(peer->peername));
+    peer->tat = now;
+  }
+
+  tat = peer->tat;
+
+  if ((int32_t) (tat - now) < 0) {
+    tat = now;
+  }
+
+  allowed = tat - now <= (TELNETD_LOGIN_BURST - 1) * ctx->login_interval;
+
+  if (allowed) {
+    peer->tat = tat + ctx->login_interval;
+  } else {
+    ++ctx->logins_throttled;
+  }
+
+  rtems_mutex_unlock(&ctx->mtx);
+  return allowed;
+}
+
+static bool telnetd_login_check(const char *user, const char *passphrase)
+{
+  telnetd_session *session;
+  telnetd_context *ctx;
+
+  session = telnetd_get_session_of_executing();
+  if (session == NULL) {
+    return false;
+  }
+
+  ctx = session->ctx;
+
+  if (!telnetd_login_allowed(ctx, session->peername)) {
+    syslog(
+      LOG_AUTHPRIV | LOG_WARNING,
+      "telnetd: too many login attempts from %s",
+      session->peername
+    );
+    return false;
+  }
+
+  return (*ctx->config.login_check)(user, passphrase);
+}
+
 static bool telnetd_login(telnetd_context *ctx, telnetd_session *session)
 {
   bool success;
@@ -118,8 +331,8 @@ static bool telnetd_login(telnetd_context *ctx, telnetd_session *session)
   success = rtems_shell_login_prompt(
     stdin,
     stderr,
-    session->pty.name,
-    ctx->config.login_check
+    session->pty.pty.name,
+    ctx->login_interval != 0 ? telnetd_login_check : ctx->config.login_check
   );
 
   if (!success) {
@@ -133,73 +346,458 @@ static bool telnetd_login(telnetd_context *ctx, telnetd_session *session)
   return success;
 }
 
-static void telnetd_session_task(rtems_task_argument arg)
+static bool telnetd_open_stdio(telnetd_session *session)
 {
   rtems_status_code sc;
-  telnetd_session *session;
-  telnetd_context *ctx;
   const char *path;
 
-  session = (telnetd_session *) arg;
-  ctx = session->ctx;
-
   sc = rtems_libio_set_private_env();
   if (sc != RTEMS_SUCCESSFUL) {
-    telnetd_session_fatal_error(ctx);
+    return false;
   }
 
-  path = rtems_pty_get_path(&session->pty);
+  path = rtems_pty_get_path(&session->pty.pty);
 
   stdin = fopen(path, "r+");
   if (stdin == NULL) {
-    telnetd_session_fatal_error(ctx);
+    return false;
   }
 
   stdout = fopen(path, "r+");
   if (stdout == NULL) {
-    telnetd_session_fatal_error(ctx);
+    return false;
+  }
+
+  stderr = fopen(path, "r+");
+  if (stderr == NULL) {
+    return false;
+  }
+
+  return true;
+}
+
+static void telnetd_serve(telnetd_context *ctx, telnetd_session *session)
+{
+  const char *path;
+
+  path = rtems_pty_get_path(&session->pty.pty);
+
+  syslog(
+    LOG_DAEMON | LOG_INFO,
+    "telnetd: accepted connection from %s on %s",
+    session->peername,
+    path
+  );
+
+  if (telnetd_login(ctx, session)) {
+    (*ctx->config.command)(session->pty.pty.name, ctx->config.arg);
+  }
+
+  if (session->pty.rx_timed_out) {
+    rtems_mutex_lock(&ctx->mtx);
+    ++ctx->sessions_timed_out;
+    rtems_mutex_unlock(&ctx->mtx);
+
+    syslog(
+      LOG_DAEMON | LOG_INFO,
+      "telnetd: idle timeout for connection from %s on %s",
+      session->peername,
+      path
+    );
+  }
+
+  syslog(
+    LOG_DAEMON | LOG_INFO,
+    "telnetd: releasing connection from %s on %s",
+    session->peername,
+    path
+  );
+
+  telnetd_pty_close_socket(&session->pty);
+}
+
+static void telnetd_format_peername(
+  char                  *peername,
+  size_t                 size,
+  const telnetd_address *peer
+)
+{
+  if (inet_ntop(AF_INET, &peer->sin.sin_addr, peername, size) == NULL) {
+    strlcpy(peername, "<UNKNOWN>", size);
+  }
+}
+
+/* Must be called with the context mutex locked */
+static bool telnetd_pop_pending(telnetd_context *ctx, telnetd_pending *pending)
+{
+  if (ctx->pending_count == 0) {
+    return false;
+  }
+
+  *pending = ctx->pending[ctx->pending_head];
+  ctx->pending_head = (uint16_t) ((ctx->pending_head + 1) %
+    ctx->config.accept_queue_size);
+  --ctx->pending_count;
+  return true;
+}
+
+/*
+ * Returns a free session for the new connection.  If no session is free,
+ * then the connection waits in the accept queue or is rejected if the queue
+ * is full.
+ */
+static telnetd_session *telnetd_dispatch_connection(
+  telnetd_context       *ctx,
+  int                    session_socket,
+  const telnetd_address *peer
+)
+{
+  telnetd_session *session;
+  telnetd_pending *pending;
+  uint16_t tail;
+
+  rtems_mutex_lock(&ctx->mtx);
+  ++ctx->connections_accepted;
+  session = LIST_FIRST(&ctx->free_sessions);
+
+  if (session != NULL) {
+    LIST_REMOVE(session, link);
+    rtems_mutex_unlock(&ctx->mtx);
+
+    telnetd_format_peername(session->peername, sizeof(session->peername), peer);
+    return session;
+  }
+
+  if (ctx->pending_count < ctx->config.accept_queue_size) {
+    tail = (uint16_t) ((ctx->pending_head + ctx->pending_count) %
+      ctx->config.accept_queue_size);
+    pending = &ctx->pending[tail];
+    pending->socket = session_socket;
+    telnetd_format_peername(pending->peername, sizeof(pending->peername), peer);
+    ++ctx->pending_count;
+    ++ctx->connections_queued;
+    rtems_mutex_unlock(&ctx->mtx);
+    return NULL;
+  }
+
+  ++ctx->connections_rejected;
+  rtems_mutex_unlock(&ctx->mtx);
+
+  /* The send buffer of a new connection is empty, so this does not block */
+  (void)write(session_socket, telnetd_busy_message,
+    sizeof(telnetd_busy_message) - 1);
+  (void)close(session_socket);
+  syslog(LOG_DAEMON | LOG_ERR, "telnetd: no free session available");
+  return NULL;
+}
+
+/*
+ * Returns the session to the free list.  If a connection waits in the accept
+ * queue, then the session is handed over to this connection instead and true
+ * is returned.
+ */
+static bool telnetd_release_session(
+  telnetd_context *ctx,
+  telnetd_session *session
+)
+{
+  telnetd_pending pending;
+
+  rtems_mutex_lock(&ctx->mtx);
+
+  if (!telnetd_pop_pending(ctx, &pending)) {
+    LIST_INSERT_HEAD(&ctx->free_sessions, session, link);
+    rtems_mutex_unlock(&ctx->mtx);
+    return false;
+  }
+
+  rtems_mutex_unlock(&ctx->mtx);
+
+  memcpy(session->peername, pending.peername, sizeof(session->peername));
+  telnetd_pty_set_socket(&session->pty, pending.socket);
+  return true;
+}
+
+static void telnetd_session_task(rtems_task_argument arg)
+{
+  telnetd_session *session;
+  telnetd_context *ctx;
+
+  session = (telnetd_session *) arg;
+  ctx = session->ctx;
+
+  if (!telnetd_open_stdio(session)) {
+    telnetd_session_fatal_error(session);
+  }
+
+  telnetd_session_task_started(session, TELNETD_SESSION_TASK_READY);
+
+  while (true) {
+    rtems_event_set events;
+
+    (void)rtems_event_system_receive(
+      RTEMS_EVENT_SYSTEM_SERVER,
+      RTEMS_WAIT | RTEMS_EVENT_ALL,
+      RTEMS_NO_TIMEOUT,
+      &events
+    );
+
+    do {
+      telnetd_serve(ctx, session);
+    } while (telnetd_release_session(ctx, session));
+  }
+}
+
+/*
+ * In multiplexed mode, the session task exists only while a client is
+ * connected.  The I/O task returns the session to the free list once the
+ * connection is closed and the session task is done.
+ */
+static void telnetd_mux_session_task(rtems_task_argument arg)
+{
+  telnetd_session *session;
+  telnetd_context *ctx;
+
+  session = (telnetd_session *) arg;
+  ctx = session->ctx;
+
+  if (telnetd_open_stdio(session)) {
+    telnetd_serve(ctx, session);
+  } else {
+    syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot initialize session task");
+    telnetd_pty_close_socket(&session->pty);
+  }
+
+  if (stdin != NULL) {
+    (void)fclose(stdin);
+  }
+
+  if (stdout != NULL) {
+    (void)fclose(stdout);
+  }
+
+  if (stderr != NULL) {
+    (void)fclose(stderr);
+  }
+
+  rtems_mutex_lock(&ctx->mtx);
+  session->running = false;
+  rtems_mutex_unlock(&ctx->mtx);
+
+  rtems_task_exit();
+}
+
+static bool telnetd_prepare_pty(telnetd_context *ctx, telnetd_session *session)
+{
+  const char *path;
+  uint16_t i;
+
+  if (session->pty_ready) {
+    return true;
+  }
+
+  i = (uint16_t) (session - ctx->sessions);
+  path = telnetd_pty_initialize(&session->pty, ctx->pty_base + i);
+  if (path == NULL) {
+    syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot create session PTY");
+    return false;
+  }
+
+  telnetd_pty_set_output(
+    &session->pty,
+    (unsigned char *) &ctx->sessions[ctx->config.client_maximum] +
+      i * ctx->config.output_buffer_size,
+    ctx->config.output_buffer_size,
+    ctx->output_latency,
+    ctx->config.output_overflow,
+    ctx->flush_task_id
+  );
+
+  if (ctx->config.multiplex_io) {
+    telnetd_pty_set_multiplexed(&session->pty);
+  }
+
+  telnetd_pty_set_idle_timeout(
+    &session->pty,
+    ctx->config.idle_timeout * rtems_clock_get_ticks_per_second()
+  );
+  telnetd_pty_set_linemode(&session->pty, ctx->config.linemode);
+  telnetd_pty_set_compression(&session->pty, ctx->config.compress);
+  telnetd_pty_set_echo_latency(&session->pty, ctx->config.echo_latency);
+
+  /* The flush task may look at the PTY from now on */
+  rtems_mutex_lock(&ctx->mtx);
+  session->pty_ready = true;
+  rtems_mutex_unlock(&ctx->mtx);
+  return true;
+}
+
+/*
+ * Starts the session task of the session in thread mode.  The caller must
+ * wait for the task with telnetd_wait_for_session_tasks().
+ */
+static bool telnetd_start_session_task(
+  telnetd_context *ctx,
+  telnetd_session *session
+)
+{
+  rtems_status_code sc;
+
+  if (ctx->config.multiplex_io || session->task_id != 0) {
+    return true;
+  }
+
+  sc = rtems_task_create(
+    rtems_build_name('T', 'N', 'T', 'a' + (session - ctx->sessions) % 26),
+    ctx->config.priority,
+    ctx->config.stack_size,
+    RTEMS_DEFAULT_MODES,
+    RTEMS_FLOATING_POINT,
+    &session->task_id
+  );
+  if (sc != RTEMS_SUCCESSFUL) {
+    syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot create session task");
+    session->task_id = 0;
+    return false;
+  }
+
+  session->task_state = TELNETD_SESSION_TASK_STARTING;
+
+  (void)rtems_task_start(
+    session->task_id,
+    telnetd_session_task,
+    (rtems_task_argument) session
+  );
+  return true;
+}
+
+/*
+ * The events of several session tasks may merge, so the task states are
+ * checked after each wake up.
+ */
+static bool telnetd_wait_for_session_tasks(
+  telnetd_context *ctx,
+  uint16_t         count
+)
+{
+  bool success;
+
+  success = true;
+
+  while (true) {
+    rtems_event_set events;
+    bool starting;
+    uint16_t i;
+
+    starting = false;
+    rtems_mutex_lock(&ctx->mtx);
+
+    for (i = 0; i < count; ++i) {
+      telnetd_session *session;
+
+      session = &ctx->sessions[i];
+
+      if (session->task_id == 0) {
+        continue;
+      }
+
+      if (session->task_state == TELNETD_SESSION_TASK_STARTING) {
+        starting = true;
+      } else if (session->task_state == TELNETD_SESSION_TASK_FAILED) {
+        /* The task deleted itself */
+        session->task_id = 0;
+        success = false;
+      }
+    }
+
+    rtems_mutex_unlock(&ctx->mtx);
+
+    if (!starting) {
+      break;
+    }
+
+    (void)rtems_event_receive(
+      TELNETD_EVENT_SUCCESS | TELNETD_EVENT_ERROR,
+      RTEMS_WAIT | RTEMS_EVENT_ANY,
+      RTEMS_NO_TIMEOUT,
+      &events
+    );
+  }
+
+  if (!success) {
+    syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot initialize session task");
+  }
+
+  return success;
+}
+
+static bool telnetd_prepare_session(
+  telnetd_context *ctx,
+  telnetd_session *session
+)
+{
+  if (!telnetd_prepare_pty(ctx, session)) {
+    return false;
   }
 
-  stderr = fopen(path, "r+");
-  if (stderr == NULL) {
-    telnetd_session_fatal_error(ctx);
+  if (!telnetd_start_session_task(ctx, session)) {
+    return false;
   }
 
-  (void)rtems_event_send(ctx->task_id, TELNETD_EVENT_SUCCESS);
+  return telnetd_wait_for_session_tasks(ctx, ctx->config.client_maximum);
+}
+
+/*
+ * Sends the output which waited for the flush latency.  The session tasks
+ * wake up this task with the TELNETD_PTY_FLUSH_EVENT if they leave output in
+ * the output buffer.
+ */
+static void telnetd_flush_task(rtems_task_argument arg)
+{
+  telnetd_context *ctx;
+  rtems_interval timeout;
+
+  ctx = (telnetd_context *) arg;
+  timeout = RTEMS_NO_TIMEOUT;
 
   while (true) {
     rtems_event_set events;
+    rtems_interval now;
+    uint16_t i;
 
-    (void)rtems_event_system_receive(
-      RTEMS_EVENT_SYSTEM_SERVER,
-      RTEMS_WAIT | RTEMS_EVENT_ALL,
-      RTEMS_NO_TIMEOUT,
+    (void)rtems_event_receive(
+      TELNETD_PTY_FLUSH_EVENT,
+      RTEMS_WAIT | RTEMS_EVENT_ANY,
+      timeout,
       &events
     );
 
-    syslog(
-      LOG_DAEMON | LOG_INFO,
-      "telnetd: accepted connection from %s on %s",
-      session->peername,
-      path
-    );
+    now = rtems_clock_get_ticks_since_boot();
+    timeout = RTEMS_NO_TIMEOUT;
 
-    if (telnetd_login(ctx, session)) {
-      (*ctx->config.command)(session->pty.name, ctx->config.arg);
-    }
+    for (i = 0; i < ctx->config.client_maximum; ++i) {
+      telnetd_session *session;
+      rtems_interval remaining;
+      bool ready;
 
-    syslog(
-      LOG_DAEMON | LOG_INFO,
-      "telnetd: releasing connection from %s on %s",
-      session->peername,
-      path
-    );
+      session = &ctx->sessions[i];
 
-    rtems_pty_close_socket(&session->pty);
+      rtems_mutex_lock(&ctx->mtx);
+      ready = session->pty_ready;
+      rtems_mutex_unlock(&ctx->mtx);
 
-    rtems_mutex_lock(&ctx->mtx);
-    LIST_INSERT_HEAD(&ctx->free_sessions, session, link);
-    rtems_mutex_unlock(&ctx->mtx);
+      if (!ready) {
+        continue;
+      }
+
+      remaining = telnetd_pty_flush_expired(&session->pty, now);
+      if (
+        remaining != 0
+          && (timeout == RTEMS_NO_TIMEOUT || remaining < timeout)
+      ) {
+        timeout = remaining;
+      }
+    }
   }
 }
 
@@ -229,35 +827,299 @@ static void telnetd_server_task(rtems_task_argument arg)
       continue;
     };
 
-    rtems_mutex_lock(&ctx->mtx);
-    session = LIST_FIRST(&ctx->free_sessions);
-
+    session = telnetd_dispatch_connection(ctx, session_socket, &peer);
     if (session == NULL) {
+      continue;
+    }
+
+    if (!telnetd_prepare_session(ctx, session)) {
+      rtems_mutex_lock(&ctx->mtx);
+      LIST_INSERT_HEAD(&ctx->free_sessions, session, link);
       rtems_mutex_unlock(&ctx->mtx);
 
       (void)close(session_socket);
-      syslog(LOG_DAEMON | LOG_ERR, "telnetd: no free session available");
       telnetd_sleep_after_error();
       continue;
     }
 
+    telnetd_pty_set_socket(&session->pty, session_socket);
+    (void)rtems_event_system_send(session->task_id, RTEMS_EVENT_SYSTEM_SERVER);
+  }
+}
+
+/* The peer name of the session must be set */
+static void telnetd_mux_start(
+  telnetd_context *ctx,
+  telnetd_session *session,
+  int              session_socket
+)
+{
+  rtems_status_code sc;
+
+  if (!telnetd_prepare_pty(ctx, session)) {
+    rtems_mutex_lock(&ctx->mtx);
+    LIST_INSERT_HEAD(&ctx->free_sessions, session, link);
+    rtems_mutex_unlock(&ctx->mtx);
+
+    (void)close(session_socket);
+    return;
+  }
+
+  telnetd_pty_set_socket(&session->pty, session_socket);
+
+  sc = rtems_task_create(
+    rtems_build_name('T', 'N', 'T', 'a' + (session - ctx->sessions) % 26),
+    ctx->config.priority,
+    ctx->config.stack_size,
+    RTEMS_DEFAULT_MODES,
+    RTEMS_FLOATING_POINT,
+    &session->task_id
+  );
+  if (sc != RTEMS_SUCCESSFUL) {
+    syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot create session task");
+    rtems_pty_close_socket(&session->pty.pty);
+    session->task_id = 0;
+
+    rtems_mutex_lock(&ctx->mtx);
+    LIST_INSERT_HEAD(&ctx->free_sessions, session, link);
+    rtems_mutex_unlock(&ctx->mtx);
+    return;
+  }
+
+  session->polling = true;
+  session->running = true;
+
+  (void)rtems_task_start(
+    session->task_id,
+    telnetd_mux_session_task,
+    (rtems_task_argument) session
+  );
+}
+
+static void telnetd_mux_accept(telnetd_context *ctx)
+{
+  telnetd_address peer;
+  socklen_t address_len;
+  int session_socket;
+  telnetd_session *session;
+
+  address_len = sizeof(peer.sin);
+  session_socket = accept(ctx->server_socket, &peer.sa, &address_len);
+  if (session_socket < 0) {
+    syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot accept session");
+    return;
+  }
+
+  session = telnetd_dispatch_connection(ctx, session_socket, &peer);
+  if (session != NULL) {
+    telnetd_mux_start(ctx, session, session_socket);
+  }
+}
+
+/* Hands out the released sessions to the connections in the accept queue */
+static void telnetd_mux_start_pending(telnetd_context *ctx)
+{
+  while (true) {
+    telnetd_session *session;
+    telnetd_pending pending;
+
+    rtems_mutex_lock(&ctx->mtx);
+    session = LIST_FIRST(&ctx->free_sessions);
+
+    if (session == NULL || !telnetd_pop_pending(ctx, &pending)) {
+      rtems_mutex_unlock(&ctx->mtx);
+      return;
+    }
+
     LIST_REMOVE(session, link);
     rtems_mutex_unlock(&ctx->mtx);
 
-    rtems_pty_set_socket(&session->pty, session_socket);
-
-    if (
-      inet_ntop(
-        AF_INET,
-        &peer.sin.sin_addr,
-        session->peername,
-        sizeof(session->peername)
-      ) == NULL
-    ) {
-      strlcpy(session->peername, "<UNKNOWN>", sizeof(session->peername));
+    memcpy(session->peername, pending.peername, sizeof(session->peername));
+    telnetd_mux_start(ctx, session, pending.socket);
+  }
+}
+
+static void telnetd_mux_release(telnetd_context *ctx, telnetd_session *session)
+{
+  rtems_pty_close_socket(&session->pty.pty);
+  session->task_id = 0;
+  LIST_INSERT_HEAD(&ctx->free_sessions, session, link);
+}
+
+/*
+ * In multiplexed mode, this task accepts new connections and services the
+ * sockets of all sessions.  Input is moved into the receive ring of the
+ * session PTY and pending output is sent once the socket is writable.
+ */
+/*
+ * Sends the output of the session which waited for the flush latency and
+ * lowers the wait time to the next flush deadline.  The I/O task cannot be
+ * woken up by an event while it waits in select().  A session task which does
+ * not wait for input may append output at any time, so the I/O task wakes up
+ * after the flush latency while the session is busy.
+ */
+static void telnetd_mux_flush_deadline(
+  telnetd_context *ctx,
+  telnetd_session *session,
+  rtems_interval   now,
+  rtems_interval  *wait
+)
+{
+  rtems_interval remaining;
+
+  remaining = telnetd_pty_flush_expired(&session->pty, now);
+
+  if (
+    remaining == 0
+      && ctx->output_latency != 0
+      && session->running
+      && !telnetd_pty_reader_waits(&session->pty)
+  ) {
+    remaining = ctx->output_latency;
+  }
+
+  if (remaining != 0 && (*wait == RTEMS_NO_TIMEOUT || remaining < *wait)) {
+    *wait = remaining;
+  }
+}
+
+static void telnetd_mux_task(rtems_task_argument arg)
+{
+  telnetd_context *ctx;
+
+  ctx = (telnetd_context *) arg;
+
+  while (true) {
+    struct timeval timeout;
+    rtems_interval now;
+    rtems_interval wait;
+    bool ring_full;
+    int nfds;
+    int rv;
+    uint16_t i;
+
+    rtems_mutex_lock(&ctx->mtx);
+
+    for (i = 0; i < ctx->config.client_maximum; ++i) {
+      telnetd_session *session;
+
+      session = &ctx->sessions[i];
+
+      /* The session task shut down the connection or the client closed it */
+      if (session->task_id != 0 && !session->running) {
+        session->polling = false;
+        telnetd_mux_release(ctx, session);
+      }
     }
 
-    (void)rtems_event_system_send(session->task_id, RTEMS_EVENT_SYSTEM_SERVER);
+    rtems_mutex_unlock(&ctx->mtx);
+
+    telnetd_mux_start_pending(ctx);
+
+    memset(ctx->read_set, 0, ctx->fd_set_size);
+    memset(ctx->write_set, 0, ctx->fd_set_size);
+    FD_SET(ctx->server_socket, ctx->read_set);
+    nfds = ctx->server_socket + 1;
+    ring_full = false;
+    now = rtems_clock_get_ticks_since_boot();
+    wait = RTEMS_NO_TIMEOUT;
+
+    rtems_mutex_lock(&ctx->mtx);
+
+    for (i = 0; i < ctx->config.client_maximum; ++i) {
+      telnetd_session *session;
+      int fd;
+
+      session = &ctx->sessions[i];
+
+      if (!session->polling) {
+        continue;
+      }
+
+      /* The shutdown makes the socket readable */
+      (void)telnetd_pty_check_idle(&session->pty);
+
+      telnetd_mux_flush_deadline(ctx, session, now, &wait);
+      fd = session->pty.pty.socket;
+
+      if (telnetd_pty_receive_space(&session->pty) > 0) {
+        FD_SET(fd, ctx->read_set);
+      } else {
+        ring_full = true;
+      }
+
+      if (telnetd_pty_output_pending(&session->pty)) {
+        FD_SET(fd, ctx->write_set);
+      }
+
+      nfds = MAX(nfds, fd + 1);
+    }
+
+    rtems_mutex_unlock(&ctx->mtx);
+
+    /*
+     * Closed sessions are released and idle timeouts are checked after the
+     * timeout.  Poll more often if some reader has to make room in its
+     * receive ring or if some output is due before.
+     */
+    if (ring_full) {
+      timeout.tv_sec = 0;
+      timeout.tv_usec = 10000;
+    } else if (wait != RTEMS_NO_TIMEOUT) {
+      uint64_t us;
+
+      us = (uint64_t) wait * rtems_configuration_get_microseconds_per_tick();
+      timeout.tv_sec = (time_t) (us / 1000000);
+      timeout.tv_usec = (suseconds_t) (us % 1000000);
+    } else {
+      timeout.tv_sec = 1;
+      timeout.tv_usec = 0;
+    }
+
+    rv = select(nfds, ctx->read_set, ctx->write_set, NULL, &timeout);
+    if (rv < 0) {
+      syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot wait for sessions");
+      telnetd_sleep_after_error();
+      continue;
+    }
+
+    if (rv == 0) {
+      continue;
+    }
+
+    for (i = 0; i < ctx->config.client_maximum; ++i) {
+      telnetd_session *session;
+      int fd;
+
+      session = &ctx->sessions[i];
+
+      if (!session->polling) {
+        continue;
+      }
+
+      fd = session->pty.pty.socket;
+
+      if (FD_ISSET(fd, ctx->write_set)) {
+        telnetd_pty_flush_output(&session->pty);
+      }
+
+      if (FD_ISSET(fd, ctx->read_set)) {
+        if (!telnetd_pty_receive(&session->pty)) {
+          rtems_mutex_lock(&ctx->mtx);
+          session->polling = false;
+
+          if (!session->running) {
+            telnetd_mux_release(ctx, session);
+          }
+
+          rtems_mutex_unlock(&ctx->mtx);
+        }
+      }
+    }
+
+    if (FD_ISSET(ctx->server_socket, ctx->read_set)) {
+      telnetd_mux_accept(ctx);
+    }
   }
 }
 
@@ -265,18 +1127,27 @@ static void telnetd_destroy_context(telnetd_context *ctx)
 {
   telnetd_session *session;
 
+  if (ctx->flush_task_id != 0) {
+    (void)rtems_task_delete(ctx->flush_task_id);
+  }
+
   LIST_FOREACH(session, &ctx->free_sessions, link) {
     if (session->task_id != 0) {
       (void)rtems_task_delete(session->task_id);
     }
 
-    (void)unlink(rtems_pty_get_path(&session->pty));
+    if (session->pty_ready) {
+      telnetd_pty_destroy(&session->pty);
+    }
   }
 
   if (ctx->server_socket >= 0) {
     (void)close(ctx->server_socket);
   }
 
+  free(ctx->pending);
+  free(ctx->read_set);
+  free(ctx->write_set);
   rtems_mutex_destroy(&ctx->mtx);
   free(ctx);
 }
@@ -320,59 +1191,63 @@ static rtems_status_code telnetd_create_server_socket(telnetd_context *ctx)
   return RTEMS_SUCCESSFUL;
 }
 
-static rtems_status_code telnetd_create_session_tasks(telnetd_context *ctx)
+/*
+ * Prepares the first client_prewarm sessions.  The other sessions are
+ * prepared on first use, so that the start up time does not depend on the
+ * maximum client count.
+ */
+static rtems_status_code telnetd_create_sessions(telnetd_context *ctx)
 {
   uint16_t i;
 
   ctx->task_id = rtems_task_self();
 
-  for (i = 0; i < ctx->config.client_maximum; ++i) {
+  ctx->output_latency =
+    RTEMS_MILLISECONDS_TO_TICKS(ctx->config.output_flush_latency);
+  if (ctx->output_latency == 0) {
+    ctx->output_latency = 1;
+  }
+
+  /* Without a flush task, the output is flushed before the session reads */
+  if (!ctx->config.multiplex_io && ctx->flush_task_id == 0) {
+    ctx->output_latency = 0;
+  }
+
+  rtems_mutex_lock(&telnetd_mtx);
+  ctx->pty_base = telnetd_pty_next;
+  telnetd_pty_next += ctx->config.client_maximum;
+  rtems_mutex_unlock(&telnetd_mtx);
+
+  /* Hand out the prepared sessions first */
+  for (i = ctx->config.client_maximum; i > 0; --i) {
     telnetd_session *session;
-    rtems_status_code sc;
-    const char *path;
-    rtems_event_set events;
 
-    session = &ctx->sessions[i];
+    session = &ctx->sessions[i - 1];
     session->ctx = ctx;
-    rtems_mutex_init(&ctx->mtx, "Telnet");
     LIST_INSERT_HEAD(&ctx->free_sessions, session, link);
+  }
 
-    sc = rtems_task_create(
-      rtems_build_name('T', 'N', 'T', 'a' + i % 26),
-      ctx->config.priority,
-      ctx->config.stack_size,
-      RTEMS_DEFAULT_MODES,
-      RTEMS_FLOATING_POINT,
-      &session->task_id
-    );
-    if (sc != RTEMS_SUCCESSFUL) {
-      syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot create session task");
-      return RTEMS_UNSATISFIED;
-    }
+  /* Start all session tasks before waiting for them */
+  for (i = 0; i < ctx->config.client_prewarm; ++i) {
+    telnetd_session *session;
 
-    path = rtems_pty_initialize(&session->pty, i);
-    if (path == NULL) {
-      syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot create session PTY");
-      return RTEMS_UNSATISFIED;
+    session = &ctx->sessions[i];
+
+    if (!telnetd_prepare_pty(ctx, session)) {
+      break;
     }
 
-    (void)rtems_task_start(
-      session->task_id,
-      telnetd_session_task,
-      (rtems_task_argument) session
-    );
+    if (!telnetd_start_session_task(ctx, session)) {
+      break;
+    }
+  }
 
-    (void)rtems_event_receive(
-      TELNETD_EVENT_SUCCESS | TELNETD_EVENT_ERROR,
-      RTEMS_WAIT | RTEMS_EVENT_ANY,
-      RTEMS_NO_TIMEOUT,
-      &events
-    );
+  if (!telnetd_wait_for_session_tasks(ctx, i)) {
+    return RTEMS_UNSATISFIED;
+  }
 
-    if ((events & TELNETD_EVENT_ERROR) != 0) {
-      syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot initialize session task");
-      return RTEMS_UNSATISFIED;
-    }
+  if (i < ctx->config.client_prewarm) {
+    return RTEMS_UNSATISFIED;
   }
 
   return RTEMS_SUCCESSFUL;
@@ -383,6 +1258,7 @@ rtems_status_code rtems_telnetd_start(const rtems_telnetd_config_table* config)
   telnetd_context *ctx;
   rtems_status_code sc;
   uint16_t client_maximum;
+  size_t output_buffer_size;
 
   if (config->command == NULL) {
     syslog(LOG_DAEMON | LOG_ERR, "telnetd: configuration with invalid command");
@@ -395,9 +1271,16 @@ rtems_status_code rtems_telnetd_start(const rtems_telnetd_config_table* config)
     client_maximum = config->client_maximum;
   }
 
+  if (config->output_buffer_size == 0) {
+    output_buffer_size = 1024;
+  } else {
+    output_buffer_size = config->output_buffer_size;
+  }
+
   ctx = calloc(
     1,
-    sizeof(*ctx) + client_maximum * sizeof(ctx->sessions[0])
+    sizeof(*ctx) +
+      client_maximum * (sizeof(ctx->sessions[0]) + output_buffer_size)
   );
   if (ctx == NULL) {
     syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot allocate server context");
@@ -406,9 +1289,26 @@ rtems_status_code rtems_telnetd_start(const rtems_telnetd_config_table* config)
 
   ctx->config = *config;
   ctx->config.client_maximum = client_maximum;
+  ctx->config.output_buffer_size = output_buffer_size;
   ctx->server_socket = -1;
+  rtems_mutex_init(&ctx->mtx, "Telnet");
   LIST_INIT(&ctx->free_sessions);
 
+  if (ctx->config.client_prewarm > client_maximum) {
+    ctx->config.client_prewarm = client_maximum;
+  }
+
+  if (ctx->config.accept_queue_size == 0) {
+    ctx->config.accept_queue_size = client_maximum;
+  }
+
+  ctx->pending = calloc(ctx->config.accept_queue_size, sizeof(*ctx->pending));
+  if (ctx->pending == NULL) {
+    syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot allocate accept queue");
+    telnetd_destroy_context(ctx);
+    return RTEMS_UNSATISFIED;
+  }
+
   /* Set priority */
   if (ctx->config.priority == 0) {
     ctx->config.priority = 100;
@@ -423,13 +1323,65 @@ rtems_status_code rtems_telnetd_start(const rtems_telnetd_config_table* config)
     ctx->config.port = 23;
   }
 
+  if (ctx->config.login_rate_limit != 0) {
+    ctx->login_interval = (60 * rtems_clock_get_ticks_per_second()) /
+      ctx->config.login_rate_limit;
+
+    if (ctx->login_interval == 0) {
+      ctx->login_interval = 1;
+    }
+  }
+
+  if (ctx->config.output_flush_latency == 0) {
+    ctx->config.output_flush_latency = 20;
+  }
+
   sc = telnetd_create_server_socket(ctx);
   if (sc != RTEMS_SUCCESSFUL) {
     telnetd_destroy_context(ctx);
     return sc;
   }
 
-  sc = telnetd_create_session_tasks(ctx);
+  if (ctx->config.multiplex_io) {
+    /* The descriptor sets must cover all file descriptors */
+    ctx->fd_set_size = howmany(rtems_libio_number_iops, sizeof(fd_mask) * 8) *
+      sizeof(fd_mask);
+    ctx->read_set = malloc(ctx->fd_set_size);
+    ctx->write_set = malloc(ctx->fd_set_size);
+    if (ctx->read_set == NULL || ctx->write_set == NULL) {
+      syslog(LOG_DAEMON | LOG_ERR, "telnetd: cannot allocate descriptor sets");
+      telnetd_destroy_context(ctx);
+      return RTEMS_UNSATISFIED;
+    }
+  }
+
+  /*
+   * In thread mode, the flush task sends the output after the flush latency.
+   * It compresses the output with the COMPRESS2 option, so it gets the stack
+   * of a session task.  In multiplexed mode, the I/O task does this.
+   */
+  if (!ctx->config.multiplex_io) {
+    sc = rtems_task_create(
+      rtems_build_name('T', 'N', 'T', 'F'),
+      ctx->config.priority,
+      ctx->config.stack_size,
+      RTEMS_DEFAULT_MODES,
+      RTEMS_FLOATING_POINT,
+      &ctx->flush_task_id
+    );
+    if (sc != RTEMS_SUCCESSFUL) {
+      syslog(LOG_DAEMON | LOG_WARNING, "telnetd: cannot create flush task");
+      ctx->flush_task_id = 0;
+    } else {
+      (void)rtems_task_start(
+        ctx->flush_task_id,
+        telnetd_flush_task,
+        (rtems_task_argument) ctx
+      );
+    }
+  }
+
+  sc = telnetd_create_sessions(ctx);
   if (sc != RTEMS_SUCCESSFUL) {
     telnetd_destroy_context(ctx);
     return sc;
@@ -438,7 +1390,8 @@ rtems_status_code rtems_telnetd_start(const rtems_telnetd_config_table* config)
   sc = rtems_task_create(
     rtems_build_name('T', 'N', 'T', 'D'),
     ctx->config.priority,
-    RTEMS_MINIMUM_STACK_SIZE,
+    ctx->config.multiplex_io ?
+      2 * RTEMS_MINIMUM_STACK_SIZE : RTEMS_MINIMUM_STACK_SIZE,
     RTEMS_DEFAULT_MODES,
     RTEMS_FLOATING_POINT,
     &ctx->task_id
@@ -451,13 +1404,108 @@ rtems_status_code rtems_telnetd_start(const rtems_telnetd_config_table* config)
 
   (void)rtems_task_start(
     ctx->task_id,
-    telnetd_server_task,
+    ctx->config.multiplex_io ? telnetd_mux_task : telnetd_server_task,
     (rtems_task_argument) ctx
   );
 
+  rtems_mutex_lock(&telnetd_mtx);
+  LIST_INSERT_HEAD(&telnetd_servers, ctx, link);
+  rtems_mutex_unlock(&telnetd_mtx);
+
   syslog(
     LOG_DAEMON | LOG_INFO,
     "telnetd: started successfully on port %" PRIu16, ctx->config.port
   );
   return RTEMS_SUCCESSFUL;
 }
+
+size_t rtems_telnetd_get_statistics(
+  rtems_telnetd_statistics *stats,
+  size_t                    count
+)
+{
+  telnetd_context *ctx;
+  size_t n;
+
+  n = 0;
+  rtems_mutex_lock(&telnetd_mtx);
+
+  LIST_FOREACH(ctx, &telnetd_servers, link) {
+    rtems_telnetd_statistics *st;
+    telnetd_session *session;
+    uint16_t free_sessions;
+
+    if (n >= count) {
+      ++n;
+      continue;
+    }
+
+    st = &stats[n];
+    ++n;
+    free_sessions = 0;
+
+    rtems_mutex_lock(&ctx->mtx);
+
+    LIST_FOREACH(session, &ctx->free_sessions, link) {
+      ++free_sessions;
+    }
+
+    st->port = ctx->config.port;
+    st->sessions_active = ctx->config.client_maximum - free_sessions;
+    st->connections_pending = ctx->pending_count;
+    st->connections_accepted = ctx->connections_accepted;
+    st->connections_queued = ctx->connections_queued;
+    st->connections_rejected = ctx->connections_rejected;
+    st->sessions_timed_out = ctx->sessions_timed_out;
+    st->logins_throttled = ctx->logins_throttled;
+    rtems_mutex_unlock(&ctx->mtx);
+  }
+
+  rtems_mutex_unlock(&telnetd_mtx);
+  return n;
+}
+
+size_t rtems_telnetd_get_session_statistics(
+  rtems_telnetd_session_statistics *stats,
+  size_t                            count
+)
+{
+  telnetd_context *ctx;
+  size_t n;
+
+  n = 0;
+  rtems_mutex_lock(&telnetd_mtx);
+
+  LIST_FOREACH(ctx, &telnetd_servers, link) {
+    uint16_t i;
+
+    for (i = 0; i < ctx->config.client_maximum; ++i) {
+      const telnetd_session *session;
+      rtems_telnetd_session_statistics *st;
+
+      session = &ctx->sessions[i];
+      if (!session->pty_ready) {
+        continue;
+      }
+
+      if (n >= count) {
+        ++n;
+        continue;
+      }
+
+      st = &stats[n];
+      ++n;
+
+      st->port = ctx->config.port;
+      st->session = i;
+      st->connected = (session->pty.pty.socket >= 0);
+      st->compressed = session->pty.tx_zactive;
+      memcpy(st->peername, session->peername, sizeof(st->peername));
+      st->peername[sizeof(st->peername) - 1] = '\0';
+      telnetd_pty_get_statistics(&session->pty, &st->connection, &st->total);
+    }
+  }
+
+  rtems_mutex_unlock(&telnetd_mtx);
+  return n;
+}
@@ -0,0 +1,1016 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/**
+ * @file
+ *
+ * @brief Host test and benchmark of the BSD program wrapper.
+ *
+ * See bsdprogram.doc for the build instructions.
+ */
+
+/*
+ * Copyright (C) 2026 The RTEMS Project
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RTEMS_BSD_PROGRAM_NO_ABORT_WRAP
+#define RTEMS_BSD_PROGRAM_NO_EXIT_WRAP
+#define RTEMS_BSD_PROGRAM_NO_ERROR_WRAP
+#define RTEMS_BSD_PROGRAM_NO_PRINTF_WRAP
+#define RTEMS_BSD_PROGRAM_NO_OPEN_WRAP
+#define RTEMS_BSD_PROGRAM_NO_SOCKET_WRAP
+#define RTEMS_BSD_PROGRAM_NO_CLOSE_WRAP
+#define RTEMS_BSD_PROGRAM_NO_FOPEN_WRAP
+#define RTEMS_BSD_PROGRAM_NO_FCLOSE_WRAP
+#define RTEMS_BSD_PROGRAM_NO_MALLOC_WRAP
+#define RTEMS_BSD_PROGRAM_NO_CALLOC_WRAP
+#define RTEMS_BSD_PROGRAM_NO_REALLOC_WRAP
+#define RTEMS_BSD_PROGRAM_NO_STRDUP_WRAP
+#define RTEMS_BSD_PROGRAM_NO_STRNDUP_WRAP
+#define RTEMS_BSD_PROGRAM_NO_VASPRINTF_WRAP
+#define RTEMS_BSD_PROGRAM_NO_ASPRINTF_WRAP
+#define RTEMS_BSD_PROGRAM_NO_FREE_WRAP
+#include <machine/rtems-bsd-program.h>
+
+#include "program-internal.h"
+
+#define BENCH_LIVE 10000
+
+#define BENCH_PAIRS 100000
+
+#define BENCH_MAX_SIZE 256
+
+#define BENCH_CALLS 10000
+
+#define BENCH_CALL_BLOCKS 200
+
+#define ARENA_CHUNK_SIZE 1024
+
+#define BENCH_OPEN_LIVE 200
+
+#define BENCH_OPEN_PAIRS 20000
+
+#define BENCH_OPEN_ROUNDS 10
+
+#define FD_CHECK_COUNT 40
+
+#define DATA_SIZE (64 * 1024)
+
+#define BENCH_DATA_CALLS 2000
+
+#ifndef PROGRAM_HOST_BENCH_ONLY
+/* Stand-in for the data section of a program */
+static unsigned char program_data[DATA_SIZE];
+
+static unsigned char program_data_copy[DATA_SIZE];
+#endif
+
+/* Stand-in for the configured number of file descriptors */
+const uint32_t rtems_libio_number_iops = 1024;
+
+/* Stand-in for the control of the executing thread in libbsd */
+static struct rtems_bsd_program_control *program_control;
+
+struct rtems_bsd_program_control *
+rtems_bsd_program_get_control_or_null(void)
+{
+  return program_control;
+}
+
+int
+rtems_bsd_program_set_control(struct rtems_bsd_program_control *prog_ctrl)
+{
+  program_control = prog_ctrl;
+  return 0;
+}
+
+static uint64_t program_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+#ifndef PROGRAM_HOST_BENCH_ONLY
+static size_t program_allocated_count(void)
+{
+  struct rtems_bsd_program_control *prog_ctrl;
+  struct program_allocmem_item *item;
+  size_t count;
+
+  prog_ctrl = rtems_bsd_program_get_control_or_null();
+  assert(prog_ctrl != NULL);
+  count = 0;
+
+  LIST_FOREACH(item, &prog_ctrl->allocated_mem, entries) {
+    ++count;
+  }
+
+  return count;
+}
+
+static void program_check_block(void *ptr, size_t size, unsigned char fill)
+{
+  const unsigned char *p;
+  size_t i;
+
+  assert(ptr != NULL);
+  assert(((uintptr_t) ptr % _Alignof(max_align_t)) == 0);
+  p = ptr;
+
+  for (i = 0; i < size; ++i) {
+    assert(p[i] == fill);
+  }
+}
+
+static int program_alloc(void *arg)
+{
+  void *blocks[64];
+  char *s;
+  size_t i;
+  int n;
+
+  (void) arg;
+
+  for (i = 0; i < 64; ++i) {
+    blocks[i] = rtems_bsd_program_malloc(i + 1);
+    program_check_block(blocks[i], 0, 0);
+    memset(blocks[i], (int) i, i + 1);
+  }
+
+  assert(program_allocated_count() == 64);
+
+  /* Grow and shrink, the contents must move along */
+  for (i = 0; i < 64; i += 2) {
+    blocks[i] = rtems_bsd_program_realloc(blocks[i], 4096 + i);
+    program_check_block(blocks[i], i + 1, (unsigned char) i);
+    blocks[i] = rtems_bsd_program_realloc(blocks[i], i + 1);
+    program_check_block(blocks[i], i + 1, (unsigned char) i);
+  }
+
+  assert(program_allocated_count() == 64);
+
+  /* Free from the middle, the end and the start of the list */
+  for (i = 16; i < 48; ++i) {
+    rtems_bsd_program_free(blocks[i]);
+    blocks[i] = NULL;
+  }
+
+  rtems_bsd_program_free(blocks[63]);
+  blocks[63] = NULL;
+  rtems_bsd_program_free(blocks[0]);
+  blocks[0] = NULL;
+  assert(program_allocated_count() == 30);
+
+  for (i = 0; i < 64; ++i) {
+    if (blocks[i] != NULL) {
+      program_check_block(blocks[i], i + 1, (unsigned char) i);
+    }
+  }
+
+  blocks[0] = rtems_bsd_program_calloc(100, 3);
+  program_check_block(blocks[0], 300, 0);
+  assert(rtems_bsd_program_calloc(SIZE_MAX, 1) == NULL);
+  assert(program_allocated_count() == 31);
+
+  s = rtems_bsd_program_strdup("ntpd");
+  assert(strcmp(s, "ntpd") == 0);
+  rtems_bsd_program_free(s);
+
+  s = rtems_bsd_program_strndup("ntpq -p", 4);
+  assert(strcmp(s, "ntpq") == 0);
+  rtems_bsd_program_free(s);
+
+  n = rtems_bsd_program_asprintf(&s, "%s %d", "peers", 7);
+  assert(n == 7);
+  assert(strcmp(s, "peers 7") == 0);
+  rtems_bsd_program_free(s);
+
+  s = rtems_bsd_program_reallocf(NULL, 10);
+  assert(s != NULL);
+  rtems_bsd_program_free(s);
+
+  /* Free of NULL is a no-op */
+  rtems_bsd_program_free(NULL);
+  assert(program_allocated_count() == 31);
+
+  /* The remaining blocks are released by rtems_bsd_program_call() */
+  return 7;
+}
+
+static int program_arena(void *arg)
+{
+  struct rtems_bsd_program_control *prog_ctrl;
+  struct program_arena_chunk *chunk;
+  void *blocks[64];
+  char *free_area;
+  char *p;
+  char *q;
+  char *big;
+  size_t i;
+
+  (void) arg;
+  prog_ctrl = rtems_bsd_program_get_control_or_null();
+  assert(prog_ctrl != NULL);
+  assert(prog_ctrl->arena_chunk_size == ARENA_CHUNK_SIZE);
+
+  for (i = 0; i < 64; ++i) {
+    blocks[i] = rtems_bsd_program_malloc(i + 1);
+    program_check_block(blocks[i], 0, 0);
+    memset(blocks[i], (int) i, i + 1);
+  }
+
+  /* Arena blocks are not tracked one by one */
+  assert(program_allocated_count() == 0);
+
+  for (i = 0; i < 64; ++i) {
+    program_check_block(blocks[i], i + 1, (unsigned char) i);
+  }
+
+  /* The last block grows and shrinks in place */
+  p = rtems_bsd_program_malloc(16);
+  memset(p, 'a', 16);
+  q = rtems_bsd_program_realloc(p, 64);
+  assert(q == p);
+  program_check_block(q, 16, 'a');
+  q = rtems_bsd_program_realloc(q, 8);
+  assert(q == p);
+
+  /* Freeing the last block gives its space back */
+  rtems_bsd_program_free(q);
+  q = rtems_bsd_program_malloc(32);
+  assert(q == p);
+
+  /* Other blocks move on growth and keep their contents */
+  p = rtems_bsd_program_realloc(blocks[10], 100);
+  assert(p != blocks[10]);
+  program_check_block(p, 11, 10);
+  rtems_bsd_program_free(p);
+
+  /* Large blocks get a chunk of their own */
+  big = rtems_bsd_program_malloc(4 * ARENA_CHUNK_SIZE);
+  program_check_block(big, 0, 0);
+  memset(big, 'b', 4 * ARENA_CHUNK_SIZE);
+  p = rtems_bsd_program_malloc(8);
+  program_check_block(p, 0, 0);
+  assert(p < big || p > big + 4 * ARENA_CHUNK_SIZE);
+  program_check_block(big, 4 * ARENA_CHUNK_SIZE, 'b');
+
+  /*
+   * So do blocks larger than a quarter chunk which do not fit into the first
+   * chunk, the first chunk is kept for the next blocks.
+   */
+  do {
+    chunk = prog_ctrl->arena;
+    free_area = chunk->free_area;
+    p = rtems_bsd_program_malloc(ARENA_CHUNK_SIZE / 2);
+    program_check_block(p, 0, 0);
+  } while (p > (char *) chunk && p < chunk->end);
+
+  assert(prog_ctrl->arena == chunk);
+  assert(chunk->free_area == free_area);
+
+  assert(rtems_bsd_program_malloc(SIZE_MAX) == NULL);
+  assert(rtems_bsd_program_calloc(SIZE_MAX, 1) == NULL);
+
+  p = rtems_bsd_program_strdup("ntpq");
+  assert(strcmp(p, "ntpq") == 0);
+  rtems_bsd_program_free(p);
+  rtems_bsd_program_free(NULL);
+
+  /* The chunks are released by rtems_bsd_program_call_with_arena() */
+  return 3;
+}
+
+static bool program_fd_is_open(int fd)
+{
+  return fcntl(fd, F_GETFD) != -1;
+}
+
+static int program_fds(void *arg)
+{
+  int *fds;
+  FILE *files[4];
+  size_t i;
+
+  fds = arg;
+
+  for (i = 0; i < FD_CHECK_COUNT; ++i) {
+    if (i % 4 == 0) {
+      fds[i] = rtems_bsd_program_socket(AF_INET, SOCK_DGRAM, 0);
+    } else {
+      fds[i] = rtems_bsd_program_open("/dev/null", O_RDONLY);
+    }
+
+    assert(fds[i] >= 0);
+  }
+
+  for (i = 0; i < 4; ++i) {
+    files[i] = rtems_bsd_program_fopen("/dev/null", "r");
+    assert(files[i] != NULL);
+  }
+
+  /* Close some descriptors and streams in no particular order */
+  for (i = 5; i < FD_CHECK_COUNT; i += 7) {
+    assert(rtems_bsd_program_close(fds[i]) == 0);
+    assert(!program_fd_is_open(fds[i]));
+    fds[i] = -1;
+  }
+
+  assert(rtems_bsd_program_fclose(files[2]) == 0);
+  files[2] = NULL;
+
+  /* Descriptors not opened by the program are left alone */
+  assert(rtems_bsd_program_close(STDIN_FILENO) == -1);
+  assert(program_fd_is_open(STDIN_FILENO));
+  assert(rtems_bsd_program_fclose(stdin) == EOF);
+  assert(rtems_bsd_program_close(-1) == -1);
+  assert(rtems_bsd_program_close(100000) == -1);
+
+  /* The descriptors of a stream belong to the stream */
+  assert(rtems_bsd_program_close(fileno(files[0])) == -1);
+
+  for (i = 0; i < 4; ++i) {
+    if (files[i] != NULL) {
+      fds[FD_CHECK_COUNT + i] = fileno(files[i]);
+    }
+  }
+
+  /* The remaining ones are closed by rtems_bsd_program_call() */
+  return 5;
+}
+
+static __attribute__((__noinline__)) void *program_site_a(size_t size)
+{
+  return rtems_bsd_program_malloc(size);
+}
+
+static __attribute__((__noinline__)) void *program_site_b(size_t size)
+{
+  return rtems_bsd_program_calloc(size, 2);
+}
+
+static const struct program_alloc_site *program_find_site(uint32_t count)
+{
+  struct rtems_bsd_program_control *prog_ctrl;
+  size_t i;
+
+  prog_ctrl = rtems_bsd_program_get_control_or_null();
+  assert(prog_ctrl != NULL);
+
+  for (i = 0; i < PROGRAM_ALLOC_SITES + 1; ++i) {
+    if (prog_ctrl->alloc_sites[i].count == count) {
+      return &prog_ctrl->alloc_sites[i];
+    }
+  }
+
+  return NULL;
+}
+
+/* Prints the statistics like the progstat command of the shell */
+static void *program_report(void *arg)
+{
+  int *n;
+
+  n = arg;
+  n[0] = rtems_bsd_program_print_statistics(stdout, "stats");
+  n[1] = rtems_bsd_program_print_statistics(stdout, "ntpd");
+  return NULL;
+}
+
+static int program_stats(void *arg)
+{
+  struct rtems_bsd_program_control *prog_ctrl;
+  const struct program_alloc_site *site;
+  void *a[5];
+  void *b[3];
+  FILE *file;
+  pthread_t thread;
+  char *s;
+  int fd;
+  int n[2];
+  int rv;
+  size_t i;
+
+  (void) arg;
+  prog_ctrl = rtems_bsd_program_get_control_or_null();
+  assert(prog_ctrl != NULL);
+
+  for (i = 0; i < 5; ++i) {
+    a[i] = program_site_a(100);
+    assert(a[i] != NULL);
+  }
+
+  for (i = 0; i < 3; ++i) {
+    b[i] = program_site_b(50);
+    assert(b[i] != NULL);
+  }
+
+  assert(prog_ctrl->mem_current == 800);
+  assert(prog_ctrl->mem_blocks == 8);
+
+  rtems_bsd_program_free(a[0]);
+  rtems_bsd_program_free(a[1]);
+  b[0] = rtems_bsd_program_realloc(b[0], 400);
+  assert(b[0] != NULL);
+
+  assert(prog_ctrl->mem_current == 600 - 100 + 400);
+  assert(prog_ctrl->mem_peak == 900);
+  assert(prog_ctrl->mem_blocks == 6);
+  assert(prog_ctrl->alloc_count == 9);
+  assert(prog_ctrl->free_count == 2);
+
+  /* The call sites keep their totals and live bytes */
+  site = program_find_site(5);
+  assert(site != NULL && site->caller != NULL);
+  assert(site->bytes == 500);
+  assert(site->live == 300);
+
+  site = program_find_site(3);
+  assert(site != NULL && site->caller != NULL);
+  assert(site->bytes == 300);
+  assert(site->live == 200);
+
+  site = program_find_site(1);
+  assert(site != NULL && site->bytes == 400 && site->live == 400);
+
+  fd = rtems_bsd_program_open("/dev/null", O_RDONLY);
+  assert(fd >= 0);
+  file = rtems_bsd_program_fopen("/dev/null", "r");
+  assert(file != NULL);
+  assert(prog_ctrl->fd_live == 1);
+  assert(prog_ctrl->file_live == 1);
+
+  /* The report of another thread sees this program */
+  rv = pthread_create(&thread, NULL, program_report, n);
+  assert(rv == 0);
+  rv = pthread_join(thread, NULL);
+  assert(rv == 0);
+  assert(n[0] == 1);
+  assert(n[1] == 0);
+
+  /* A descriptor number reused after a close outside of the wrapper */
+  assert(close(fd) == 0);
+  fd = rtems_bsd_program_open("/dev/null", O_RDONLY);
+  assert(fd >= 0);
+  assert(prog_ctrl->fd_live == 1);
+
+  assert(rtems_bsd_program_close(fd) == 0);
+  assert(rtems_bsd_program_fclose(file) == 0);
+  assert(prog_ctrl->fd_live == 0);
+  assert(prog_ctrl->file_live == 0);
+
+  s = rtems_bsd_program_strdup("ntpd");
+  assert(s != NULL);
+  rtems_bsd_program_free(s);
+  assert(prog_ctrl->mem_current == 900);
+  return 11;
+}
+
+static int program_stats_arena(void *arg)
+{
+  struct rtems_bsd_program_control *prog_ctrl;
+  const struct program_alloc_site *site;
+  void *a[5];
+  size_t i;
+
+  (void) arg;
+  prog_ctrl = rtems_bsd_program_get_control_or_null();
+  assert(prog_ctrl != NULL);
+
+  for (i = 0; i < 5; ++i) {
+    a[i] = program_site_a(100);
+    assert(a[i] != NULL);
+  }
+
+  rtems_bsd_program_free(a[4]);
+  a[0] = rtems_bsd_program_realloc(a[0], 300);
+  assert(a[0] != NULL);
+
+  assert(prog_ctrl->mem_current == 300 + 3 * 100);
+  assert(prog_ctrl->mem_peak == 600);
+  assert(prog_ctrl->mem_blocks == 4);
+  assert(prog_ctrl->free_count == 1);
+
+  site = program_find_site(5);
+  assert(site != NULL && site->bytes == 500 && site->live == 300);
+  return 13;
+}
+
+/* Writes a few variables, like a shell command which parses its options */
+static int program_data_main(int argc, char **argv)
+{
+  int i;
+
+  assert(argc == 2);
+  assert(strcmp(argv[0], "data") == 0);
+
+  for (i = 0; i < 8; ++i) {
+    program_data[(size_t) i * 4099 % DATA_SIZE] ^= 0xff;
+  }
+
+  program_data[DATA_SIZE - 1] = (unsigned char) atoi(argv[1]);
+  return 9;
+}
+
+static void program_check_data(void)
+{
+  struct rtems_bsd_program_data_snapshot snapshot;
+  char *argv[] = { "data", "42", NULL };
+  unsigned char expected[DATA_SIZE];
+  size_t i;
+  int exit_code;
+  int rv;
+
+  for (i = 0; i < DATA_SIZE; ++i) {
+    program_data[i] = (unsigned char) (i * 7);
+  }
+
+  memcpy(expected, program_data, DATA_SIZE);
+
+  /* A snapshot in an allocated buffer restores the data after each call */
+  rv = rtems_bsd_program_data_snapshot_init(
+    &snapshot,
+    program_data,
+    DATA_SIZE,
+    NULL
+  );
+  assert(rv == 0);
+
+  for (i = 0; i < 2; ++i) {
+    exit_code = rtems_bsd_program_call_main_with_data_snapshot(
+      "data",
+      program_data_main,
+      2,
+      argv,
+      &snapshot
+    );
+    assert(exit_code == 9);
+    assert(memcmp(program_data, expected, DATA_SIZE) == 0);
+  }
+
+  rtems_bsd_program_data_snapshot_destroy(&snapshot);
+
+  /* A snapshot in a buffer of the caller */
+  rv = rtems_bsd_program_data_snapshot_init(
+    &snapshot,
+    program_data,
+    DATA_SIZE,
+    program_data_copy
+  );
+  assert(rv == 0);
+  exit_code = rtems_bsd_program_call_main_with_data_snapshot(
+    "data",
+    program_data_main,
+    2,
+    argv,
+    &snapshot
+  );
+  assert(exit_code == 9);
+  assert(memcmp(program_data, expected, DATA_SIZE) == 0);
+  rtems_bsd_program_data_snapshot_destroy(&snapshot);
+
+  /* Data outside of the snapshot is left alone */
+  rv = rtems_bsd_program_data_snapshot_init(
+    &snapshot,
+    program_data,
+    DATA_SIZE - 1,
+    program_data_copy
+  );
+  assert(rv == 0);
+  exit_code = rtems_bsd_program_call_main_with_data_snapshot(
+    "data",
+    program_data_main,
+    2,
+    argv,
+    &snapshot
+  );
+  assert(exit_code == 9);
+  assert(program_data[DATA_SIZE - 1] == 42);
+  assert(memcmp(program_data, expected, DATA_SIZE - 1) == 0);
+  rtems_bsd_program_data_snapshot_destroy(&snapshot);
+}
+
+static void program_check(void)
+{
+  int fds[FD_CHECK_COUNT + 4];
+  size_t i;
+
+  int exit_code;
+
+  exit_code = rtems_bsd_program_call("alloc", program_alloc, NULL);
+  assert(exit_code == 7);
+  assert(rtems_bsd_program_get_control_or_null() == NULL);
+
+  exit_code = rtems_bsd_program_call_with_arena(
+    "arena",
+    program_arena,
+    NULL,
+    ARENA_CHUNK_SIZE
+  );
+  assert(exit_code == 3);
+  assert(rtems_bsd_program_get_control_or_null() == NULL);
+
+  for (i = 0; i < FD_CHECK_COUNT + 4; ++i) {
+    fds[i] = -1;
+  }
+
+  exit_code = rtems_bsd_program_call("fds", program_fds, fds);
+  assert(exit_code == 5);
+
+  for (i = 0; i < FD_CHECK_COUNT + 4; ++i) {
+    if (fds[i] >= 0) {
+      assert(!program_fd_is_open(fds[i]));
+    }
+  }
+
+  assert(program_fd_is_open(STDIN_FILENO));
+
+  program_check_data();
+
+  exit_code = rtems_bsd_program_call("stats", program_stats, NULL);
+  assert(exit_code == 11);
+  assert(rtems_bsd_program_print_statistics(stdout, NULL) == 0);
+
+  exit_code = rtems_bsd_program_call_with_arena(
+    "stats",
+    program_stats_arena,
+    NULL,
+    0
+  );
+  assert(exit_code == 13);
+
+  /* Outside of a program there is nothing to allocate */
+  assert(rtems_bsd_program_malloc(1) == NULL);
+  rtems_bsd_program_free(NULL);
+}
+#endif /* PROGRAM_HOST_BENCH_ONLY */
+
+static size_t bench_size(void)
+{
+  return 1 + (size_t) rand() % BENCH_MAX_SIZE;
+}
+
+/*
+ * Replaces random blocks of the live set, like a long running ntpd which
+ * frees MRU entries and receive buffers in no particular order.
+ */
+static int program_bench(void *arg)
+{
+  void **live;
+  uint64_t t0;
+  uint64_t t1;
+  size_t i;
+
+  live = arg;
+
+  for (i = 0; i < BENCH_LIVE; ++i) {
+    live[i] = rtems_bsd_program_malloc(bench_size());
+    assert(live[i] != NULL);
+  }
+
+  t0 = program_now();
+
+  for (i = 0; i < BENCH_PAIRS; ++i) {
+    size_t j;
+
+    j = (size_t) rand() % BENCH_LIVE;
+    rtems_bsd_program_free(live[j]);
+    live[j] = rtems_bsd_program_malloc(bench_size());
+    assert(live[j] != NULL);
+  }
+
+  t1 = program_now();
+
+  printf(
+    "bench: %d live blocks, %.1f ns per program malloc/free pair\n",
+    BENCH_LIVE,
+    (double) (t1 - t0) / BENCH_PAIRS
+  );
+  return 0;
+}
+
+static void heap_bench(void **live)
+{
+  uint64_t t0;
+  uint64_t t1;
+  size_t i;
+
+  for (i = 0; i < BENCH_LIVE; ++i) {
+    live[i] = malloc(bench_size());
+    assert(live[i] != NULL);
+  }
+
+  t0 = program_now();
+
+  for (i = 0; i < BENCH_PAIRS; ++i) {
+    size_t j;
+
+    j = (size_t) rand() % BENCH_LIVE;
+    free(live[j]);
+    live[j] = malloc(bench_size());
+    assert(live[j] != NULL);
+  }
+
+  t1 = program_now();
+
+  for (i = 0; i < BENCH_LIVE; ++i) {
+    free(live[i]);
+  }
+
+  printf(
+    "bench: %d live blocks, %.1f ns per heap malloc/free pair\n",
+    BENCH_LIVE,
+    (double) (t1 - t0) / BENCH_PAIRS
+  );
+}
+
+/*
+ * Reopens random descriptors of the live set, like ntpd which opens and
+ * closes sockets during the interface rescans.
+ */
+static uint64_t open_pairs(
+  int *fds,
+  const unsigned short *slots,
+  size_t count,
+  bool wrapped
+)
+{
+  uint64_t t0;
+  size_t i;
+
+  for (i = 0; i < BENCH_OPEN_LIVE; ++i) {
+    if (wrapped) {
+      fds[i] = rtems_bsd_program_open("/dev/null", O_RDONLY);
+    } else {
+      fds[i] = open("/dev/null", O_RDONLY);
+    }
+
+    assert(fds[i] >= 0);
+  }
+
+  t0 = program_now();
+
+  for (i = 0; i < count; ++i) {
+    size_t j;
+    int rv;
+
+    j = slots[i];
+
+    if (wrapped) {
+      rv = rtems_bsd_program_close(fds[j]);
+      assert(rv == 0);
+      fds[j] = rtems_bsd_program_open("/dev/null", O_RDONLY);
+    } else {
+      rv = close(fds[j]);
+      assert(rv == 0);
+      fds[j] = open("/dev/null", O_RDONLY);
+    }
+
+    assert(fds[j] >= 0);
+  }
+
+  t0 = program_now() - t0;
+
+  for (i = 0; i < BENCH_OPEN_LIVE; ++i) {
+    int rv;
+
+    if (wrapped) {
+      rv = rtems_bsd_program_close(fds[i]);
+    } else {
+      rv = close(fds[i]);
+    }
+
+    assert(rv == 0);
+  }
+
+  return t0;
+}
+
+/*
+ * The program and the plain system calls replace the same descriptors in the
+ * same random order.  They take turns, so that a drift of the system call
+ * times hits both.
+ */
+static int program_open_bench(void *arg)
+{
+  static unsigned short slots[BENCH_OPEN_PAIRS];
+  int fds[BENCH_OPEN_LIVE];
+  uint64_t t_prog;
+  uint64_t t_sys;
+  size_t count;
+  size_t i;
+
+  (void) arg;
+
+  for (i = 0; i < BENCH_OPEN_PAIRS; ++i) {
+    slots[i] = (unsigned short) ((size_t) rand() % BENCH_OPEN_LIVE);
+  }
+
+  count = BENCH_OPEN_PAIRS / BENCH_OPEN_ROUNDS;
+  t_prog = 0;
+  t_sys = 0;
+
+  for (i = 0; i < BENCH_OPEN_ROUNDS; ++i) {
+    t_sys += open_pairs(fds, &slots[i * count], count, false);
+    t_prog += open_pairs(fds, &slots[i * count], count, true);
+  }
+
+  count *= BENCH_OPEN_ROUNDS;
+  printf(
+    "bench: %d open descriptors, %.1f ns per program open/close pair, "
+    "%.1f ns without the program\n",
+    BENCH_OPEN_LIVE,
+    (double) t_prog / count,
+    (double) t_sys / count
+  );
+  return 0;
+}
+
+#ifndef PROGRAM_HOST_BENCH_ONLY
+/* A short program, like an ntpq query, which leaves its blocks behind */
+static int program_short(void *arg)
+{
+  size_t i;
+
+  (void) arg;
+
+  for (i = 0; i < BENCH_CALL_BLOCKS; ++i) {
+    char *p;
+
+    p = rtems_bsd_program_malloc(bench_size());
+    assert(p != NULL);
+    *p = 0;
+  }
+
+  return 0;
+}
+
+static void call_bench(const char *what, size_t chunk_size)
+{
+  uint64_t t0;
+  uint64_t t1;
+  size_t i;
+
+  t0 = program_now();
+
+  for (i = 0; i < BENCH_CALLS; ++i) {
+    int exit_code;
+
+    if (chunk_size == 0) {
+      exit_code = rtems_bsd_program_call("short", program_short, NULL);
+    } else {
+      exit_code = rtems_bsd_program_call_with_arena(
+        "short",
+        program_short,
+        NULL,
+        chunk_size
+      );
+    }
+
+    assert(exit_code == 0);
+  }
+
+  t1 = program_now();
+
+  printf(
+    "bench: %d blocks, %.1f ns per program call with %s\n",
+    BENCH_CALL_BLOCKS,
+    (double) (t1 - t0) / BENCH_CALLS,
+    what
+  );
+}
+
+static void data_bench(const char *what, bool snapshot_restore)
+{
+  struct rtems_bsd_program_data_snapshot snapshot;
+  char *argv[] = { "data", "42", NULL };
+  uint64_t t0;
+  uint64_t t1;
+  size_t i;
+  int rv;
+
+  rv = rtems_bsd_program_data_snapshot_init(
+    &snapshot,
+    program_data,
+    DATA_SIZE,
+    program_data_copy
+  );
+  assert(rv == 0);
+  t0 = program_now();
+
+  for (i = 0; i < BENCH_DATA_CALLS; ++i) {
+    int exit_code;
+
+    if (snapshot_restore) {
+      exit_code = rtems_bsd_program_call_main_with_data_snapshot(
+        "data",
+        program_data_main,
+        2,
+        argv,
+        &snapshot
+      );
+    } else {
+      exit_code = rtems_bsd_program_call_main_with_data_restore(
+        "data",
+        program_data_main,
+        2,
+        argv,
+        program_data,
+        DATA_SIZE
+      );
+    }
+
+    assert(exit_code == 9);
+  }
+
+  t1 = program_now();
+  rtems_bsd_program_data_snapshot_destroy(&snapshot);
+
+  printf(
+    "bench: %d bytes of data, %.1f ns per program call with %s\n",
+    DATA_SIZE,
+    (double) (t1 - t0) / BENCH_DATA_CALLS,
+    what
+  );
+}
+#endif /* PROGRAM_HOST_BENCH_ONLY */
+
+int main(void)
+{
+  void **live;
+  int exit_code;
+
+  printf("*** BEGIN OF TEST BSD PROGRAM ***\n");
+
+#ifndef PROGRAM_HOST_BENCH_ONLY
+  program_check();
+#endif
+
+  live = malloc(BENCH_LIVE * sizeof(*live));
+  assert(live != NULL);
+
+  srand(1);
+  heap_bench(live);
+
+  srand(1);
+  exit_code = rtems_bsd_program_call("bench", program_bench, live);
+  assert(exit_code == 0);
+
+  free(live);
+
+  srand(1);
+  exit_code = rtems_bsd_program_call("open", program_open_bench, NULL);
+  assert(exit_code == 0);
+
+#ifndef PROGRAM_HOST_BENCH_ONLY
+  srand(1);
+  call_bench("tracked blocks", 0);
+
+  srand(1);
+  call_bench("an arena", PROGRAM_ARENA_DEFAULT_CHUNK_SIZE);
+
+  data_bench("a data restore", false);
+  data_bench("a snapshot restore", true);
+#endif
+
+  printf("*** END OF TEST BSD PROGRAM ***\n");
+  return 0;
+}
@@ -0,0 +1,1191 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/**
+ * @file
+ *
+ * @brief Telnet server performance measurements over the loopback interface.
+ */
+
+/*
+ * Copyright (C) 2026 The RTEMS Project
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <rtems.h>
+#include <rtems/malloc.h>
+#include <rtems/pty.h>
+#include <rtems/shell.h>
+#include <rtems/telnetd.h>
+
+#include <net_adapter.h>
+#include <net_adapter_extra.h>
+
+#include <tmacros.h>
+
+#include "pty-internal.h"
+#include "pty-nvt.h"
+
+const char rtems_test_name[] = "TELNETD 2";
+
+#define BENCH_PORT 2323
+
+#define BENCH_PASTE_SIZE 4096
+
+#define BENCH_EVENT_DONE RTEMS_EVENT_0
+
+#define BENCH_SESSIONS 8
+
+#define BENCH_CONNECTIONS 4
+
+#define BENCH_OUTPUT_LINES 512
+
+#define BENCH_OVERFLOW_ROUNDS 16
+
+typedef struct {
+  int      client;
+  int      server;
+  rtems_id reader;
+} bench_connection;
+
+static char bench_paste[BENCH_PASTE_SIZE];
+
+static char bench_input[BENCH_PASTE_SIZE];
+
+static rtems_pty_context bench_legacy_pty;
+
+static telnetd_pty bench_buffered_pty;
+
+static telnetd_pty bench_compress_pty;
+
+static unsigned char bench_compress_buf[1024];
+
+static telnetd_pty bench_overflow_pty;
+
+static unsigned char bench_overflow_buf[1024];
+
+static char bench_output[BENCH_OUTPUT_LINES * 80];
+
+static char bench_inflated[sizeof(bench_output)];
+
+typedef struct {
+  int      fd;
+  rtems_id waiter;
+  size_t   wire;
+  size_t   inflated;
+} bench_compress_client;
+
+typedef struct {
+  int            fd;
+  rtems_id       waiter;
+  rtems_interval delay;
+  size_t         received;
+} bench_drain_client;
+
+static void bench_connect(bench_connection *bc)
+{
+  struct sockaddr_in addr;
+  socklen_t addr_len;
+  int listener;
+  int enable;
+  int rv;
+
+  listener = socket(PF_INET, SOCK_STREAM, 0);
+  rtems_test_assert(listener >= 0);
+
+  enable = 1;
+  rv = setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  rtems_test_assert(rv == 0);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(BENCH_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  rv = bind(listener, (struct sockaddr *) &addr, sizeof(addr));
+  rtems_test_assert(rv == 0);
+
+  rv = listen(listener, 1);
+  rtems_test_assert(rv == 0);
+
+  bc->client = socket(PF_INET, SOCK_STREAM, 0);
+  rtems_test_assert(bc->client >= 0);
+
+  rv = connect(bc->client, (struct sockaddr *) &addr, sizeof(addr));
+  rtems_test_assert(rv == 0);
+
+  addr_len = sizeof(addr);
+  bc->server = accept(listener, (struct sockaddr *) &addr, &addr_len);
+  rtems_test_assert(bc->server >= 0);
+
+  rv = close(listener);
+  rtems_test_assert(rv == 0);
+}
+
+static void bench_sender_task(rtems_task_argument arg)
+{
+  bench_connection *bc;
+  size_t done;
+
+  bc = (bench_connection *) arg;
+  done = 0;
+
+  while (done < sizeof(bench_paste)) {
+    ssize_t n;
+
+    n = write(bc->client, &bench_paste[done], sizeof(bench_paste) - done);
+    rtems_test_assert(n > 0);
+    done += (size_t) n;
+  }
+
+  (void) rtems_event_send(bc->reader, BENCH_EVENT_DONE);
+  rtems_task_exit();
+}
+
+static uint64_t bench_paste_into(const char *path, bench_connection *bc)
+{
+  struct termios term;
+  rtems_status_code sc;
+  rtems_event_set events;
+  rtems_id sender;
+  uint64_t t0;
+  uint64_t t1;
+  size_t done;
+  int fd;
+  int rv;
+
+  fd = open(path, O_RDWR);
+  rtems_test_assert(fd >= 0);
+
+  rv = tcgetattr(fd, &term);
+  rtems_test_assert(rv == 0);
+  cfmakeraw(&term);
+  rv = tcsetattr(fd, TCSANOW, &term);
+  rtems_test_assert(rv == 0);
+
+  sc = rtems_task_create(
+    rtems_build_name('B', 'S', 'N', 'D'),
+    1,
+    RTEMS_MINIMUM_STACK_SIZE,
+    RTEMS_DEFAULT_MODES,
+    RTEMS_DEFAULT_ATTRIBUTES,
+    &sender
+  );
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+
+  bc->reader = rtems_task_self();
+  t0 = rtems_clock_get_uptime_nanoseconds();
+
+  sc = rtems_task_start(sender, bench_sender_task, (rtems_task_argument) bc);
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+
+  done = 0;
+  while (done < sizeof(bench_input)) {
+    ssize_t n;
+
+    n = read(fd, &bench_input[done], sizeof(bench_input) - done);
+    rtems_test_assert(n > 0);
+    done += (size_t) n;
+  }
+
+  t1 = rtems_clock_get_uptime_nanoseconds();
+
+  sc = rtems_event_receive(
+    BENCH_EVENT_DONE,
+    RTEMS_WAIT | RTEMS_EVENT_ALL,
+    RTEMS_NO_TIMEOUT,
+    &events
+  );
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+  rtems_test_assert(memcmp(bench_input, bench_paste, sizeof(bench_paste)) == 0);
+
+  rv = close(fd);
+  rtems_test_assert(rv == 0);
+
+  return t1 - t0;
+}
+
+static void bench_receive_legacy(void)
+{
+  bench_connection bc;
+  const char *path;
+  uint64_t ns;
+
+  path = rtems_pty_initialize(&bench_legacy_pty, 100);
+  rtems_test_assert(path != NULL);
+
+  bench_connect(&bc);
+  rtems_pty_set_socket(&bench_legacy_pty, bc.server);
+  ns = bench_paste_into(path, &bc);
+  rtems_pty_close_socket(&bench_legacy_pty);
+  (void) close(bc.client);
+  (void) unlink(path);
+
+  /* The legacy handler issues exactly one read() per input byte */
+  printf(
+    "receive legacy:   %i bytes, %i read() calls, 1.000 calls/byte, "
+    "%" PRIu64 " us\n",
+    BENCH_PASTE_SIZE,
+    BENCH_PASTE_SIZE,
+    ns / 1000
+  );
+}
+
+static void bench_receive_buffered(void)
+{
+  bench_connection bc;
+  const char *path;
+  uint64_t ns;
+
+  path = telnetd_pty_initialize(&bench_buffered_pty, 101);
+  rtems_test_assert(path != NULL);
+
+  bench_connect(&bc);
+  telnetd_pty_set_socket(&bench_buffered_pty, bc.server);
+  ns = bench_paste_into(path, &bc);
+  rtems_pty_close_socket(&bench_buffered_pty.pty);
+  (void) close(bc.client);
+  (void) unlink(path);
+
+  printf(
+    "receive buffered: %" PRIu32 " bytes, %" PRIu32 " read() calls, "
+    "%.3f calls/byte, %" PRIu64 " us\n",
+    bench_buffered_pty.rx_bytes,
+    bench_buffered_pty.rx_syscalls,
+    (double) bench_buffered_pty.rx_syscalls /
+      (double) bench_buffered_pty.rx_bytes,
+    ns / 1000
+  );
+}
+
+static void bench_read_exact(int fd, const unsigned char *expected, size_t len)
+{
+  unsigned char buf[8];
+  size_t done;
+
+  rtems_test_assert(len <= sizeof(buf));
+  done = 0;
+
+  while (done < len) {
+    ssize_t n;
+
+    n = read(fd, &buf[done], len - done);
+    rtems_test_assert(n > 0);
+    done += (size_t) n;
+  }
+
+  rtems_test_assert(memcmp(buf, expected, len) == 0);
+}
+
+/* Acts as a MCCP2 capable client and inflates the output of the session */
+static void bench_compress_client_task(rtems_task_argument arg)
+{
+  static const unsigned char offer[] = {
+    IAC_ESC, IAC_WILL, TELOPT_ECHO, IAC_ESC, IAC_WILL, TELOPT_COMPRESS2
+  };
+  static const unsigned char accept[] = {
+    IAC_ESC, IAC_DO, TELOPT_COMPRESS2, 'x'
+  };
+  static const unsigned char start[] = {
+    IAC_ESC, IAC_SB, TELOPT_COMPRESS2, IAC_ESC, IAC_SE
+  };
+  bench_compress_client *client;
+  unsigned char buf[512];
+  z_stream z;
+  ssize_t n;
+  int rv;
+
+  client = (bench_compress_client *) arg;
+
+  bench_read_exact(client->fd, offer, sizeof(offer));
+  n = write(client->fd, accept, sizeof(accept));
+  rtems_test_assert(n == (ssize_t) sizeof(accept));
+  bench_read_exact(client->fd, start, sizeof(start));
+
+  memset(&z, 0, sizeof(z));
+  rv = inflateInit(&z);
+  rtems_test_assert(rv == Z_OK);
+  z.next_out = (Bytef *) bench_inflated;
+  z.avail_out = sizeof(bench_inflated);
+
+  while ((n = read(client->fd, buf, sizeof(buf))) > 0) {
+    client->wire += (size_t) n;
+    z.next_in = buf;
+    z.avail_in = (uInt) n;
+    rv = inflate(&z, Z_SYNC_FLUSH);
+    rtems_test_assert(rv == Z_OK || rv == Z_BUF_ERROR);
+    rtems_test_assert(z.avail_in == 0);
+  }
+
+  client->inflated = sizeof(bench_inflated) - z.avail_out;
+  (void) inflateEnd(&z);
+
+  (void) rtems_event_send(client->waiter, BENCH_EVENT_DONE);
+  rtems_task_exit();
+}
+
+/*
+ * Writes a peer list like the one of ntpq line by line through a compressed
+ * session and checks what the client inflates.
+ */
+static void bench_compress(void)
+{
+  rtems_telnetd_io_statistics connection;
+  rtems_telnetd_io_statistics total;
+  bench_compress_client client;
+  uint32_t echoes;
+  bench_connection bc;
+  struct termios term;
+  rtems_status_code sc;
+  rtems_event_set events;
+  rtems_id task;
+  const char *path;
+  uint64_t t0;
+  uint64_t t1;
+  size_t done;
+  char c;
+  int fd;
+  int rv;
+
+  for (done = 0; done < BENCH_OUTPUT_LINES; ++done) {
+    char *line;
+
+    line = &bench_output[done * 80];
+    rv = snprintf(
+      line,
+      79,
+      "%c192.168.%3u.%-3u %-15s %2u u %4u %4u  377 %7u.%03u %+7d.%03u %5u.%03u",
+      done % 7 == 0 ? '*' : '+',
+      (unsigned) (done / 250) % 256,
+      (unsigned) done % 250,
+      done % 3 == 0 ? ".GPS." : "10.0.0.1",
+      (unsigned) (done % 3 + 1),
+      (unsigned) (done * 7 % 1024),
+      64U << (done % 5),
+      (unsigned) (done % 97),
+      (unsigned) (done * 13 % 1000),
+      (int) (done % 11) - 5,
+      (unsigned) (done * 17 % 1000),
+      (unsigned) (done % 5),
+      (unsigned) (done * 19 % 1000)
+    );
+    rtems_test_assert(rv > 0 && rv <= 78);
+    memset(&line[rv], ' ', (size_t) (78 - rv));
+    line[78] = '\r';
+    line[79] = '\n';
+  }
+
+  path = telnetd_pty_initialize(&bench_compress_pty, 102);
+  rtems_test_assert(path != NULL);
+
+  telnetd_pty_set_output(
+    &bench_compress_pty,
+    bench_compress_buf,
+    sizeof(bench_compress_buf),
+    0,
+    RTEMS_TELNETD_OVERFLOW_BLOCK,
+    0
+  );
+  telnetd_pty_set_compression(&bench_compress_pty, true);
+  telnetd_pty_set_echo_latency(&bench_compress_pty, true);
+
+  bench_connect(&bc);
+  memset(&client, 0, sizeof(client));
+  client.fd = bc.client;
+  client.waiter = rtems_task_self();
+  telnetd_pty_set_socket(&bench_compress_pty, bc.server);
+
+  sc = rtems_task_create(
+    rtems_build_name('B', 'Z', 'I', 'P'),
+    1,
+    RTEMS_MINIMUM_STACK_SIZE + 16 * 1024,
+    RTEMS_DEFAULT_MODES,
+    RTEMS_DEFAULT_ATTRIBUTES,
+    &task
+  );
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+  sc = rtems_task_start(
+    task,
+    bench_compress_client_task,
+    (rtems_task_argument) &client
+  );
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+
+  fd = open(path, O_RDWR);
+  rtems_test_assert(fd >= 0);
+  rv = tcgetattr(fd, &term);
+  rtems_test_assert(rv == 0);
+  cfmakeraw(&term);
+  rv = tcsetattr(fd, TCSANOW, &term);
+  rtems_test_assert(rv == 0);
+
+  /* The client accepts the compression before it sends this character */
+  rtems_test_assert(read(fd, &c, sizeof(c)) == 1);
+  rtems_test_assert(c == 'x');
+  rtems_test_assert(bench_compress_pty.tx_zactive);
+
+  t0 = rtems_clock_get_uptime_nanoseconds();
+
+  for (done = 0; done < sizeof(bench_output); done += 80) {
+    ssize_t n;
+
+    n = write(fd, &bench_output[done], 80);
+    rtems_test_assert(n == 80);
+  }
+
+  telnetd_pty_close_socket(&bench_compress_pty);
+  t1 = rtems_clock_get_uptime_nanoseconds();
+
+  sc = rtems_event_receive(
+    BENCH_EVENT_DONE,
+    RTEMS_WAIT | RTEMS_EVENT_ALL,
+    RTEMS_NO_TIMEOUT,
+    &events
+  );
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+  rtems_test_assert(client.inflated == sizeof(bench_output));
+  rtems_test_assert(
+    memcmp(bench_inflated, bench_output, sizeof(bench_output)) == 0
+  );
+  rtems_test_assert(bench_compress_pty.tx_produced == sizeof(bench_output));
+
+  /*
+   * The client sent one command and a character, the start sequence was the
+   * answer.  The WILL COMPRESS2 of the offer and the start sequence are sent
+   * before the compressed data.
+   */
+  telnetd_pty_get_statistics(&bench_compress_pty, &connection, &total);
+  rtems_test_assert(connection.bytes_sent == total.bytes_sent);
+  rtems_test_assert(connection.iac_commands == 1);
+  rtems_test_assert(connection.bytes_received == 4);
+  rtems_test_assert(connection.bytes_produced == sizeof(bench_output));
+  rtems_test_assert(connection.bytes_sent == client.wire + 3 + 5);
+
+  echoes = 0;
+  for (done = 0; done < RTEMS_TELNETD_ECHO_LATENCY_BUCKETS; ++done) {
+    echoes += connection.echo_latency[done];
+  }
+  rtems_test_assert(echoes >= 1);
+
+  rv = close(fd);
+  rtems_test_assert(rv == 0);
+  (void) close(bc.client);
+  telnetd_pty_destroy(&bench_compress_pty);
+
+  printf(
+    "compress: %" PRIu32 " bytes produced, %" PRIu32 " bytes sent, "
+    "%zu bytes received, %.1f%%, %" PRIu64 " us\n",
+    bench_compress_pty.tx_produced,
+    bench_compress_pty.tx_bytes,
+    client.wire,
+    100.0 * (double) bench_compress_pty.tx_bytes /
+      (double) bench_compress_pty.tx_produced,
+    (t1 - t0) / 1000
+  );
+}
+
+/* Acts as a client which does not read until the delay expired */
+static void bench_drain_client_task(rtems_task_argument arg)
+{
+  bench_drain_client *client;
+  char buf[512];
+  ssize_t n;
+
+  client = (bench_drain_client *) arg;
+
+  if (client->delay > 0) {
+    (void) rtems_task_wake_after(client->delay);
+  }
+
+  while ((n = read(client->fd, buf, sizeof(buf))) > 0) {
+    client->received += (size_t) n;
+  }
+
+  (void) rtems_event_send(client->waiter, BENCH_EVENT_DONE);
+  rtems_task_exit();
+}
+
+static void bench_start_drain_client(bench_drain_client *client)
+{
+  rtems_status_code sc;
+  rtems_id task;
+
+  sc = rtems_task_create(
+    rtems_build_name('B', 'D', 'R', 'N'),
+    1,
+    RTEMS_MINIMUM_STACK_SIZE,
+    RTEMS_DEFAULT_MODES,
+    RTEMS_DEFAULT_ATTRIBUTES,
+    &task
+  );
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+  sc = rtems_task_start(
+    task,
+    bench_drain_client_task,
+    (rtems_task_argument) client
+  );
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+}
+
+static void bench_wait_for_drain_client(void)
+{
+  rtems_status_code sc;
+  rtems_event_set events;
+
+  sc = rtems_event_receive(
+    BENCH_EVENT_DONE,
+    RTEMS_WAIT | RTEMS_EVENT_ALL,
+    RTEMS_NO_TIMEOUT,
+    &events
+  );
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+}
+
+/*
+ * Writes more output than the output buffer and the socket buffers can take
+ * to a client which does not read.  With the block policy, the client starts
+ * to read after a delay and gets all output.  With the drop policy, the
+ * output which does not fit is discarded and the connection stays usable.
+ * With the disconnect policy, the client gets an end of file condition while
+ * the PTY is still open.
+ */
+static void bench_overflow(
+  const char                    *name,
+  rtems_telnetd_overflow_policy  overflow
+)
+{
+  rtems_telnetd_io_statistics connection;
+  rtems_telnetd_io_statistics total;
+  bench_drain_client client;
+  bench_connection bc;
+  struct termios term;
+  const char *path;
+  uint32_t produced;
+  size_t i;
+  size_t done;
+  int size;
+  int fd;
+  int rv;
+
+  path = telnetd_pty_initialize(&bench_overflow_pty, 103);
+  rtems_test_assert(path != NULL);
+
+  telnetd_pty_set_output(
+    &bench_overflow_pty,
+    bench_overflow_buf,
+    sizeof(bench_overflow_buf),
+    0,
+    overflow,
+    0
+  );
+
+  bench_connect(&bc);
+
+  /* Small socket buffers let the output overflow early, if supported */
+  size = 4096;
+  (void) setsockopt(bc.server, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  (void) setsockopt(bc.client, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  memset(&client, 0, sizeof(client));
+  client.fd = bc.client;
+  client.waiter = rtems_task_self();
+  telnetd_pty_set_socket(&bench_overflow_pty, bc.server);
+
+  if (overflow == RTEMS_TELNETD_OVERFLOW_BLOCK) {
+    client.delay = rtems_clock_get_ticks_per_second() / 10;
+    bench_start_drain_client(&client);
+  }
+
+  fd = open(path, O_RDWR);
+  rtems_test_assert(fd >= 0);
+  rv = tcgetattr(fd, &term);
+  rtems_test_assert(rv == 0);
+  cfmakeraw(&term);
+  rv = tcsetattr(fd, TCSANOW, &term);
+  rtems_test_assert(rv == 0);
+
+  for (i = 0; i < BENCH_OVERFLOW_ROUNDS; ++i) {
+    for (done = 0; done < sizeof(bench_output); done += 80) {
+      ssize_t n;
+
+      n = write(fd, &bench_output[done], 80);
+      rtems_test_assert(n == 80);
+    }
+  }
+
+  if (overflow == RTEMS_TELNETD_OVERFLOW_DISCONNECT) {
+    bench_start_drain_client(&client);
+    bench_wait_for_drain_client();
+    telnetd_pty_close_socket(&bench_overflow_pty);
+  } else {
+    if (overflow == RTEMS_TELNETD_OVERFLOW_DROP) {
+      bench_start_drain_client(&client);
+    }
+
+    telnetd_pty_close_socket(&bench_overflow_pty);
+    bench_wait_for_drain_client();
+  }
+
+  telnetd_pty_get_statistics(&bench_overflow_pty, &connection, &total);
+  produced = BENCH_OVERFLOW_ROUNDS * sizeof(bench_output);
+  rtems_test_assert(connection.bytes_produced == produced);
+  rtems_test_assert(connection.bytes_sent == client.received);
+
+  if (overflow == RTEMS_TELNETD_OVERFLOW_BLOCK) {
+    rtems_test_assert(connection.bytes_dropped == 0);
+    rtems_test_assert(connection.bytes_sent >= produced);
+    rtems_test_assert(connection.write_blocked_ns > 0);
+  } else {
+    rtems_test_assert(connection.bytes_dropped > 0);
+    rtems_test_assert(connection.bytes_sent < produced);
+    rtems_test_assert(connection.write_blocked_ns == 0);
+  }
+
+  rv = close(fd);
+  rtems_test_assert(rv == 0);
+  (void) close(bc.client);
+  telnetd_pty_destroy(&bench_overflow_pty);
+
+  printf(
+    "overflow %s: %" PRIu32 " bytes produced, %" PRIu32 " bytes sent, "
+    "%" PRIu32 " bytes dropped, %" PRIu64 " us blocked\n",
+    name,
+    connection.bytes_produced,
+    connection.bytes_sent,
+    connection.bytes_dropped,
+    connection.write_blocked_ns / 1000
+  );
+}
+
+static void bench_command(char *device_name, void *arg)
+{
+  (void) device_name;
+  (void) arg;
+
+  printf("ok\n");
+
+  while (getchar() != EOF) {
+    /* Wait for the client to close the connection */
+  }
+}
+
+static uintptr_t bench_heap_free(void)
+{
+  Heap_Information_block info;
+  int rv;
+
+  rv = malloc_info(&info);
+  rtems_test_assert(rv == 0);
+
+  return info.Free.total;
+}
+
+static int bench_connect_port(uint16_t port)
+{
+  struct sockaddr_in addr;
+  int fd;
+  int rv;
+
+  fd = socket(PF_INET, SOCK_STREAM, 0);
+  rtems_test_assert(fd >= 0);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  rv = connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+  rtems_test_assert(rv == 0);
+
+  return fd;
+}
+
+static void bench_read_line(int fd)
+{
+  char c;
+
+  do {
+    ssize_t n;
+
+    n = read(fd, &c, sizeof(c));
+    rtems_test_assert(n == 1);
+  } while (c != '\n');
+}
+
+/*
+ * Returns the time from the connect() until the first line of the session
+ * arrives at the client.
+ */
+static uint64_t bench_accept(uint16_t port)
+{
+  uint64_t t0;
+  uint64_t t1;
+  int fd;
+  int rv;
+
+  t0 = rtems_clock_get_uptime_nanoseconds();
+  fd = bench_connect_port(port);
+  bench_read_line(fd);
+  t1 = rtems_clock_get_uptime_nanoseconds();
+
+  rv = close(fd);
+  rtems_test_assert(rv == 0);
+
+  return t1 - t0;
+}
+
+static void bench_sessions(const char *name, uint16_t port, bool multiplex_io)
+{
+  rtems_telnetd_config_table config;
+  rtems_status_code sc;
+  uintptr_t free_before;
+  uintptr_t free_after;
+  uint64_t start_ns;
+  uint64_t ns;
+  int i;
+
+  memset(&config, 0, sizeof(config));
+  config.command = bench_command;
+  config.client_maximum = BENCH_SESSIONS;
+  config.port = port;
+  config.multiplex_io = multiplex_io;
+  config.client_prewarm = BENCH_SESSIONS;
+
+  free_before = bench_heap_free();
+  start_ns = rtems_clock_get_uptime_nanoseconds();
+  sc = rtems_telnetd_start(&config);
+  start_ns = rtems_clock_get_uptime_nanoseconds() - start_ns;
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+  free_after = bench_heap_free();
+
+  ns = 0;
+
+  for (i = 0; i < BENCH_CONNECTIONS; ++i) {
+    ns += bench_accept(port);
+
+    /* Give the server time to release the session */
+    (void) rtems_task_wake_after(rtems_clock_get_ticks_per_second());
+  }
+
+  printf(
+    "sessions %s: %zu bytes per idle session, %" PRIu64 " us to first line\n",
+    name,
+    (size_t) (free_before - free_after) / BENCH_SESSIONS,
+    ns / BENCH_CONNECTIONS / 1000
+  );
+  printf(
+    "start %s: %i prepared sessions, %" PRIu64 " us\n",
+    name,
+    BENCH_SESSIONS,
+    start_ns / 1000
+  );
+}
+
+static void bench_lazy_start(uint16_t port)
+{
+  rtems_telnetd_config_table config;
+  rtems_status_code sc;
+  uint64_t start_ns;
+  uint64_t ns;
+
+  memset(&config, 0, sizeof(config));
+  config.command = bench_command;
+  config.client_maximum = BENCH_SESSIONS;
+  config.port = port;
+
+  start_ns = rtems_clock_get_uptime_nanoseconds();
+  sc = rtems_telnetd_start(&config);
+  start_ns = rtems_clock_get_uptime_nanoseconds() - start_ns;
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+
+  /* The first connection creates the session on demand */
+  ns = bench_accept(port);
+
+  printf(
+    "start lazy: 0 prepared sessions, %" PRIu64 " us, "
+    "%" PRIu64 " us to first line\n",
+    start_ns / 1000,
+    ns / 1000
+  );
+}
+
+static void bench_accept_queue(const char *name, uint16_t port,
+  bool multiplex_io)
+{
+  rtems_telnetd_config_table config;
+  rtems_telnetd_statistics stats[8];
+  rtems_status_code sc;
+  uint64_t t0;
+  uint64_t t1;
+  char busy[64];
+  ssize_t n;
+  size_t count;
+  size_t i;
+  int served;
+  int queued;
+  int rejected;
+  int rv;
+
+  memset(&config, 0, sizeof(config));
+  config.command = bench_command;
+  config.client_maximum = 1;
+  config.accept_queue_size = 1;
+  config.port = port;
+  config.multiplex_io = multiplex_io;
+
+  sc = rtems_telnetd_start(&config);
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+
+  served = bench_connect_port(port);
+  bench_read_line(served);
+
+  queued = bench_connect_port(port);
+
+  /* The third client gets the busy message */
+  rejected = bench_connect_port(port);
+  n = read(rejected, busy, sizeof(busy));
+  rtems_test_assert(n > 0);
+  rv = close(rejected);
+  rtems_test_assert(rv == 0);
+
+  /* The queued client gets the session once it is released */
+  t0 = rtems_clock_get_uptime_nanoseconds();
+  rv = close(served);
+  rtems_test_assert(rv == 0);
+  bench_read_line(queued);
+  t1 = rtems_clock_get_uptime_nanoseconds();
+
+  rv = close(queued);
+  rtems_test_assert(rv == 0);
+
+  count = rtems_telnetd_get_statistics(stats, RTEMS_ARRAY_SIZE(stats));
+  rtems_test_assert(count <= RTEMS_ARRAY_SIZE(stats));
+
+  for (i = 0; i < count; ++i) {
+    if (stats[i].port == port) {
+      break;
+    }
+  }
+
+  rtems_test_assert(i < count);
+  rtems_test_assert(stats[i].connections_accepted == 3);
+  rtems_test_assert(stats[i].connections_queued == 1);
+  rtems_test_assert(stats[i].connections_rejected == 1);
+
+  printf(
+    "accept queue %s: %" PRIu64 " us from release to next session\n",
+    name,
+    (t1 - t0) / 1000
+  );
+}
+
+static void bench_idle_timeout(const char *name, uint16_t port,
+  bool multiplex_io)
+{
+  rtems_telnetd_config_table config;
+  rtems_telnetd_statistics stats[8];
+  rtems_status_code sc;
+  uint64_t t0;
+  uint64_t t1;
+  char buf[64];
+  ssize_t n;
+  size_t count;
+  size_t i;
+  int fd;
+  int rv;
+
+  memset(&config, 0, sizeof(config));
+  config.command = bench_command;
+  config.client_maximum = 1;
+  config.port = port;
+  config.multiplex_io = multiplex_io;
+  config.idle_timeout = 1;
+
+  sc = rtems_telnetd_start(&config);
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+
+  /* The client gets the first line and then sends nothing */
+  t0 = rtems_clock_get_uptime_nanoseconds();
+  fd = bench_connect_port(port);
+  bench_read_line(fd);
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    /* Wait for the server to close the connection */
+  }
+
+  t1 = rtems_clock_get_uptime_nanoseconds();
+  rtems_test_assert(t1 - t0 >= 900000000);
+
+  rv = close(fd);
+  rtems_test_assert(rv == 0);
+
+  /* Give the server time to release the session */
+  (void) rtems_task_wake_after(rtems_clock_get_ticks_per_second());
+
+  count = rtems_telnetd_get_statistics(stats, RTEMS_ARRAY_SIZE(stats));
+  rtems_test_assert(count <= RTEMS_ARRAY_SIZE(stats));
+
+  for (i = 0; i < count; ++i) {
+    if (stats[i].port == port) {
+      break;
+    }
+  }
+
+  rtems_test_assert(i < count);
+  rtems_test_assert(stats[i].connections_accepted == 1);
+  rtems_test_assert(stats[i].sessions_timed_out == 1);
+
+  printf(
+    "idle timeout %s: %" PRIu64 " ms from connect to close\n",
+    name,
+    (t1 - t0) / 1000000
+  );
+}
+
+static uint32_t bench_login_checks;
+
+static bool bench_login_check(const char *user, const char *passphrase)
+{
+  (void) user;
+  (void) passphrase;
+
+  ++bench_login_checks;
+  return false;
+}
+
+/* Returns false if the connection was closed before the next prompt */
+static bool bench_read_prompt(int fd)
+{
+  char prev;
+  char c;
+
+  prev = '\0';
+
+  while (true) {
+    ssize_t n;
+
+    n = read(fd, &c, sizeof(c));
+    if (n <= 0) {
+      return false;
+    }
+
+    if (prev == ':' && c == ' ') {
+      return true;
+    }
+
+    prev = c;
+  }
+}
+
+static const rtems_telnetd_statistics *bench_find_statistics(
+  rtems_telnetd_statistics *stats,
+  size_t                    count,
+  uint16_t                  port
+)
+{
+  size_t n;
+  size_t i;
+
+  n = rtems_telnetd_get_statistics(stats, count);
+  rtems_test_assert(n <= count);
+
+  for (i = 0; i < n; ++i) {
+    if (stats[i].port == port) {
+      return &stats[i];
+    }
+  }
+
+  rtems_test_assert(0);
+  return NULL;
+}
+
+/*
+ * Answers all login prompts with a wrong password from the same address
+ * until the login rate limit rejects an attempt.  With one attempt per
+ * minute, only the burst of three attempts reaches the login check.
+ */
+static void bench_login_rate_limit(uint16_t port)
+{
+  static const char user[] = "user\r\n";
+  static const char passphrase[] = "wrong\r\n";
+  rtems_telnetd_config_table config;
+  rtems_telnetd_statistics stats[8];
+  const rtems_telnetd_statistics *st;
+  rtems_status_code sc;
+  uint32_t attempts;
+  int connections;
+
+  memset(&config, 0, sizeof(config));
+  config.command = bench_command;
+  config.client_maximum = 1;
+  config.port = port;
+  config.login_check = bench_login_check;
+  config.login_rate_limit = 1;
+
+  sc = rtems_telnetd_start(&config);
+  rtems_test_assert(sc == RTEMS_SUCCESSFUL);
+
+  attempts = 0;
+  connections = 0;
+
+  do {
+    int fd;
+    int rv;
+
+    rtems_test_assert(connections < 4);
+    ++connections;
+    fd = bench_connect_port(port);
+
+    while (bench_read_prompt(fd)) {
+      ssize_t n;
+
+      n = write(fd, user, sizeof(user) - 1);
+      rtems_test_assert(n == (ssize_t) sizeof(user) - 1);
+
+      if (!bench_read_prompt(fd)) {
+        break;
+      }
+
+      n = write(fd, passphrase, sizeof(passphrase) - 1);
+      rtems_test_assert(n == (ssize_t) sizeof(passphrase) - 1);
+      ++attempts;
+    }
+
+    rv = close(fd);
+    rtems_test_assert(rv == 0);
+
+    st = bench_find_statistics(stats, RTEMS_ARRAY_SIZE(stats), port);
+  } while (st->logins_throttled == 0);
+
+  rtems_test_assert(bench_login_checks == 3);
+  rtems_test_assert(st->logins_throttled + bench_login_checks == attempts);
+
+  printf(
+    "login rate limit: %" PRIu32 " attempts in %i connections, "
+    "%" PRIu32 " checked, %" PRIu32 " throttled\n",
+    attempts,
+    connections,
+    bench_login_checks,
+    st->logins_throttled
+  );
+}
+
+/*
+ * Runs the shell command once all the servers of the benchmarks run, some of
+ * them with sessions which served a connection.
+ */
+static void bench_shell_command(void)
+{
+  char *argv[] = { "telnetd", NULL };
+  char *bad_argv[] = { "telnetd", "all", NULL };
+  int rv;
+
+  rtems_shell_add_cmd_struct(&rtems_shell_TELNETD_Command);
+
+  rv = rtems_shell_execute_cmd("telnetd", 1, argv);
+  rtems_test_assert(rv == 0);
+
+  rv = rtems_shell_execute_cmd("telnetd", 2, bad_argv);
+  rtems_test_assert(rv == 1);
+}
+
+static rtems_task Init( rtems_task_argument argument )
+{
+  size_t i;
+
+  TEST_BEGIN();
+
+  rtems_test_assert( net_start() == 0 );
+
+  for (i = 0; i < sizeof(bench_paste); ++i) {
+    bench_paste[i] = (char) ('A' + i % 26);
+  }
+
+  bench_receive_legacy();
+  bench_receive_buffered();
+  bench_compress();
+  bench_overflow("block", RTEMS_TELNETD_OVERFLOW_BLOCK);
+  bench_overflow("drop", RTEMS_TELNETD_OVERFLOW_DROP);
+  bench_overflow("disconnect", RTEMS_TELNETD_OVERFLOW_DISCONNECT);
+  bench_sessions("thread", BENCH_PORT + 1, false);
+  bench_sessions("multiplexed", BENCH_PORT + 2, true);
+  bench_lazy_start(BENCH_PORT + 3);
+  bench_accept_queue("thread", BENCH_PORT + 4, false);
+  bench_accept_queue("multiplexed", BENCH_PORT + 5, true);
+  bench_idle_timeout("thread", BENCH_PORT + 6, false);
+  bench_idle_timeout("multiplexed", BENCH_PORT + 7, true);
+  bench_login_rate_limit(BENCH_PORT + 8);
+  bench_shell_command();
+
+  TEST_END();
+  rtems_test_exit( 0 );
+}
+
+#define CONFIGURE_INIT
+
+#define CONFIGURE_MICROSECONDS_PER_TICK 10000
+
+#define CONFIGURE_APPLICATION_NEEDS_CLOCK_DRIVER
+#define CONFIGURE_APPLICATION_NEEDS_CONSOLE_DRIVER
+#define CONFIGURE_APPLICATION_NEEDS_LIBBLOCK
+#define CONFIGURE_APPLICATION_NEEDS_STUB_DRIVER
+#define CONFIGURE_APPLICATION_NEEDS_ZERO_DRIVER
+
+#define CONFIGURE_MAXIMUM_DRIVERS 32
+#define CONFIGURE_MAXIMUM_FILE_DESCRIPTORS 64
+
+#define CONFIGURE_MAXIMUM_USER_EXTENSIONS 1
+
+#define CONFIGURE_UNLIMITED_ALLOCATION_SIZE 32
+
+#define CONFIGURE_BDBUF_BUFFER_MAX_SIZE (64 * 1024)
+#define CONFIGURE_BDBUF_MAX_READ_AHEAD_BLOCKS 4
+#define CONFIGURE_BDBUF_CACHE_MEMORY_SIZE (1 * 1024 * 1024)
+
+#define CONFIGURE_INIT_TASK_STACK_SIZE (32 * 1024)
+
+#define CONFIGURE_MAXIMUM_TASKS 40
+
+#define CONFIGURE_MAXIMUM_POSIX_KEYS 1
+#define CONFIGURE_MAXIMUM_SEMAPHORES 20
+#define CONFIGURE_MAXIMUM_MESSAGE_QUEUES 10
+
+#define CONFIGURE_INITIAL_EXTENSIONS RTEMS_TEST_INITIAL_EXTENSION
+
+#define CONFIGURE_RTEMS_INIT_TASKS_TABLE
+
+#define CONFIGURE_INIT_TASK_ATTRIBUTES RTEMS_FLOATING_POINT
+
+#define CONFIGURE_UNLIMITED_OBJECTS
+#define CONFIGURE_UNIFIED_WORK_AREAS
+
+#include <rtems/confdefs.h>
@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/**
+ * @file
+ *
+ * @brief Host test and benchmark of the DES based crypt() used by the Telnet
+ *   login check.
+ *
+ * See telnetdcrypt.doc for the build instructions.
+ */
+
+/*
+ * Copyright (C) 2026 The RTEMS Project
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "des.h"
+
+#define BENCH_CRYPTS 100000
+
+#define RANDOM_CHECKS 2000
+
+#ifdef CRYPT_HOST_REFERENCE
+/* The __des_crypt_r() of another des.c built with a renamed symbol */
+char *des_crypt_ref(const char *, const char *, char *, int);
+#endif
+
+typedef struct {
+  const char *key;
+  const char *salt;
+  const char *hash;
+} crypt_vector;
+
+/* Known answers of the traditional crypt(3) */
+static const crypt_vector crypt_vectors[] = {
+  { "", "ab", "abmF1QH4PEr.E" },
+  { "test", "ab", "abgOeLfPimXQo" },
+  { "password", "td", "tdo0P9yxNTGrU" },
+  { "rtems", "./", "./h5/H29EUDRg" },
+  { "longerthan8chars", "zZ", "zZTmz5tm4KJnQ" },
+  { "\xff\x80x", "a1", "a1y9M64UOGtGw" }
+};
+
+static uint64_t crypt_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static void crypt_random_string(char *s, size_t size)
+{
+  static const char salt_chars[] =
+    "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+  size_t i;
+
+  for (i = 0; i + 1 < size; ++i) {
+    s[i] = salt_chars[rand() % (sizeof(salt_chars) - 1)];
+  }
+
+  s[size - 1] = '\0';
+}
+
+static void crypt_check(void)
+{
+  char buf[21];
+  size_t i;
+
+  for (i = 0; i < sizeof(crypt_vectors) / sizeof(crypt_vectors[0]); ++i) {
+    const crypt_vector *v;
+    const char *hash;
+
+    v = &crypt_vectors[i];
+    hash = __des_crypt_r(v->key, v->salt, buf, sizeof(buf));
+    assert(hash != NULL);
+    assert(strcmp(hash, v->hash) == 0);
+  }
+
+  assert(__des_crypt_r("x", "ab", buf, 20) == NULL);
+
+#ifdef CRYPT_HOST_REFERENCE
+  srand(1);
+
+  for (i = 0; i < RANDOM_CHECKS; ++i) {
+    char key[9];
+    char salt[3];
+    char ref[21];
+
+    crypt_random_string(key, (size_t) (rand() % 9) + 1);
+    crypt_random_string(salt, sizeof(salt));
+    assert(strcmp(
+      __des_crypt_r(key, salt, buf, sizeof(buf)),
+      des_crypt_ref(key, salt, ref, sizeof(ref))
+    ) == 0);
+  }
+#endif
+
+  printf("check: %zu known answers ok\n",
+    sizeof(crypt_vectors) / sizeof(crypt_vectors[0]));
+}
+
+static double crypt_bench(
+  char *(*crypt_r)(const char *, const char *, char *, int)
+)
+{
+  char keys[16][9];
+  char salt[3];
+  char buf[21];
+  uint64_t t0;
+  uint64_t t1;
+  size_t i;
+
+  srand(2);
+
+  for (i = 0; i < 16; ++i) {
+    crypt_random_string(keys[i], sizeof(keys[i]));
+  }
+
+  /* Like repeated login attempts against one stored password */
+  crypt_random_string(salt, sizeof(salt));
+  t0 = crypt_now();
+
+  for (i = 0; i < BENCH_CRYPTS; ++i) {
+    (void) (*crypt_r)(keys[i % 16], salt, buf, sizeof(buf));
+  }
+
+  t1 = crypt_now();
+  return (double) BENCH_CRYPTS / ((double) (t1 - t0) / 1e9);
+}
+
+int main(void)
+{
+  double rate;
+
+  crypt_check();
+
+  rate = crypt_bench(__des_crypt_r);
+  printf("bench: des.c %10.0f crypts/s\n", rate);
+
+#ifdef CRYPT_HOST_REFERENCE
+  {
+    double ref;
+
+    ref = crypt_bench(des_crypt_ref);
+    printf(
+      "bench: reference %10.0f crypts/s, speedup %.2f\n",
+      ref,
+      rate / ref
+    );
+  }
+#endif
+
+  printf("*** END OF TEST TELNETD CRYPT ***\n");
+  return 0;
+}
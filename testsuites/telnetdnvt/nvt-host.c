@@ -0,0 +1,417 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/**
+ * @file
+ *
+ * @brief Host test and benchmark of the Telnet NVT input processing.
+ *
+ * See telnetdnvt.doc for the build instructions.
+ */
+
+/*
+ * Copyright (C) 2026 The RTEMS Project
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <assert.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pty-nvt.h"
+
+#define BENCH_BLOCK_SIZE 512
+
+#define BENCH_TOTAL_SIZE (64 * 1024 * 1024)
+
+typedef struct {
+  const char    *name;
+  unsigned char *data;
+  size_t         size;
+} nvt_stream;
+
+/*
+ * Negotiation of a typical Telnet client followed by a window size
+ * subnegotiation (NAWS, 132x43) and some typed command lines.
+ */
+static const unsigned char nvt_login[] = {
+  0xff, 0xfd, 0x03, 0xff, 0xfb, 0x18, 0xff, 0xfb, 0x1f, 0xff, 0xfb, 0x20,
+  0xff, 0xfb, 0x21, 0xff, 0xfb, 0x22, 0xff, 0xfb, 0x27, 0xff, 0xfd, 0x05,
+  0xff, 0xfa, 0x1f, 0x00, 0x84, 0x00, 0x2b, 0xff, 0xf0,
+  'r', 'o', 'o', 't', '\r', '\0',
+  'p', 'a', 's', 's', 'w', 'o', 'r', 'd', '\r', '\n',
+  'l', 's', ' ', '-', 'l', '\r', '\n',
+  'c', 'p', 'u', 'u', 's', 'e', '\r', '\0',
+  0xff, 0xf4, 0xff, 0xfd, 0x06,
+  0xff, 0xfa, 0x1f, 0x00, 0x50, 0x00, 0x18, 0xff, 0xf0,
+  's', 't', 'a', 't', 's', 0xff, 0xf7, '\r', '\n'
+};
+
+static uint64_t nvt_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+static void nvt_init(rtems_pty_context *pty, int socket)
+{
+  memset(pty, 0, sizeof(*pty));
+  pty->socket = socket;
+}
+
+static int nvt_reply_file(void)
+{
+  FILE *file;
+
+  file = tmpfile();
+  assert(file != NULL);
+  return dup(fileno(file));
+}
+
+static size_t nvt_read_replies(int fd, unsigned char *buf, size_t size)
+{
+  ssize_t n;
+
+  n = pread(fd, buf, size, 0);
+  assert(n >= 0);
+  return (size_t) n;
+}
+
+static size_t nvt_reference(
+  rtems_pty_context   *pty,
+  const unsigned char *in,
+  size_t               len,
+  unsigned char       *out
+)
+{
+  size_t n;
+  size_t i;
+
+  n = 0;
+
+  for (i = 0; i < len; ++i) {
+    int result;
+
+    result = telnetd_nvt_process_byte(pty, in[i]);
+    if (result >= 0) {
+      out[n] = (unsigned char) result;
+      ++n;
+    }
+  }
+
+  return n;
+}
+
+static size_t nvt_blocks(
+  rtems_pty_context   *pty,
+  const unsigned char *in,
+  size_t               len,
+  size_t               block,
+  unsigned char       *out
+)
+{
+  size_t n;
+  size_t i;
+
+  n = 0;
+
+  for (i = 0; i < len; i += block) {
+    size_t chunk;
+
+    chunk = len - i < block ? len - i : block;
+    memcpy(&out[n], &in[i], chunk);
+    n += telnetd_nvt_decode(pty, NULL, &out[n], chunk);
+  }
+
+  return n;
+}
+
+static void nvt_check(const nvt_stream *stream)
+{
+  static const size_t blocks[] = { 1, 2, 3, 7, 64, 511, 512, 4096 };
+  rtems_pty_context ref;
+  unsigned char *expected;
+  unsigned char *actual;
+  unsigned char *expected_replies;
+  unsigned char *actual_replies;
+  size_t expected_len;
+  size_t expected_replies_len;
+  size_t reply_size;
+  size_t i;
+  int fd;
+
+  expected = malloc(stream->size);
+  actual = malloc(stream->size);
+  reply_size = 64 * stream->size + 64;
+  expected_replies = malloc(reply_size);
+  actual_replies = malloc(reply_size);
+  assert(expected != NULL && actual != NULL);
+  assert(expected_replies != NULL && actual_replies != NULL);
+
+  fd = nvt_reply_file();
+  nvt_init(&ref, fd);
+  expected_len = nvt_reference(&ref, stream->data, stream->size, expected);
+  expected_replies_len = nvt_read_replies(fd, expected_replies, reply_size);
+  close(fd);
+
+  for (i = 0; i < sizeof(blocks) / sizeof(blocks[0]); ++i) {
+    rtems_pty_context pty;
+    size_t actual_len;
+    size_t actual_replies_len;
+
+    fd = nvt_reply_file();
+    nvt_init(&pty, fd);
+    actual_len = nvt_blocks(
+      &pty,
+      stream->data,
+      stream->size,
+      blocks[i],
+      actual
+    );
+    actual_replies_len = nvt_read_replies(fd, actual_replies, reply_size);
+    close(fd);
+
+    assert(actual_len == expected_len);
+    assert(memcmp(actual, expected, expected_len) == 0);
+    assert(actual_replies_len == expected_replies_len);
+    assert(memcmp(actual_replies, expected_replies, actual_replies_len) == 0);
+    assert(pty.width == ref.width);
+    assert(pty.height == ref.height);
+    assert(pty.iac_mode == ref.iac_mode);
+    assert(pty.last_cr == ref.last_cr);
+  }
+
+  printf(
+    "%-8s check: %zu bytes in, %zu characters out, %zu reply bytes, "
+    "window %ix%i\n",
+    stream->name,
+    stream->size,
+    expected_len,
+    expected_replies_len,
+    ref.width,
+    ref.height
+  );
+
+  free(expected);
+  free(actual);
+  free(expected_replies);
+  free(actual_replies);
+}
+
+static void nvt_check_linemode(void)
+{
+  static const unsigned char in[] = {
+    /* WILL LINEMODE */
+    0xff, 0xfb, 0x22,
+    /* MODE EDIT|TRAPSIG, we insist on EDIT */
+    0xff, 0xfa, 0x22, 0x01, 0x03, 0xff, 0xf0,
+    /* MODE EDIT|ACK */
+    0xff, 0xfa, 0x22, 0x01, 0x05, 0xff, 0xf0,
+    /* DO FORWARDMASK */
+    0xff, 0xfa, 0x22, 0xfd, 0x02, 0xff, 0xf0,
+    /* SLC with an escaped 0xff value */
+    0xff, 0xfa, 0x22, 0x03, 0x03, 0x02, 0xff, 0xff, 0xff, 0xf0,
+    'l', 's', '\r', '\n'
+  };
+  static const unsigned char expected_replies[] = {
+    /* MODE EDIT and WONT ECHO */
+    0xff, 0xfa, 0x22, 0x01, 0x01, 0xff, 0xf0,
+    0xff, 0xfc, 0x01,
+    /* MODE EDIT again */
+    0xff, 0xfa, 0x22, 0x01, 0x01, 0xff, 0xf0,
+    /* WONT FORWARDMASK */
+    0xff, 0xfa, 0x22, 0xfc, 0x02, 0xff, 0xf0,
+    /* Back in character mode, WILL ECHO */
+    0xff, 0xfa, 0x22, 0x01, 0x00, 0xff, 0xf0,
+    0xff, 0xfb, 0x01
+  };
+  static const unsigned char start_reply[] = { 0xff, 0xfd, 0x22 };
+  telnetd_nvt_options opt;
+  rtems_pty_context pty;
+  unsigned char out[sizeof(in)];
+  unsigned char replies[128];
+  size_t len;
+  size_t replies_len;
+  int fd;
+
+  fd = nvt_reply_file();
+  nvt_init(&pty, fd);
+  memset(&opt, 0, sizeof(opt));
+  opt.linemode.enabled = true;
+  telnetd_nvt_start(&pty, &opt);
+  replies_len = nvt_read_replies(fd, replies, sizeof(replies));
+  assert(replies_len == sizeof(start_reply));
+  assert(memcmp(replies, start_reply, sizeof(start_reply)) == 0);
+  close(fd);
+
+  fd = nvt_reply_file();
+  pty.socket = fd;
+  telnetd_nvt_linemode_update(&pty, &opt, LM_MODE_EDIT, true);
+  memcpy(out, in, sizeof(in));
+  len = telnetd_nvt_decode(&pty, &opt, out, sizeof(in));
+  assert(opt.linemode.active);
+  assert(len == 3);
+  assert(memcmp(out, "ls\r", 3) == 0);
+  telnetd_nvt_linemode_update(&pty, &opt, 0, false);
+  replies_len = nvt_read_replies(fd, replies, sizeof(replies));
+  assert(replies_len == sizeof(expected_replies));
+  assert(memcmp(replies, expected_replies, sizeof(expected_replies)) == 0);
+  close(fd);
+
+  printf("linemode check: %zu reply bytes\n", replies_len);
+}
+
+static double nvt_mb_per_s(size_t bytes, uint64_t ns)
+{
+  return ((double) bytes / (1024.0 * 1024.0)) / ((double) ns / 1e9);
+}
+
+static void nvt_bench(const nvt_stream *stream, int null_fd)
+{
+  static unsigned char out[BENCH_BLOCK_SIZE];
+  rtems_pty_context pty;
+  volatile size_t sink;
+  uint64_t t0;
+  uint64_t t1;
+  uint64_t t2;
+  size_t done;
+  size_t pos;
+
+  sink = 0;
+
+  nvt_init(&pty, null_fd);
+  t0 = nvt_now();
+
+  for (done = 0, pos = 0; done < BENCH_TOTAL_SIZE; done += BENCH_BLOCK_SIZE) {
+    if (pos + BENCH_BLOCK_SIZE > stream->size) {
+      pos = 0;
+    }
+
+    sink += nvt_reference(&pty, &stream->data[pos], BENCH_BLOCK_SIZE, out);
+    pos += BENCH_BLOCK_SIZE;
+  }
+
+  t1 = nvt_now();
+  nvt_init(&pty, null_fd);
+
+  for (done = 0, pos = 0; done < BENCH_TOTAL_SIZE; done += BENCH_BLOCK_SIZE) {
+    if (pos + BENCH_BLOCK_SIZE > stream->size) {
+      pos = 0;
+    }
+
+    /* The copy stands for the socket read into the receive ring */
+    memcpy(out, &stream->data[pos], BENCH_BLOCK_SIZE);
+    sink += telnetd_nvt_decode(&pty, NULL, out, BENCH_BLOCK_SIZE);
+    pos += BENCH_BLOCK_SIZE;
+  }
+
+  t2 = nvt_now();
+
+  printf(
+    "%-8s bench: byte %8.1f MB/s, block %8.1f MB/s\n",
+    stream->name,
+    nvt_mb_per_s(BENCH_TOTAL_SIZE, t1 - t0),
+    nvt_mb_per_s(BENCH_TOTAL_SIZE, t2 - t1)
+  );
+  (void) sink;
+}
+
+static void nvt_fill(
+  nvt_stream          *stream,
+  const char          *name,
+  const unsigned char *pattern,
+  size_t               pattern_size,
+  size_t               size
+)
+{
+  size_t i;
+
+  stream->name = name;
+  stream->data = malloc(size);
+  stream->size = size;
+  assert(stream->data != NULL);
+
+  for (i = 0; i < size; ++i) {
+    stream->data[i] = pattern[i % pattern_size];
+  }
+}
+
+int main(void)
+{
+  static const unsigned char text[] =
+    "The quick brown fox jumps over the lazy dog 0123456789.\r\n";
+  static const unsigned char binary[] = {
+    'a', 0xff, 0xff, 'b', '\r', '\0', 'c', '\r', '\n', 0xff, 0xf1, 'd',
+    '\r', 'e', 0xff, 0xfa, 0x1f, 0xff, 0xff, 0x01, 0x00, 0x02, 0xff, 0xf0
+  };
+  nvt_stream streams[5];
+  size_t count;
+  size_t i;
+  int null_fd;
+
+  count = sizeof(streams) / sizeof(streams[0]);
+  nvt_fill(&streams[0], "login", nvt_login, sizeof(nvt_login),
+    sizeof(nvt_login) * 64);
+  nvt_fill(&streams[1], "paste", text, sizeof(text) - 1, 1024 * 1024);
+  nvt_fill(&streams[2], "escapes", binary, sizeof(binary), 1024 * 1024);
+
+  /* Plain text with a window size change after each 4KiB */
+  nvt_fill(&streams[3], "mixed", text, sizeof(text) - 1, 1024 * 1024);
+  for (i = 0; i + sizeof(nvt_login) <= streams[3].size; i += 4096) {
+    memcpy(&streams[3].data[i], nvt_login, sizeof(nvt_login));
+  }
+
+  nvt_fill(&streams[4], "random", text, 1, 1024 * 1024);
+  srand(1);
+  for (i = 0; i < streams[4].size; ++i) {
+    streams[4].data[i] = (unsigned char) rand();
+  }
+
+  for (i = 0; i < count; ++i) {
+    nvt_check(&streams[i]);
+  }
+
+  nvt_check_linemode();
+
+  null_fd = open("/dev/null", O_WRONLY);
+  assert(null_fd >= 0);
+
+  for (i = 0; i < count; ++i) {
+    nvt_bench(&streams[i], null_fd);
+  }
+
+  close(null_fd);
+
+  for (i = 0; i < count; ++i) {
+    free(streams[i].data);
+  }
+
+  printf("*** END OF TEST TELNETD NVT ***\n");
+  return 0;
+}
@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: BSD-2-Clause */
+
+/**
+ * @file
+ *
+ * @brief CPU time of the RTEMS tasks for ttcp.
+ *
+ * The Classic API has no directive to get the CPU time used by a task, so
+ * this file uses the score functions of the CPU usage report in
+ * cpukit/libmisc/cpuuse.  No other file of ttcp includes score headers.
+ */
+
+/*
+ * Copyright (C) 2026 The RTEMS Project
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <rtems.h>
+#include <rtems/score/threadimpl.h>
+#include <rtems/score/timestampimpl.h>
+
+#include "ttcp-cpu.h"
+
+typedef struct {
+	uint64_t idle_ns;
+	int processors;
+} ttcp_cpu_idle_context;
+
+static bool ttcp_cpu_idle_visitor(rtems_tcb *tcb, void *arg)
+{
+	ttcp_cpu_idle_context *ctx = arg;
+	Timestamp_Control used;
+
+	if (_Thread_Is_idle(tcb)) {
+		used = _Thread_Get_CPU_time_used(tcb);
+		ctx->idle_ns += _Timestamp_Get_as_nanoseconds(&used);
+		++ctx->processors;
+	}
+	return false;
+}
+
+void ttcp_cpu_executing(struct timespec *ts)
+{
+	Timestamp_Control used;
+
+	used = _Thread_Get_CPU_time_used(_Thread_Get_executing());
+	_Timestamp_To_timespec(&used, ts);
+}
+
+uint64_t ttcp_cpu_idle(int *processors)
+{
+	ttcp_cpu_idle_context ctx = { 0, 0 };
+
+	rtems_task_iterate(ttcp_cpu_idle_visitor, &ctx);
+	*processors = ctx.processors;
+	return ctx.idle_ns;
+}
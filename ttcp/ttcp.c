@@ -48,6 +48,9 @@
 //The millisecond delay should work on a modern OS but can be disabled if not
 #define ENABLE_NANOSLEEP_DELAY
 
+/* For the thread CPU affinity */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <signal.h>
 #include <ctype.h>
@@ -62,189 +65,3200 @@
 #ifndef RTEMS_NET_LWIP
 #include <netdb.h>
 #endif
+#include <stdint.h>
 #include <string.h>
 #include <sys/time.h>		/* struct timeval */
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <time.h>
 
 #if defined(__rtems__)
 #define __need_getopt_newlib
 #include <getopt.h>
 #include <rtems/shell.h>
 #include <sys/select.h>
+#include "ttcp-cpu.h"
 #endif /* __rtems__ */
 
-#if RTEMS_NET_LWIP
-#include <lwip/inet.h>
-#include <lwip/netdb.h>
-#undef TCP_NODELAY
-#define select lwip_select
-#endif /* RTEMS_NET_LWIP */
+#if RTEMS_NET_LWIP
+#include <lwip/inet.h>
+#include <lwip/netdb.h>
+#undef TCP_NODELAY
+#define select lwip_select
+#endif /* RTEMS_NET_LWIP */
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <syslog.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#if defined(SYSV)
+#include <sys/times.h>
+#include <sys/param.h>
+struct rusage {
+    struct timeval ru_utime, ru_stime;
+};
+#define RUSAGE_SELF 0
+#else
+#include <sys/resource.h>
+#endif
+
+#if defined(__rtems__) || defined(__linux__)
+#define TTCP_HAVE_AFFINITY
+#endif
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <linux/errqueue.h>
+#include <poll.h>
+#define TTCP_HAVE_SENDFILE		/* Linux sendfile() */
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define TTCP_HAVE_MSG_ZEROCOPY
+#define TTCP_ZEROCOPY_WAIT_MS	100	/* for completions if out of memory */
+#endif
+#define TTCP_HAVE_MSG_TRUNC		/* TCP recv() may discard the data */
+#elif defined(__FreeBSD__)
+#define TTCP_HAVE_SENDFILE		/* BSD sendfile() */
+#endif
+
+#if RTEMS_NET_LWIP
+#include <lwip/api.h>
+#define TTCP_NOCOPY_DRAIN_MS	10000	/* for the peer to take the data */
+#endif
+
+#if defined(__linux__)
+#define TTCP_HAVE_MMSG			/* sendmmsg() and recvmmsg() */
+#define TTCP_UDP_BATCH		32
+#else
+#define TTCP_UDP_BATCH		1
+#endif
+
+#define TTCP_MAX_STREAMS	64	/* limit of -P */
+#define TTCP_MAX_CPUS		32	/* limit of the -a list */
+#define TTCP_STREAM_STACK_SIZE	(32 * 1024)
+#define TTCP_RR_TIMEOUT_MS	1000	/* -R -u: a response is lost after this */
+
+/*
+ * Round trip time histogram in nanoseconds.  Values below 2 * HALF have
+ * their own bucket, above each power of two range is split into HALF
+ * buckets, so the relative error stays below 1 / HALF up to about 17s.
+ */
+#define TTCP_HIST_SUB_BITS	7
+#define TTCP_HIST_HALF		(1 << (TTCP_HIST_SUB_BITS - 1))
+#define TTCP_HIST_BUCKETS	(30 * TTCP_HIST_HALF)
+
+typedef struct {
+	uint32_t *counts;		/* TTCP_HIST_BUCKETS counters */
+	unsigned long count;
+	uint64_t sum, min, max;
+} ttcp_hist;
+
+#define TTCP_MAX_BATCH		64	/* limit of -k */
+#define TTCP_SEQ_WINDOW		1024	/* duplicate detection, power of two */
+#define TTCP_PACE_MIN_US	16	/* first delay after ENOBUFS */
+#define TTCP_PACE_MAX_US	18000
+#define TTCP_RATE_BURST_NS	10000000	/* default burst of -L: 10ms */
+#define TTCP_RATE_SPIN_NS	20000		/* shorter waits poll the clock */
+#define TTCP_POLL_NS		100000000	/* -i: check for the run end */
+#define TTCP_DAEMON_POLL_MS	250		/* -S: check for a stop request */
+
+/*
+ * Token bucket of -L.  The bucket is kept as the time at which it is empty
+ * again (tat), sending costs ns_per_token per token, and tat may be up to
+ * burst_ns ahead of the current time.  This allows a burst after a long
+ * wait, so a coarse sleep does not lower the average rate.
+ */
+typedef struct {
+	double ns_per_token;
+	uint64_t burst_ns;
+	uint64_t tat;
+} ttcp_bucket;
+
+/*
+ * Header of the datagrams of -u -s in network byte order.  The time stamp is
+ * the monotonic clock of the transmitter in nanoseconds.
+ */
+typedef struct {
+	uint32_t seq;
+	uint32_t reserved;
+	uint32_t stamp_hi;
+	uint32_t stamp_lo;
+} ttcp_udp_header;
+
+#if defined(TTCP_HAVE_MMSG)
+typedef struct mmsghdr ttcp_mmsghdr;
+#else
+typedef struct {
+	struct msghdr msg_hdr;
+	unsigned int msg_len;
+} ttcp_mmsghdr;
+#endif
+
+typedef struct {
+	ttcp_mmsghdr msg[TTCP_MAX_BATCH];
+	struct iovec iov[TTCP_MAX_BATCH][2];
+	ttcp_udp_header head[TTCP_MAX_BATCH];
+	char *data;			/* receiver: one buffer per datagram */
+} ttcp_batch;
+
+/*
+ * Receiver accounting of the sequence numbers.  The bit of a sequence number
+ * in the window is set once it was received, the window covers the sequence
+ * numbers below next.  The jitter is the one of RFC 3550 in nanoseconds.
+ */
+typedef struct {
+	uint32_t next;			/* highest sequence number + 1 */
+	unsigned long received;		/* distinct sequence numbers */
+	unsigned long duplicates;
+	unsigned long reordered;
+	uint32_t window[TTCP_SEQ_WINDOW / 32];
+	int64_t transit;
+	double jitter;
+} ttcp_udp_stats;
+
+typedef struct ttcp_run ttcp_run;
+
+/*
+ * Payload verification.  Each buffer is a block with a pattern keyed by the
+ * block number and the CRC32C of the pattern in the last four bytes.
+ */
+typedef struct {
+	uint64_t blocks;		/* blocks generated or checked */
+	unsigned long corrupt;		/* -r: blocks with bad data */
+	uint64_t offset;		/* -r: stream offset of the first error */
+	int fill;			/* -r: bytes of the current block */
+	uint64_t cpu_ns;		/* CPU time to generate or check */
+} ttcp_verify;
+
+/*
+ * Classes of failed connection attempts of -C.  Running out of local ports
+ * is mostly due to connections in TIME_WAIT.
+ */
+#define TTCP_CONN_PORTS		0	/* EADDRNOTAVAIL, EADDRINUSE */
+#define TTCP_CONN_FILES		1	/* EMFILE, ENFILE */
+#define TTCP_CONN_BUFFERS	2	/* ENOBUFS, ENOMEM */
+#define TTCP_CONN_PEER		3	/* refused, reset or timed out */
+#define TTCP_CONN_OTHER		4
+#define TTCP_CONN_ERRORS	5
+
+#define TTCP_CONN_BACKOFF_NS	1000000	/* after a failed attempt */
+#define TTCP_CONN_IDLE_MS	2000	/* -r: end of the run */
+
+/*
+ * State of one connection.  With -P, each stream runs in its own thread and
+ * must not print, since the thread does not share the stdio of the shell.
+ * Errors are recorded and reported by the calling task.
+ */
+typedef struct {
+	ttcp_run *run;
+	int index;
+	int fd;				/* fd of network socket */
+	char *buf;			/* ptr to dynamic buffer */
+	char *alloc_buf;		/* ptr to beginning of memory allocated for buf */
+	struct sockaddr_in sinme;
+	struct sockaddr_in sinhim;
+	struct sockaddr_in peer;	/* receiver: address of the transmitter */
+	int going;			/* UDP receiver: start sentinel seen */
+	double nbytes;			/* bytes on net */
+	unsigned long numCalls;		/* # of I/O system calls */
+	double cput, realt;		/* user, real time (seconds) */
+	double thread_cput;		/* CPU time of the stream, < 0 if unknown */
+	struct timeval time0;		/* Time at which timing started */
+	struct timeval time1;		/* Time at which timing ended */
+	struct rusage ru0;		/* Resource utilization at the start */
+	struct timespec cpu0;		/* Thread CPU time at the start */
+	const char *error;		/* failed operation or NULL */
+	int error_errno;
+	unsigned long transactions;	/* -R: completed requests */
+	unsigned long lost;		/* -R -u: requests without response */
+	ttcp_hist rtt;			/* -R -t: round trip times */
+	ttcp_batch *batch;		/* -u -s: batched datagrams */
+	unsigned long datagrams;	/* -u -s -t: datagrams sent */
+	unsigned long enobufs;		/* -u -t: sends failed with ENOBUFS */
+	long pace_us;			/* -u -t: delay between sends */
+	ttcp_udp_stats udp;		/* -u -s -r: sequence accounting */
+	ttcp_bucket bucket;		/* -L -t: rate limit */
+	unsigned long zc_sends;		/* -Z -t: zero-copy sends completed */
+	unsigned long zc_copied;	/* -Z -t: of which were copied anyway */
+	ttcp_verify verify;		/* -V: checked blocks */
+	unsigned long conn_errors[TTCP_CONN_ERRORS]; /* -C: failures */
+	atomic_uint_least64_t progress_bytes;	/* -i: nbytes */
+	atomic_ulong progress_calls;	/* -i: numCalls */
+	atomic_int finished;		/* -i: stream_run() returned */
+	char stats[128];
+	pthread_t thread;
+	int thread_started;
+} ttcp_stream;
+
+/* Options and streams of one ttcp invocation */
+struct ttcp_run {
+	int buflen;			/* length of buffer */
+	int nbuf;			/* number of buffers to send in sinkmode */
+	int bufoffset;			/* align buffer to this */
+	int bufalign;			/* modulo this */
+	int udp;			/* 0 = tcp, !0 = udp */
+	int options;			/* socket options */
+	short port;			/* TCP port number */
+	char *host;			/* ptr to name of host */
+	int trans;			/* 0=receive, !0=transmit mode */
+	int sinkmode;			/* 0=normal I/O, !0=sink/source mode */
+	int verbose;			/* 0=print basic info, 1=print cpu rate, proc
+					 * resource usage. */
+	int nodelay;			/* set TCP_NODELAY socket option */
+	int b_flag;			/* use mread() */
+	int sockbufsize;		/* socket buffer size to use */
+	char fmt;			/* output format: k = kilobits, K = kilobytes,
+					 *  m = megabits, M = megabytes,
+					 *  g = gigabits, G = gigabytes */
+	int touchdata;			/* access data after reading */
+	long milliseconds;		/* delay in milliseconds */
+	long duration;			/* transmit for seconds instead of nbuf */
+	int rr;				/* request/response mode */
+	int rr_request;			/* request size */
+	int rr_response;		/* response size */
+	int batch;			/* -u -s: datagrams per system call */
+	double rate;			/* -L: bits or buffers per second */
+	int rate_buffers;		/* rate is in buffers per second */
+	int rate_burst;			/* burst in buffers, 0 = 10ms */
+	uint64_t interval_ns;		/* -i: interval report period */
+	int daemon;			/* -S: concurrent connections */
+	const char *file;		/* -F: transmit this file */
+	int zerocopy;			/* -Z: zero-copy send, no-copy receive */
+	int verify;			/* -V: generate or check the payload */
+	int conn;			/* -C: connection rate mode */
+	int conn_bytes;			/* -C: bytes exchanged per connection */
+	char output;			/* t = text, j = JSON lines, c = CSV */
+	int threaded;			/* all streams run in threads */
+	int nstreams;			/* number of parallel streams */
+	int ncpus;			/* number of CPUs in the affinity list */
+	int cpus[TTCP_MAX_CPUS];	/* affinity list */
+	struct sockaddr_in sinhim;	/* transmitter: address of the receiver */
+	ttcp_stream *streams;
+};
+
+static const int one = 1;		/* for 4.3 BSD style setsockopt() */
+
+static void initialize_run(ttcp_run *run)
+{
+	memset(run, 0, sizeof(*run));
+	run->buflen = 8 * 1024;
+	run->nbuf = 2 * 1024;
+	run->bufalign = 16*1024;
+	run->port = 5001;
+	run->fmt = 'K';
+	run->nstreams = 1;
+	run->batch = TTCP_UDP_BATCH;
+	run->output = 't';
+}
+
+static const char Usage[] = "\
+Usage: ttcp -t [-options] host [ < in ]\n\
+       ttcp -r [-options > out]\n\
+Common options:\n\
+	-l ##	length of bufs read from or written to network (default 8192)\n\
+	-u	use UDP instead of TCP\n\
+	-p ##	port number to send to or listen at (default 5001)\n\
+	-s	-t: source a pattern to network\n\
+		-r: sink (discard) all data from network\n\
+	-A	align the start of buffers to this modulus (default 16384)\n\
+	-O	start buffers at this offset from the modulus (default 0)\n\
+	-v	verbose: print more statistics\n\
+	-i ##	report the throughput every ## seconds\n\
+	-o X	output: text (default), json (one object per line) or csv\n\
+	-d	set SO_DEBUG socket option\n\
+	-b ##	set socket buffer size (if supported)\n\
+	-f X	format for rate: k,K = kilo{bit,byte}; m,M = mega; g,G = giga\n\
+	-P ##	number of parallel streams, needs -s; stream i uses port + i\n\
+	-a ##,##	run stream i on the i-th CPU of the list (modulo its length)\n\
+	-R ##[,##]	request/response mode with these request and response\n\
+		sizes (default response size is the request size)\n\
+	-k ##	for -u -s, datagrams per system call (default %d, max %d)\n\
+	-L ##[k|m|g][p][,##]	limit the rate to ## bits/sec, with p to ## buffers\n\
+		(datagrams, requests) per second, optionally allow bursts of\n\
+		## buffers; k, m and g as for -f, the streams share the rate\n\
+	-C ##	open, exchange ## bytes and close TCP connections in a loop,\n\
+		report connections/sec, connect times and failures (both sides)\n\
+	-V	verify the payload over TCP: -t sends numbered blocks with a\n\
+		CRC32C, -r checks them (both sides need -V and the same -l)\n\
+Options specific to -t:\n\
+	-n##	number of source bufs written to network (default 2048)\n\
+		for -R, the number of requests\n\
+	-F file	send the file with sendfile() instead of a pattern, with -w\n\
+		the file is sent again until the time is up\n\
+	-Z	for -s over TCP, send without copying the buffer if the stack\n\
+		supports it; also for -r, discard the data without copying it\n\
+		(-F and -Z report a copying fallback where they copy anyway)\n\
+	-w ##	for -s or -R, transmit for ## seconds instead of -n\n\
+	-D	don't buffer TCP writes (sets TCP_NODELAY socket option)\n\
+		for -R, use it also with -r\n\
+Options specific to -r:\n\
+	-B	for -s, only output full blocks as specified by -l (for TAR)\n\
+	-S ##	for -s or -R over TCP, keep serving senders, up to ## at a time,\n\
+		each in its own task; the results are logged\n\
+	-K	stop serving the port given by -p\n\
+	-T	\"touch\": access each byte as it's read\n\
+	-m ##	delay for specified milliseconds between each write\n\
+";
+
+static void err(ttcp_stream *, const char *);
+static void mes(const ttcp_stream *, const char *);
+static void pattern(char *, int);
+static void prep_timer(ttcp_stream *);
+static double read_timer(ttcp_stream *);
+static int Nread(ttcp_stream *, void *, int);
+static int Nwrite(ttcp_stream *, void *, int);
+static void delay(int);
+static int mread(ttcp_stream *, char *, unsigned);
+static char *outfmt(const ttcp_run *, double, char *, size_t);
+static int thread_cputime(struct timespec *);
+static void sleep_ns(uint64_t);
+static double tvdiff(const struct timeval *, const struct timeval *);
+
+static void millisleep(long msec)
+{
+#if defined(ENABLE_NANOSLEEP_DELAY)
+  struct timespec req;
+
+  req.tv_sec = msec / 1000;
+  req.tv_nsec = (msec % 1000) * 1000000;
+
+  nanosleep( &req, NULL );
+#endif
+}
+
+/* Only a stream running in the calling task may print */
+static int can_print(const ttcp_stream *s)
+{
+	return !s->run->threaded;
+}
+
+/* Publishes the counters of the stream for the interval reports */
+static void progress(ttcp_stream *s)
+{
+	if (s->run->interval_ns != 0) {
+		atomic_store_explicit(&s->progress_bytes,
+		    (uint_least64_t)s->nbytes, memory_order_relaxed);
+		atomic_store_explicit(&s->progress_calls, s->numCalls,
+		    memory_order_relaxed);
+	}
+}
+
+static const char *role(const ttcp_run *run)
+{
+	return run->trans ? "-t" : "-r";
+}
+
+static int parse_cpus(ttcp_run *run, const char *list)
+{
+	char *end;
+
+	run->ncpus = 0;
+	do {
+		long cpu = strtol(list, &end, 10);
+
+		if (end == list || cpu < 0 || run->ncpus == TTCP_MAX_CPUS)
+			return -1;
+		run->cpus[run->ncpus++] = (int)cpu;
+		list = end + 1;
+	} while (*end == ',');
+
+	return *end == '\0' ? 0 : -1;
+}
+
+static int parse_rr(ttcp_run *run, const char *sizes)
+{
+	char *end;
+
+	run->rr = 1;
+	run->rr_request = (int)strtol(sizes, &end, 10);
+	if (*end == ',')
+		run->rr_response = (int)strtol(end + 1, &end, 10);
+	else
+		run->rr_response = run->rr_request;
+
+	return (*end == '\0' && run->rr_request > 0 && run->rr_response > 0) ?
+	    0 : -1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/* Counts down the buffers or requests, with -w checks the deadline */
+static int keep_going(const ttcp_run *run, long *count, uint64_t deadline)
+{
+	if (run->duration > 0)
+		return now_ns() < deadline;
+	return (*count)-- > 0;
+}
+
+static int parse_rate(ttcp_run *run, const char *rate)
+{
+	char *end;
+
+	run->rate = strtod(rate, &end);
+	switch (*end) {
+	case 'g':
+		run->rate *= 1024.0;
+		/* Fall through */
+	case 'm':
+		run->rate *= 1024.0;
+		/* Fall through */
+	case 'k':
+		run->rate *= 1024.0;
+		++end;
+		break;
+	}
+	if (*end == 'p') {
+		run->rate_buffers = 1;
+		++end;
+	}
+	if (*end == ',') {
+		run->rate_burst = (int)strtol(end + 1, &end, 10);
+		if (run->rate_burst < 1)
+			return -1;
+	}
+
+	return (*end == '\0' && run->rate > 0.0) ? 0 : -1;
+}
+
+static void bucket_init(ttcp_stream *s)
+{
+	const ttcp_run *run = s->run;
+	ttcp_bucket *b = &s->bucket;
+	double buffer;
+
+	if (run->rate <= 0.0 || !run->trans)
+		return;
+
+	/* Tokens are bits or buffers */
+	buffer = run->rate_buffers ? 1.0 :
+	    8.0 * (run->rr ? run->rr_request : run->buflen);
+	b->ns_per_token = 1e9 * run->nstreams / run->rate;
+	if (run->rate_burst > 0)
+		b->burst_ns = (uint64_t)(run->rate_burst * buffer *
+		    b->ns_per_token);
+	else
+		b->burst_ns = TTCP_RATE_BURST_NS;
+	b->tat = 0;
+}
+
+/* Waits until the bucket holds the tokens for the bytes of n buffers */
+static void bucket_wait(ttcp_stream *s, double bytes, int n)
+{
+	const ttcp_run *run = s->run;
+	ttcp_bucket *b = &s->bucket;
+	uint64_t now;
+
+	if (b->ns_per_token == 0.0)
+		return;
+
+	now = now_ns();
+	if (b->tat < now)
+		b->tat = now;		/* the bucket is full */
+	while (b->tat > now + b->burst_ns) {
+		uint64_t wait = b->tat - b->burst_ns - now;
+
+		if (wait >= TTCP_RATE_SPIN_NS) {
+			struct timespec ts;
+
+			ts.tv_sec = (time_t)(wait / 1000000000);
+			ts.tv_nsec = (long)(wait % 1000000000);
+			(void)nanosleep(&ts, NULL);
+		}
+		now = now_ns();
+	}
+	b->tat += (uint64_t)((run->rate_buffers ? n : 8.0 * bytes) *
+	    b->ns_per_token);
+}
+
+static int hist_index(uint64_t v)
+{
+	int e;
+
+	if (v < 2 * TTCP_HIST_HALF)
+		return (int)v;
+	e = 63 - __builtin_clzll(v) - (TTCP_HIST_SUB_BITS - 1);
+	if (e >= TTCP_HIST_BUCKETS / TTCP_HIST_HALF - 1)
+		return TTCP_HIST_BUCKETS - 1;
+	return e * TTCP_HIST_HALF + (int)(v >> e);
+}
+
+/* Returns the highest value of the bucket */
+static uint64_t hist_value(int i)
+{
+	int e;
+
+	if (i < 2 * TTCP_HIST_HALF)
+		return (uint64_t)i;
+	e = i / TTCP_HIST_HALF - 1;
+	return ((uint64_t)(i - e * TTCP_HIST_HALF + 1) << e) - 1;
+}
+
+static void hist_record(ttcp_hist *h, uint64_t v)
+{
+	++h->counts[hist_index(v)];
+	if (h->count == 0 || v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->sum += v;
+	++h->count;
+}
+
+static void hist_merge(ttcp_hist *h, const ttcp_hist *other)
+{
+	int i;
+
+	if (other->count == 0)
+		return;
+	for (i = 0; i < TTCP_HIST_BUCKETS; ++i)
+		h->counts[i] += other->counts[i];
+	if (h->count == 0 || other->min < h->min)
+		h->min = other->min;
+	if (other->max > h->max)
+		h->max = other->max;
+	h->sum += other->sum;
+	h->count += other->count;
+}
+
+static uint64_t hist_percentile(const ttcp_hist *h, double q)
+{
+	unsigned long rank, seen = 0;
+	int i;
+
+	rank = (unsigned long)(q * h->count);
+	if (rank < q * h->count || rank == 0)
+		++rank;
+	for (i = 0; i < TTCP_HIST_BUCKETS; ++i) {
+		seen += h->counts[i];
+		if (seen >= rank)
+			break;
+	}
+	if (i == TTCP_HIST_BUCKETS || hist_value(i) > h->max)
+		return h->max;
+	return hist_value(i);
+}
+
+static int set_nodelay(ttcp_stream *s)
+{
+#ifdef TCP_NODELAY
+	struct protoent *p;
+	p = getprotobyname("tcp");
+	if( p && setsockopt(s->fd, p->p_proto, TCP_NODELAY,
+	    &one, sizeof(one)) < 0)  {
+		err(s, "setsockopt: nodelay");
+		return 1;
+	}
+	mes(s, "nodelay");
+#endif
+	return 0;
+}
+
+/*
+ * Waits for the response to the UDP request seq.  Returns its length, 0 if
+ * it is lost, or -1 on error.  The first four bytes of a response echo the
+ * ones of the request, so a late response to an earlier request is skipped.
+ */
+static int rr_udp_response(ttcp_stream *s, uint32_t seq)
+{
+	const ttcp_run *run = s->run;
+	uint32_t echoed;
+	int cnt;
+
+	for (;;) {
+		cnt = recv(s->fd, s->buf, run->rr_response, 0);
+		s->numCalls++;
+		if (cnt < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				errno = 0;
+				return 0;
+			}
+			return -1;
+		}
+		if (cnt < (int)sizeof(echoed))
+			return cnt;
+		memcpy(&echoed, s->buf, sizeof(echoed));
+		if (echoed == seq)
+			return cnt;
+	}
+}
+
+/*
+ * Sends the requests and records the time until the complete response is
+ * received.
+ */
+static int rr_transmit(ttcp_stream *s)
+{
+	const ttcp_run *run = s->run;
+	uint64_t deadline = now_ns() + (uint64_t)run->duration * 1000000000;
+	long count = run->nbuf;
+	uint32_t seq = 0;
+
+	if (run->udp) {
+		struct timeval tv;
+
+		tv.tv_sec = TTCP_RR_TIMEOUT_MS / 1000;
+		tv.tv_usec = (TTCP_RR_TIMEOUT_MS % 1000) * 1000;
+		if (setsockopt(s->fd, SOL_SOCKET, SO_RCVTIMEO, &tv,
+		    sizeof(tv)) < 0) {
+			err(s, "setsockopt: rcvtimeo");
+			return 1;
+		}
+	}
+
+	while (keep_going(run, &count, deadline)) {
+		uint64_t t0;
+		int cnt;
+
+		++seq;
+		memcpy(s->buf, &seq, sizeof(seq));
+		bucket_wait(s, run->rr_request, 1);
+		t0 = now_ns();
+		if (Nwrite(s, s->buf, run->rr_request) != run->rr_request) {
+			err(s, "IO");
+			return 1;
+		}
+		if (run->udp)
+			cnt = rr_udp_response(s, seq);
+		else
+			cnt = mread(s, s->buf, run->rr_response);
+		if (cnt < 0) {
+			err(s, "IO");
+			return 1;
+		}
+		if (cnt == 0 && run->udp) {
+			++s->lost;
+			continue;
+		}
+		if (cnt != run->rr_response && !run->udp) {
+			errno = ECONNRESET;	/* receiver closed the connection */
+			err(s, "IO");
+			return 1;
+		}
+		hist_record(&s->rtt, now_ns() - t0);
+		s->nbytes += run->rr_request + cnt;
+		++s->transactions;
+		progress(s);
+	}
+	return 0;
+}
+
+/*
+ * Answers each request with a response until the transmitter closes the
+ * connection or sends the UDP end sentinel.  Nothing is printed here, the
+ * response is sent right after the request is complete.
+ */
+static int rr_receive(ttcp_stream *s)
+{
+	const ttcp_run *run = s->run;
+	int cnt;
+
+	if (run->udp) {
+		struct sockaddr_in from;
+		socklen_t len;
+
+		for (;;) {
+			len = sizeof(from);
+			cnt = recvfrom(s->fd, s->buf, run->rr_request, 0,
+			    (struct sockaddr *)&from, &len);
+			s->numCalls++;
+			if (cnt < 0) {
+				err(s, "IO");
+				return 1;
+			}
+			if (cnt <= 4 && s->going)
+				break;	/* "EOF" */
+			if (!s->going) {
+				s->going = 1;
+				s->peer = from;
+				prep_timer(s);
+			}
+			if (cnt <= 4)
+				continue;
+			s->numCalls++;
+			if (sendto(s->fd, s->buf, run->rr_response, 0,
+			    (struct sockaddr *)&from, len) < 0) {
+				if (errno != ENOBUFS) {
+					err(s, "IO");
+					return 1;
+				}
+				continue;	/* the transmitter sees a loss */
+			}
+			s->nbytes += cnt + run->rr_response;
+			++s->transactions;
+			progress(s);
+		}
+	} else {
+		while ((cnt = mread(s, s->buf, run->rr_request)) ==
+		    run->rr_request) {
+			if (Nwrite(s, s->buf, run->rr_response) !=
+			    run->rr_response) {
+				err(s, "IO");
+				return 1;
+			}
+			s->nbytes += cnt + run->rr_response;
+			++s->transactions;
+			progress(s);
+		}
+		if (cnt < 0) {
+			err(s, "IO");
+			return 1;
+		}
+	}
+	errno = 0;
+	return 0;
+}
+
+/*
+ * Doubles the delay between UDP sends after a send failed with ENOBUFS and
+ * waits before the retry.
+ */
+static void pace_backoff(ttcp_stream *s)
+{
+	++s->enobufs;
+	if (s->pace_us < TTCP_PACE_MIN_US)
+		s->pace_us = TTCP_PACE_MIN_US;
+	else if (s->pace_us < TTCP_PACE_MAX_US / 2)
+		s->pace_us *= 2;
+	else
+		s->pace_us = TTCP_PACE_MAX_US;
+	delay((int)s->pace_us);
+}
+
+/* Waits the delay between UDP sends and shrinks it while sends succeed */
+static void pace(ttcp_stream *s)
+{
+	if (s->pace_us != 0) {
+		delay((int)s->pace_us);
+		s->pace_us -= s->pace_us / 8 + 1;
+	}
+}
+
+static int batch_alloc(ttcp_stream *s)
+{
+	const ttcp_run *run = s->run;
+	ttcp_batch *b;
+	int i;
+
+	b = calloc(1, sizeof(*b));
+	if (b == NULL)
+		return -1;
+	s->batch = b;
+
+	for (i = 0; i < run->batch; ++i) {
+		struct msghdr *m = &b->msg[i].msg_hdr;
+
+		if (run->trans) {
+			b->iov[i][0].iov_base = &b->head[i];
+			b->iov[i][0].iov_len = sizeof(b->head[i]);
+			b->iov[i][1].iov_base = s->buf + sizeof(b->head[i]);
+			b->iov[i][1].iov_len = run->buflen - sizeof(b->head[i]);
+			m->msg_name = &s->sinhim;
+			m->msg_namelen = sizeof(s->sinhim);
+			m->msg_iovlen = 2;
+		} else {
+			if (b->data == NULL) {
+				b->data = malloc((size_t)run->batch * run->buflen);
+				if (b->data == NULL)
+					return -1;
+			}
+			b->iov[i][0].iov_base = b->data + (size_t)i * run->buflen;
+			b->iov[i][0].iov_len = run->buflen;
+			m->msg_iovlen = 1;
+		}
+		m->msg_iov = b->iov[i];
+	}
+	return 0;
+}
+
+static void batch_free(ttcp_stream *s)
+{
+	if (s->batch != NULL) {
+		free(s->batch->data);
+		free(s->batch);
+		s->batch = NULL;
+	}
+}
+
+/* Returns the number of datagrams sent or -1 */
+static int send_batch(ttcp_stream *s, int first, int n)
+{
+	ttcp_batch *b = s->batch;
+#if defined(TTCP_HAVE_MMSG)
+	s->numCalls++;
+	return sendmmsg(s->fd, &b->msg[first], n, 0);
+#else
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		s->numCalls++;
+		if (sendmsg(s->fd, &b->msg[first + i].msg_hdr, 0) < 0)
+			return i > 0 ? i : -1;
+	}
+	return n;
+#endif
+}
+
+/* Returns the number of datagrams received or -1 */
+static int recv_batch(ttcp_stream *s)
+{
+	ttcp_batch *b = s->batch;
+#if defined(TTCP_HAVE_MMSG)
+	s->numCalls++;
+	return recvmmsg(s->fd, b->msg, s->run->batch, MSG_WAITFORONE, NULL);
+#else
+	ssize_t len;
+
+	s->numCalls++;
+	len = recvmsg(s->fd, &b->msg[0].msg_hdr, 0);
+	if (len < 0)
+		return -1;
+	b->msg[0].msg_len = (unsigned int)len;
+	return 1;
+#endif
+}
+
+/*
+ * Sends the buffers as datagrams with a sequence number and time stamp, the
+ * run->batch datagrams of a system call share the payload.
+ */
+static int udp_transmit(ttcp_stream *s, long *count, uint64_t deadline)
+{
+	const ttcp_run *run = s->run;
+	ttcp_batch *b = s->batch;
+	uint32_t seq = 0;
+	int done = 0;
+
+	while (!done) {
+		uint64_t stamp;
+		int i, n, sent;
+
+		for (n = 0; n < run->batch; ++n) {
+			if (!keep_going(run, count, deadline)) {
+				done = 1;
+				break;
+			}
+		}
+		stamp = now_ns();
+		for (i = 0; i < n; ++i) {
+			b->head[i].seq = htonl(seq++);
+			b->head[i].stamp_hi = htonl((uint32_t)(stamp >> 32));
+			b->head[i].stamp_lo = htonl((uint32_t)stamp);
+		}
+
+		bucket_wait(s, (double)n * run->buflen, n);
+		for (i = 0; i < n; i += sent) {
+			pace(s);
+			sent = send_batch(s, i, n - i);
+			if (sent < 0) {
+				if (errno != ENOBUFS)
+					return 1;
+				errno = 0;
+				pace_backoff(s);
+				sent = 0;
+			}
+		}
+		s->datagrams += n;
+		s->nbytes += (double)n * run->buflen;
+		progress(s);
+		millisleep( run->milliseconds );
+	}
+	return 0;
+}
+
+static void udp_account(ttcp_udp_stats *u, const ttcp_udp_header *head,
+    uint64_t now)
+{
+	uint32_t seq = ntohl(head->seq);
+	uint64_t stamp = ((uint64_t)ntohl(head->stamp_hi) << 32) |
+	    ntohl(head->stamp_lo);
+	int64_t transit, d;
+
+	if (seq >= u->next) {
+		uint32_t gap = seq - u->next;
+
+		if (gap >= TTCP_SEQ_WINDOW)
+			memset(u->window, 0, sizeof(u->window));
+		else
+			for (; u->next != seq; ++u->next)
+				u->window[(u->next % TTCP_SEQ_WINDOW) / 32] &=
+				    ~(1U << (u->next % 32));
+		u->next = seq + 1;
+	} else if (u->next - seq <= TTCP_SEQ_WINDOW) {
+		if (u->window[(seq % TTCP_SEQ_WINDOW) / 32] &
+		    (1U << (seq % 32))) {
+			++u->duplicates;
+			return;
+		}
+		++u->reordered;
+	} else {
+		++u->reordered;		/* too old to tell a duplicate */
+	}
+	u->window[(seq % TTCP_SEQ_WINDOW) / 32] |= 1U << (seq % 32);
+	++u->received;
+
+	/* The clock offset of the transmitter cancels out */
+	transit = (int64_t)(now - stamp);
+	if (u->received > 1) {
+		d = transit - u->transit;
+		if (d < 0)
+			d = -d;
+		u->jitter += ((double)d - u->jitter) / 16;
+	}
+	u->transit = transit;
+}
+
+/*
+ * Receives the datagrams of a -u -s transmitter until the end sentinel.  The
+ * datagrams of one system call share the arrival time.
+ */
+static int udp_receive(ttcp_stream *s)
+{
+	ttcp_batch *b = s->batch;
+
+	for (;;) {
+		uint64_t now;
+		int i, n;
+
+		n = recv_batch(s);
+		if (n < 0)
+			return 1;
+		now = now_ns();
+		for (i = 0; i < n; ++i) {
+			unsigned int len = b->msg[i].msg_len;
+			ttcp_udp_header head;
+
+			if (len <= 4) {
+				if (s->going)
+					return 0;	/* "EOF" */
+				s->going = 1;
+				prep_timer(s);
+				continue;
+			}
+			if (!s->going) {
+				s->going = 1;
+				prep_timer(s);
+			}
+			s->nbytes += len;
+			if (len >= sizeof(head)) {
+				memcpy(&head, b->iov[i][0].iov_base, sizeof(head));
+				udp_account(&s->udp, &head, now);
+			}
+		}
+		progress(s);
+	}
+}
+
+/*
+ * Sends the file in chunks of buflen.  Without sendfile(), the file is read
+ * into the buffer.
+ */
+static int file_transmit(ttcp_stream *s, uint64_t deadline)
+{
+	const ttcp_run *run = s->run;
+	struct stat st;
+	off_t off = 0;
+	int fd;
+
+	fd = open(run->file, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+		if (fd >= 0) {
+			errno = EINVAL;
+			close(fd);
+		}
+		return 1;
+	}
+
+	for (;;) {
+		size_t chunk;
+		ssize_t n;
+
+		if (off == st.st_size) {
+			if (run->duration == 0)
+				break;
+			off = 0;
+		}
+		if (run->duration > 0 && now_ns() >= deadline)
+			break;
+
+		chunk = (size_t)(st.st_size - off);
+		if (chunk > (size_t)run->buflen)
+			chunk = run->buflen;
+		bucket_wait(s, chunk, 1);
+#if defined(TTCP_HAVE_SENDFILE) && defined(__linux__)
+		n = sendfile(s->fd, fd, &off, chunk);
+#elif defined(TTCP_HAVE_SENDFILE)
+		{
+			off_t sbytes = 0;
+
+			if (sendfile(fd, s->fd, off, chunk, NULL, &sbytes, 0) != 0 &&
+			    sbytes == 0)
+				n = -1;
+			else
+				n = sbytes;
+		}
+		if (n > 0)
+			off += n;
+#else
+		n = pread(fd, s->buf, chunk, off);
+		if (n > 0)
+			n = write(s->fd, s->buf, (size_t)n);
+		if (n > 0)
+			off += n;
+#endif
+		s->numCalls++;
+		if (n <= 0) {
+			if (n == 0)
+				errno = EIO;
+			close(fd);
+			return 1;
+		}
+		s->nbytes += n;
+		progress(s);
+	}
+
+	close(fd);
+	return 0;
+}
+
+#if defined(TTCP_HAVE_MSG_ZEROCOPY)
+/*
+ * Counts the completed zero-copy sends.  The pattern never changes, so the
+ * buffer may be sent again before the previous sends completed.  With a
+ * timeout, waits for at least one completion.
+ */
+static int zerocopy_complete(ttcp_stream *s, int timeout_ms)
+{
+	char control[128];
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	struct pollfd pfd = { .fd = s->fd };
+
+	if (timeout_ms > 0 && poll(&pfd, 1, timeout_ms) < 0)
+		return -1;
+
+	for (;;) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		if (recvmsg(s->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			if (errno != EAGAIN)
+				return -1;
+			errno = 0;
+			return 0;
+		}
+		s->numCalls++;
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+		    cm = CMSG_NXTHDR(&msg, cm)) {
+			struct sock_extended_err *ee;
+			unsigned long n;
+
+			ee = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY ||
+			    ee->ee_errno != 0)
+				continue;
+			n = ee->ee_data - ee->ee_info + 1;
+			s->zc_sends += n;
+			if (ee->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				s->zc_copied += n;
+		}
+	}
+}
+
+static int zerocopy_transmit(ttcp_stream *s, long *count, uint64_t deadline)
+{
+	const ttcp_run *run = s->run;
+	unsigned long sent = 0;
+
+	if (setsockopt(s->fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) < 0)
+		return 1;
+
+	while (keep_going(run, count, deadline)) {
+		ssize_t n;
+
+		bucket_wait(s, run->buflen, 1);
+		n = send(s->fd, s->buf, run->buflen, MSG_ZEROCOPY);
+		s->numCalls++;
+		if (n < 0 && errno == ENOBUFS) {
+			/* Too many sends wait for completion */
+			if (zerocopy_complete(s, TTCP_ZEROCOPY_WAIT_MS) != 0)
+				return 1;
+			++*count;
+			continue;
+		}
+		if (n != run->buflen)
+			return 1;
+		s->nbytes += n;
+		++sent;
+		progress(s);
+		if ((sent % 64) == 0 && zerocopy_complete(s, 0) != 0)
+			return 1;
+	}
+	return zerocopy_complete(s, 0) != 0;
+}
+#endif
+
+#if RTEMS_NET_LWIP
+/*
+ * Waits until lwIP no longer refers to the buffer.  The receiver closes the
+ * connection once it got the end of the data, and the segment with its FIN
+ * acknowledges all the data sent, so lwIP has released the segments when
+ * the close is reported.  If the receiver does not close in time, the buffer
+ * is left allocated, since a retransmission could still read it.
+ */
+static void netconn_drain(ttcp_stream *s, struct netconn *conn)
+{
+	struct netbuf *nb;
+	err_t e;
+
+	netconn_shutdown(conn, 0, 1);
+#if LWIP_SO_RCVTIMEO
+	netconn_set_recvtimeout(conn, TTCP_NOCOPY_DRAIN_MS);
+#endif
+	while ((e = netconn_recv(conn, &nb)) == ERR_OK)
+		netbuf_delete(nb);
+	if (e == ERR_TIMEOUT) {
+		mes(s, "receiver did not close, keeping the buffer");
+		s->alloc_buf = NULL;
+	}
+}
+
+/*
+ * Sends the pattern through a netconn with NETCONN_NOCOPY instead of the
+ * socket, so that lwIP refers to the buffer until the data is acknowledged.
+ * The buffer is not changed during the transfer and stays allocated until
+ * netconn_drain() returns.
+ */
+static int netconn_transmit(ttcp_stream *s)
+{
+	const ttcp_run *run = s->run;
+	uint64_t deadline = now_ns() + (uint64_t)run->duration * 1000000000;
+	ip_addr_t addr = IPADDR4_INIT(s->sinhim.sin_addr.s_addr);
+	long nbuf = run->nbuf;
+	struct netconn *conn;
+	err_t e;
+
+	pattern( s->buf, run->buflen );
+	conn = netconn_new(NETCONN_TCP);
+	if (conn == NULL) {
+		errno = ENOMEM;
+		err(s, "netconn_new");
+		return 1;
+	}
+	e = netconn_connect(conn, &addr, ntohs(s->sinhim.sin_port));
+	if (e != ERR_OK) {
+		netconn_delete(conn);
+		errno = err_to_errno(e);
+		err(s, "netconn_connect");
+		return 1;
+	}
+	mes(s, "netconn");
+
+	prep_timer(s);
+	while (keep_going(run, &nbuf, deadline)) {
+		bucket_wait(s, run->buflen, 1);
+		e = netconn_write(conn, s->buf, run->buflen, NETCONN_NOCOPY);
+		s->numCalls++;
+		if (e != ERR_OK)
+			break;
+		s->nbytes += run->buflen;
+		progress(s);
+	}
+	(void)read_timer(s);
+	if (e == ERR_OK)
+		netconn_drain(s, conn);
+	else
+		s->alloc_buf = NULL;	/* queued segments may refer to it */
+	netconn_close(conn);
+	netconn_delete(conn);
+	if (e != ERR_OK) {
+		errno = err_to_errno(e);
+		err(s, "netconn_write");
+		return 1;
+	}
+
+	if( s->cput <= 0.0 )  s->cput = 0.001;
+	if( s->realt <= 0.0 )  s->realt = 0.001;
+	return 0;
+}
+#endif
+
+/* CRC32C (Castagnoli), reflected, processed four bytes at a time */
+#define TTCP_CRC32C_POLY	0x82f63b78
+#define TTCP_VERIFY_MIN		8	/* one pattern word and the CRC */
+
+static uint32_t crc32c_table[4][256];
+
+static void crc32c_init(void)
+{
+	uint32_t c;
+	int i, j;
+
+	for (i = 0; i < 256; ++i) {
+		c = i;
+		for (j = 0; j < 8; ++j)
+			c = (c >> 1) ^ (TTCP_CRC32C_POLY & (0 - (c & 1)));
+		crc32c_table[0][i] = c;
+	}
+	for (i = 0; i < 256; ++i) {
+		c = crc32c_table[0][i];
+		for (j = 1; j < 4; ++j) {
+			c = (c >> 8) ^ crc32c_table[0][c & 0xff];
+			crc32c_table[j][i] = c;
+		}
+	}
+}
+
+static uint32_t crc32c(const unsigned char *p, size_t len)
+{
+	uint32_t c = 0xffffffff;
+
+	for (; len >= 4; len -= 4, p += 4) {
+		c ^= (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+		    ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+		c = crc32c_table[3][c & 0xff] ^
+		    crc32c_table[2][(c >> 8) & 0xff] ^
+		    crc32c_table[1][(c >> 16) & 0xff] ^
+		    crc32c_table[0][c >> 24];
+	}
+	while (len-- > 0)
+		c = (c >> 8) ^ crc32c_table[0][(c ^ *p++) & 0xff];
+	return ~c;
+}
+
+/* Returns the pattern word at the index of the block */
+static uint32_t verify_word(uint64_t block, uint32_t index)
+{
+	uint32_t x = (uint32_t)block ^ (uint32_t)(block >> 32) ^
+	    (index * 0x9e3779b1U);
+
+	x *= 0x85ebca77U;
+	return x ^ (x >> 16);
+}
+
+/* Returns the pattern byte at the offset of the block */
+static unsigned char verify_byte(uint64_t block, size_t offset)
+{
+	uint32_t w = verify_word(block, (uint32_t)(offset / 4));
+
+	return (unsigned char)(w >> (24 - 8 * (offset % 4)));
+}
+
+/* The CPU time of the thread if available, otherwise the monotonic clock */
+static uint64_t verify_clock(void)
+{
+	struct timespec ts;
+
+	if (thread_cputime(&ts) != 0)
+		return now_ns();
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Fills the buffer with the next block */
+static void verify_fill(ttcp_stream *s)
+{
+	ttcp_verify *v = &s->verify;
+	unsigned char *p = (unsigned char *)s->buf;
+	size_t len = s->run->buflen - 4;
+	uint64_t t0 = verify_clock();
+	uint32_t crc, i;
+
+	for (i = 0; i < len / 4; ++i) {
+		uint32_t w = htonl(verify_word(v->blocks, i));
+
+		memcpy(p + 4 * i, &w, sizeof(w));
+	}
+	for (i *= 4; i < len; ++i)
+		p[i] = verify_byte(v->blocks, i);
+	crc = htonl(crc32c(p, len));
+	memcpy(p + len, &crc, sizeof(crc));
+	++v->blocks;
+	v->cpu_ns += verify_clock() - t0;
+}
+
+/*
+ * Checks the complete block in the buffer.  The CRC catches the corruption,
+ * the pattern is only compared to find the offset, or if the CRC is right to
+ * detect a block with the wrong number.
+ */
+static void verify_check(ttcp_stream *s)
+{
+	ttcp_verify *v = &s->verify;
+	const unsigned char *p = (const unsigned char *)s->buf;
+	size_t len = s->run->buflen - 4;
+	uint64_t t0 = verify_clock();
+	uint32_t crc, w;
+	size_t i;
+
+	memcpy(&crc, p + len, sizeof(crc));
+	memcpy(&w, p, sizeof(w));
+	if (ntohl(crc) != crc32c(p, len) ||
+	    ntohl(w) != verify_word(v->blocks, 0)) {
+		for (i = 0; i < len; ++i)
+			if (p[i] != verify_byte(v->blocks, i))
+				break;
+		if (i == len) {
+			/* Bad CRC */
+			crc = htonl(crc32c(p, len));
+			while (p[i] == ((unsigned char *)&crc)[i - len])
+				++i;
+		}
+		if (v->corrupt++ == 0)
+			v->offset = v->blocks * s->run->buflen + i;
+	}
+	++v->blocks;
+	v->cpu_ns += verify_clock() - t0;
+}
+
+/* Sends the numbered blocks */
+static int verify_transmit(ttcp_stream *s, long *count, uint64_t deadline)
+{
+	const ttcp_run *run = s->run;
+
+	while (keep_going(run, count, deadline)) {
+		verify_fill(s);
+		bucket_wait(s, run->buflen, 1);
+		if (Nwrite(s, s->buf, run->buflen) != run->buflen)
+			return 1;
+		s->nbytes += run->buflen;
+		progress(s);
+		millisleep( run->milliseconds );
+	}
+	return 0;
+}
+
+/* Receives and checks the blocks, the data is read block by block */
+static int verify_receive(ttcp_stream *s)
+{
+	ttcp_verify *v = &s->verify;
+	int buflen = s->run->buflen;
+	int cnt;
+
+	while ((cnt = read(s->fd, s->buf + v->fill, buflen - v->fill)) > 0) {
+		s->numCalls++;
+		s->nbytes += cnt;
+		v->fill += cnt;
+		if (v->fill == buflen) {
+			verify_check(s);
+			v->fill = 0;
+		}
+		progress(s);
+	}
+	s->numCalls++;
+	if (cnt == 0 && v->fill != 0) {
+		/* The transmitter sends only complete blocks */
+		if (v->corrupt++ == 0)
+			v->offset = v->blocks * buflen + v->fill;
+	}
+	return cnt < 0;
+}
+
+/* Drains the connection, the data is discarded by the stack if possible */
+static int nocopy_receive(ttcp_stream *s)
+{
+	const ttcp_run *run = s->run;
+	ssize_t cnt;
+
+	for (;;) {
+#if defined(TTCP_HAVE_MSG_TRUNC)
+		cnt = recv(s->fd, NULL, run->buflen, MSG_TRUNC);
+#else
+		cnt = read(s->fd, s->buf, run->buflen);
+#endif
+		s->numCalls++;
+		if (cnt <= 0)
+			return cnt < 0;
+		s->nbytes += cnt;
+		progress(s);
+	}
+}
+
+/* Like set_nodelay() without recording the error */
+static int conn_nodelay(ttcp_stream *s)
+{
+#ifdef TCP_NODELAY
+	return setsockopt(s->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#else
+	return 0;
+#endif
+}
+
+/* Counts a failed connection attempt and backs off */
+static void conn_failed(ttcp_stream *s, int error)
+{
+	int class;
+
+	switch (error) {
+	case EADDRNOTAVAIL:
+	case EADDRINUSE:
+		class = TTCP_CONN_PORTS;
+		break;
+	case EMFILE:
+	case ENFILE:
+		class = TTCP_CONN_FILES;
+		break;
+	case ENOBUFS:
+	case ENOMEM:
+		class = TTCP_CONN_BUFFERS;
+		break;
+	case ECONNREFUSED:
+	case ECONNRESET:
+	case ECONNABORTED:
+	case ETIMEDOUT:
+	case EPIPE:
+		class = TTCP_CONN_PEER;
+		break;
+	default:
+		class = TTCP_CONN_OTHER;
+		break;
+	}
+	++s->conn_errors[class];
+	if (s->fd >= 0) {
+		close(s->fd);
+		s->fd = -1;
+	}
+	if (class != TTCP_CONN_PEER)
+		sleep_ns(TTCP_CONN_BACKOFF_NS);
+}
+
+/*
+ * Opens a connection, exchanges the bytes and closes it until the count or
+ * time is done.  The connect times are recorded.  The transmitter closes
+ * first, so the connections in TIME_WAIT are on this side.
+ */
+static int conn_transmit(ttcp_stream *s)
+{
+	const ttcp_run *run = s->run;
+	uint64_t deadline = now_ns() + (uint64_t)run->duration * 1000000000;
+	long nconn = run->nbuf;
+	int bytes = run->conn_bytes;
+
+	bucket_init(s);
+	pattern( s->buf, run->buflen );
+	prep_timer(s);
+	while (keep_going(run, &nconn, deadline)) {
+		uint64_t t0;
+
+		bucket_wait(s, bytes, 1);
+		t0 = now_ns();
+		s->fd = socket(AF_INET, SOCK_STREAM, 0);
+		s->numCalls++;
+		if (s->fd < 0) {
+			conn_failed(s, errno);
+			continue;
+		}
+		if (run->nodelay && conn_nodelay(s) != 0) {
+			conn_failed(s, errno);
+			continue;
+		}
+		s->numCalls++;
+		if (connect(s->fd, (struct sockaddr *)&s->sinhim,
+		    sizeof(s->sinhim)) < 0) {
+			conn_failed(s, errno);
+			continue;
+		}
+		hist_record(&s->rtt, now_ns() - t0);
+		if (bytes > 0 && (Nwrite(s, s->buf, bytes) != bytes ||
+		    mread(s, s->buf, bytes) != bytes)) {
+			conn_failed(s, errno != 0 ? errno : ECONNRESET);
+			continue;
+		}
+		s->numCalls++;
+		if (close(s->fd) < 0) {
+			s->fd = -1;
+			conn_failed(s, errno);
+			continue;
+		}
+		s->fd = -1;
+		s->nbytes += bytes;
+		++s->transactions;
+		progress(s);
+	}
+	(void)read_timer(s);
+	errno = 0;
+
+	if( s->cput <= 0.0 )  s->cput = 0.001;
+	if( s->realt <= 0.0 )  s->realt = 0.001;
+	return 0;
+}
+
+/*
+ * Accepts the connections one at a time, echoes the bytes and waits for the
+ * transmitter to close.  The run starts with the first connection and ends
+ * if no connection arrived for TTCP_CONN_IDLE_MS.
+ */
+static int conn_receive(ttcp_stream *s)
+{
+	const ttcp_run *run = s->run;
+	int bytes = run->conn_bytes;
+	struct timeval last;
+	int listen_fd;
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		err(s, "socket");
+		return 1;
+	}
+	s->fd = listen_fd;
+	if (setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one,
+	    sizeof(one)) < 0 || bind(listen_fd, (struct sockaddr *)&s->sinme,
+	    sizeof(s->sinme)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+		err(s, "listen");
+		return 1;
+	}
+	s->fd = -1;
+	mes(s, "listen");
+
+	for (;;) {
+		struct timeval tv = { TTCP_CONN_IDLE_MS / 1000,
+		    (TTCP_CONN_IDLE_MS % 1000) * 1000 };
+		socklen_t len;
+		fd_set set;
+		int cnt;
+
+		FD_ZERO(&set);
+		FD_SET(listen_fd, &set);
+		cnt = select(listen_fd + 1, &set, NULL, NULL,
+		    s->transactions > 0 ? &tv : NULL);
+		if (cnt < 0 && errno != EINTR) {
+			s->fd = listen_fd;
+			err(s, "select");
+			return 1;
+		}
+		if (cnt == 0)
+			break;
+		if (cnt < 0)
+			continue;
+
+		len = sizeof(s->peer);
+		s->fd = accept(listen_fd, (struct sockaddr *)&s->peer, &len);
+		s->numCalls++;
+		if (s->fd < 0) {
+			conn_failed(s, errno);
+			continue;
+		}
+		if (s->transactions == 0 &&
+		    s->conn_errors[TTCP_CONN_FILES] == 0 &&
+		    s->conn_errors[TTCP_CONN_BUFFERS] == 0)
+			prep_timer(s);
+		if (run->nodelay && conn_nodelay(s) != 0) {
+			conn_failed(s, errno);
+			continue;
+		}
+		if (bytes > 0 && (mread(s, s->buf, bytes) != bytes ||
+		    Nwrite(s, s->buf, bytes) != bytes)) {
+			conn_failed(s, errno != 0 ? errno : ECONNRESET);
+			continue;
+		}
+		while ((cnt = Nread(s, s->buf, run->buflen)) > 0)
+			;
+		s->numCalls++;
+		close(s->fd);
+		s->fd = -1;
+		s->nbytes += bytes;
+		++s->transactions;
+		gettimeofday(&last, NULL);
+		progress(s);
+	}
+	close(listen_fd);
+
+	(void)read_timer(s);
+	if (s->transactions > 0) {
+		s->time1 = last;
+		s->realt = tvdiff(&s->time1, &s->time0);
+	}
+	errno = 0;
+
+	if( s->cput <= 0.0 )  s->cput = 0.001;
+	if( s->realt <= 0.0 )  s->realt = 0.001;
+	return 0;
+}
+
+static int stream_transfer(ttcp_stream *);
+
+static int stream_buffers(ttcp_stream *s)
+{
+	ttcp_run *run = s->run;
+
+	if ( (s->buf = (char *)malloc(run->buflen+run->bufalign)) == (char *)NULL)  {
+		err(s, "malloc");
+		return 1;
+	}
+	s->alloc_buf = s->buf;
+	if (run->bufalign != 0)
+		s->buf +=(run->bufalign - ((intptr_t)s->buf % run->bufalign) +
+		    run->bufoffset) % run->bufalign;
+
+	if (run->udp && run->sinkmode && !run->rr && batch_alloc(s) != 0) {
+		err(s, "malloc");
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Sets up the connection of the stream, moves the data and closes the
+ * connection.  Returns 0 on success, otherwise the error is recorded in the
+ * stream.
+ */
+static int stream_run(ttcp_stream *s)
+{
+	ttcp_run *run = s->run;
+
+	if (stream_buffers(s) != 0)
+		return 1;
+
+	s->sinme.sin_family = AF_INET;
+	if (run->trans) {
+		s->sinhim = run->sinhim;
+		s->sinhim.sin_port = htons(run->port + s->index);
+		s->sinme.sin_port = 0;		/* free choice */
+	} else {
+		s->sinme.sin_port =  htons(run->port + s->index);
+	}
+
+#if RTEMS_NET_LWIP
+	if (run->zerocopy && run->trans && !run->udp && run->file == NULL)
+		return netconn_transmit(s);
+#endif
+	if (run->conn)
+		return run->trans ? conn_transmit(s) : conn_receive(s);
+
+	if ((s->fd = socket(AF_INET, run->udp?SOCK_DGRAM:SOCK_STREAM, 0)) < 0)  {
+		err(s, "socket");
+		return 1;
+	}
+	mes(s, "socket");
+
+	if (bind(s->fd, (struct sockaddr *) &s->sinme, sizeof(s->sinme)) < 0)  {
+		err(s, "bind");
+		return 1;
+	}
+
+#if defined(SO_SNDBUF) || defined(SO_RCVBUF)
+	if (run->sockbufsize) {
+	    if (run->trans) {
+		if (setsockopt(s->fd, SOL_SOCKET, SO_SNDBUF, &run->sockbufsize,
+		    sizeof run->sockbufsize) < 0)  {
+			err(s, "setsockopt: sndbuf");
+			return 1;
+		}
+		mes(s, "sndbuf");
+	    } else {
+		if (setsockopt(s->fd, SOL_SOCKET, SO_RCVBUF, &run->sockbufsize,
+		    sizeof run->sockbufsize) < 0)  {
+			err(s, "setsockopt: rcvbuf");
+			return 1;
+		}
+		mes(s, "rcvbuf");
+	    }
+	}
+#endif
+
+	if (!run->udp)  {
+#if 0
+	    signal(SIGPIPE, sigpipe);
+#endif
+	    if (run->trans) {
+		/* We are the client if transmitting */
+		if (run->options)  {
+#if defined(BSD42)
+			if( setsockopt(s->fd, SOL_SOCKET, run->options, 0, 0) < 0)  {
+#else /* BSD43 */
+			if( setsockopt(s->fd, SOL_SOCKET, run->options, &one, sizeof(one)) < 0)  {
+#endif
+				err(s, "setsockopt");
+				return 1;
+			}
+		}
+		if (run->nodelay && set_nodelay(s) != 0)
+			return 1;
+		if(connect(s->fd, (struct sockaddr *) &s->sinhim,
+		    sizeof(s->sinhim) ) < 0)  {
+			err(s, "connect");
+			return 1;
+		}
+		mes(s, "connect");
+	    } else {
+		struct sockaddr_in frominet;
+		socklen_t fromlen;
+		int fd_list;
+
+		/* otherwise, we are the server and
+	         * should listen for the connections
+	         */
+#if defined(ultrix) || defined(sgi)
+		listen(s->fd,1);   /* workaround for alleged u4.2 bug */
+#else
+		listen(s->fd,0);   /* allow a queue of 0 */
+#endif
+		if(run->options)  {
+#if defined(BSD42)
+			if( setsockopt(s->fd, SOL_SOCKET, run->options, 0, 0) < 0)  {
+#else /* BSD43 */
+			if( setsockopt(s->fd, SOL_SOCKET, run->options, &one, sizeof(one)) < 0)  {
+#endif
+				err(s, "setsockopt");
+				return 1;
+			}
+		}
+		fromlen = sizeof(frominet);
+		fd_list = s->fd;
+		if((s->fd=accept(fd_list, (struct sockaddr *) &frominet,
+		    &fromlen) ) < 0)  {
+			s->fd = fd_list;
+			err(s, "accept");
+			return 1;
+		}
+
+		if(close(fd_list) < 0)  {
+			err(s, "close");
+			return 1;
+		}
+
+		{ socklen_t peerlen = sizeof(s->peer);
+		  if (getpeername(s->fd, (struct sockaddr *) &s->peer,
+				&peerlen) < 0) {
+			err(s, "getpeername");
+			return 1;
+		  }
+		  if (can_print(s))
+			fprintf(stderr,"ttcp-r: accept from %s\n",
+			    inet_ntoa(s->peer.sin_addr));
+		}
+		/* The responses of -R are small writes as well */
+		if (run->rr && run->nodelay && set_nodelay(s) != 0)
+			return 1;
+	    }
+	}
+	return stream_transfer(s);
+}
+
+/* Moves the data over the connected socket and closes it */
+static int stream_transfer(ttcp_stream *s)
+{
+	ttcp_run *run = s->run;
+	int buflen = run->buflen;
+	long nbuf = run->nbuf;
+
+	bucket_init(s);
+	prep_timer(s);
+	errno = 0;
+	if (run->rr) {
+		pattern( s->buf, buflen );
+		if ((run->trans ? rr_transmit(s) : rr_receive(s)) != 0)
+			return 1;
+	} else if (run->sinkmode) {
+		register int cnt;
+		if (run->trans)  {
+			uint64_t deadline = now_ns() +
+			    (uint64_t)run->duration * 1000000000;
+
+			pattern( s->buf, buflen );
+			if(run->udp)  {
+			    (void)Nwrite( s, s->buf, 4 ); /* rcvr start */
+			    (void)udp_transmit(s, &nbuf, deadline);
+			    (void)Nwrite( s, s->buf, 4 ); /* rcvr end */
+			} else if (run->verify) {
+			    (void)verify_transmit(s, &nbuf, deadline);
+			} else if (run->file != NULL) {
+			    (void)file_transmit(s, deadline);
+#if defined(TTCP_HAVE_MSG_ZEROCOPY)
+			} else if (run->zerocopy) {
+			    (void)zerocopy_transmit(s, &nbuf, deadline);
+#endif
+			} else {
+			    while (keep_going(run, &nbuf, deadline)) {
+				    bucket_wait(s, buflen, 1);
+				    if (Nwrite(s,s->buf,buflen) != buflen)
+					    break;
+				    s->nbytes += buflen;
+				    progress(s);
+				    millisleep( run->milliseconds );
+			    }
+			}
+		} else {
+			if (run->udp) {
+			    (void)udp_receive(s);
+			} else if (run->verify) {
+			    (void)verify_receive(s);
+			} else if (run->zerocopy) {
+			    (void)nocopy_receive(s);
+			} else {
+			    while ((cnt=Nread(s,s->buf,buflen)) > 0)  {
+				    s->nbytes += cnt;
+				    progress(s);
+			    }
+			}
+		}
+	} else {
+		register int cnt;
+		if (run->trans)  {
+			while((cnt=read(0,s->buf,buflen)) > 0 &&
+			    Nwrite(s,s->buf,cnt) == cnt) {
+				s->nbytes += cnt;
+				progress(s);
+			}
+		}  else  {
+			while((cnt=Nread(s,s->buf,buflen)) > 0 &&
+			    write(1,s->buf,cnt) == cnt) {
+				s->nbytes += cnt;
+				progress(s);
+			}
+		}
+	}
+	if(errno)  {
+		err(s, "IO");
+		return 1;
+	}
+	(void)read_timer(s);
+	if(run->udp&&run->trans)  {
+		(void)Nwrite( s, s->buf, 4 ); /* rcvr end */
+		(void)Nwrite( s, s->buf, 4 ); /* rcvr end */
+		(void)Nwrite( s, s->buf, 4 ); /* rcvr end */
+		(void)Nwrite( s, s->buf, 4 ); /* rcvr end */
+	}
+
+	if(close(s->fd) < 0)  {
+		s->fd = -1;
+		err(s, "close");
+		return 1;
+	}
+	s->fd = -1;
+
+	if( s->cput <= 0.0 )  s->cput = 0.001;
+	if( s->realt <= 0.0 )  s->realt = 0.001;
+	return 0;
+}
+
+static void *stream_thread(void *arg)
+{
+	ttcp_stream *s = arg;
+
+	(void)stream_run(s);
+	atomic_store_explicit(&s->finished, 1, memory_order_release);
+	return NULL;
+}
+
+static int start_stream_thread(ttcp_stream *s, void *(*start)(void *),
+    int detached)
+{
+	ttcp_run *run = s->run;
+	pthread_attr_t attr;
+	int eno;
+
+	eno = pthread_attr_init(&attr);
+	if (eno != 0)
+		return eno;
+
+	eno = pthread_attr_setstacksize(&attr, TTCP_STREAM_STACK_SIZE);
+	if (eno == 0 && detached)
+		eno = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+#if defined(TTCP_HAVE_AFFINITY)
+	if (eno == 0 && run->ncpus > 0) {
+		cpu_set_t cpuset;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(run->cpus[s->index % run->ncpus], &cpuset);
+		eno = pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
+	}
+#endif
+	if (eno == 0)
+		eno = pthread_create(&s->thread, &attr, start, s);
+	if (eno == 0)
+		s->thread_started = 1;
+
+	(void)pthread_attr_destroy(&attr);
+	return eno;
+}
+
+static void sleep_ns(uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)(ns / 1000000000);
+	ts.tv_nsec = (long)(ns % 1000000000);
+	(void)nanosleep(&ts, NULL);
+}
+
+static int all_finished(ttcp_run *run)
+{
+	int i;
+
+	for (i = 0; i < run->nstreams; ++i) {
+		ttcp_stream *s = &run->streams[i];
+
+		if (s->thread_started &&
+		    !atomic_load_explicit(&s->finished, memory_order_acquire))
+			return 0;
+	}
+	return 1;
+}
+
+static double rusage_cpu(const struct rusage *ru1, const struct rusage *ru0)
+{
+	struct timeval u, t;
+
+	timersub(&ru1->ru_utime, &ru0->ru_utime, &u);
+	timersub(&ru1->ru_stime, &ru0->ru_stime, &t);
+	timeradd(&u, &t, &u);
+	return u.tv_sec + ((double)u.tv_usec) / 1000000;
+}
+
+/*
+ * CPU time of the system.  The busy time of the run is the elapsed time of
+ * all processors minus the time of the idle tasks.
+ */
+typedef struct {
+	uint64_t uptime_ns;
+	uint64_t idle_ns;		/* of all idle tasks */
+	int processors;			/* 0 if the idle time is unknown */
+	struct timespec self;		/* CPU time of the calling task */
+	int self_known;
+} ttcp_cpu;
+
+static void cpu_sample(ttcp_cpu *cpu)
+{
+#if defined(__linux__)
+	unsigned long long user, nice, sys, idle, iowait;
+	FILE *stat;
+#endif
+
+	memset(cpu, 0, sizeof(*cpu));
+	cpu->self_known = thread_cputime(&cpu->self) == 0;
+#if defined(__rtems__)
+	cpu->idle_ns = ttcp_cpu_idle(&cpu->processors);
+#elif defined(__linux__)
+	stat = fopen("/proc/stat", "r");
+	if (stat != NULL) {
+		if (fscanf(stat, "cpu %llu %llu %llu %llu %llu", &user, &nice,
+		    &sys, &idle, &iowait) == 5) {
+			cpu->idle_ns = (idle + iowait) * (1000000000 /
+			    sysconf(_SC_CLK_TCK));
+			cpu->processors = (int)sysconf(_SC_NPROCESSORS_ONLN);
+		}
+		fclose(stat);
+	}
+#endif
+	cpu->uptime_ns = now_ns();
+}
+
+static double ts_diff(const struct timespec *t1, const struct timespec *t0)
+{
+	return (t1->tv_sec - t0->tv_sec) +
+	    ((double)(t1->tv_nsec - t0->tv_nsec)) / 1000000000;
+}
+
+/* CPU usage of a run */
+typedef struct {
+	double elapsed;			/* seconds of all processors */
+	double busy;			/* seconds not spent in idle tasks */
+	double own;			/* seconds of ttcp, < 0 if unknown */
+	double stack;			/* busy seconds of other tasks */
+	double verify;			/* -V: seconds to generate or check */
+	double nbytes;
+	double packets;
+	const char *packet;		/* name of a packet */
+} ttcp_cpu_use;
+
+/*
+ * Gets the CPU usage between the samples.  The time of ttcp is the one of the
+ * calling task and of the stream threads.  Everything else which is not idle
+ * is accounted to the network stack.  Returns -1 if the idle time is
+ * unknown.
+ */
+static int cpu_use(const ttcp_run *run, const ttcp_cpu *c0,
+    const ttcp_cpu *c1, ttcp_cpu_use *u)
+{
+	int i;
+
+	if (c0->processors == 0 || c1->processors != c0->processors)
+		return -1;
+
+	memset(u, 0, sizeof(*u));
+	u->elapsed = (double)(c1->uptime_ns - c0->uptime_ns) / 1e9 *
+	    c1->processors;
+	u->busy = u->elapsed - (double)(c1->idle_ns - c0->idle_ns) / 1e9;
+	if (u->busy < 0.0)
+		u->busy = 0.0;
+
+	if (c0->self_known && c1->self_known)
+		u->own = ts_diff(&c1->self, &c0->self);
+	else
+		u->own = -1.0;
+
+	if (run->rr)
+		u->packet = "transaction";
+	else if (run->conn)
+		u->packet = "connection";
+	else if (run->udp && run->sinkmode)
+		u->packet = "datagram";
+	else
+		u->packet = "call";
+
+	for (i = 0; i < run->nstreams; ++i) {
+		const ttcp_stream *s = &run->streams[i];
+
+		if (s->error != NULL || (run->threaded && !s->thread_started))
+			continue;
+		if (run->threaded && u->own >= 0.0) {
+			if (s->thread_cput >= 0.0)
+				u->own += s->thread_cput;
+			else
+				u->own = -1.0;
+		}
+		u->nbytes += s->nbytes;
+		u->verify += s->verify.cpu_ns / 1e9;
+		if (run->rr || run->conn)
+			u->packets += s->transactions;
+		else if (run->udp && run->sinkmode)
+			u->packets += run->trans ? s->datagrams :
+			    s->udp.received;
+		else
+			u->packets += s->numCalls;
+	}
+
+	if (u->own >= 0.0) {
+		u->stack = u->busy - u->own;
+		if (u->stack < 0.0)
+			u->stack = 0.0;
+	}
+	return 0;
+}
+
+/* Throughput of an interval or of the run */
+typedef struct {
+	double start, end;		/* seconds since the start */
+	double nbytes;
+	unsigned long numCalls;
+	double cput;			/* CPU seconds */
+} ttcp_sample;
+
+/*
+ * Prints the sample in the output format of the run.  The extra JSON members
+ * start with a comma and are not part of the CSV columns.
+ */
+static void print_sample(const ttcp_run *run, const char *type,
+    const ttcp_sample *t, const char *extra)
+{
+	double realt = t->end - t->start;
+	char obuf[50];
+
+	if( realt <= 0.0 )  realt = 0.001;
+	switch (run->output) {
+	case 'j':
+		fprintf(stdout,
+		    "{\"type\":\"%s\",\"role\":\"%s\",\"start\":%.3f,"
+		    "\"end\":%.3f,\"bytes\":%.0f,\"bytes_per_sec\":%.0f,"
+		    "\"calls\":%lu,\"calls_per_sec\":%.2f,"
+		    "\"cpu_seconds\":%.3f%s}\n",
+		    type, run->trans ? "t" : "r", t->start, t->end, t->nbytes,
+		    t->nbytes / realt, t->numCalls, t->numCalls / realt,
+		    t->cput, extra);
+		break;
+	case 'c':
+		fprintf(stdout, "%s,%s,%.3f,%.3f,%.0f,%.0f,%lu,%.2f,%.3f\n",
+		    type, run->trans ? "t" : "r", t->start, t->end, t->nbytes,
+		    t->nbytes / realt, t->numCalls, t->numCalls / realt,
+		    t->cput);
+		break;
+	default:
+		fprintf(stdout,
+		    "ttcp%s: %6.2f-%6.2f sec %.0f bytes = %s/sec, "
+		    "%lu calls = %.2f calls/sec, %.2f CPU seconds\n",
+		    role(run), t->start, t->end, t->nbytes,
+		    outfmt(run, t->nbytes / realt, obuf, sizeof(obuf)),
+		    t->numCalls, t->numCalls / realt, t->cput);
+		break;
+	}
+	fflush(stdout);
+}
+
+/*
+ * Gets the CPU time of an interval.  On RTEMS, getrusage() reports nothing,
+ * so this is the busy time of all processors like in the CPU summary of the
+ * run.  Otherwise, it is the CPU time of the process.
+ */
+static double interval_cpu(const ttcp_run *run, const ttcp_cpu *c0,
+    const ttcp_cpu *c1, const struct rusage *ru0, const struct rusage *ru1)
+{
+#if defined(__rtems__)
+	ttcp_cpu_use u;
+
+	if (cpu_use(run, c0, c1, &u) == 0)
+		return u.busy;
+	if (c0->self_known && c1->self_known)
+		return ts_diff(&c1->self, &c0->self);
+#endif
+	return rusage_cpu(ru1, ru0);
+}
+
+/*
+ * Prints the progress of the streams every interval until all streams
+ * finished.  The CPU time is the one of interval_cpu().
+ */
+static void report_intervals(ttcp_run *run)
+{
+	uint64_t start = now_ns(), prev = start, next = start, now;
+	double last_bytes = 0.0;
+	unsigned long last_calls = 0;
+	struct rusage ru_last, ru;
+	ttcp_cpu cpu_last, cpu;
+	int done;
+
+	getrusage(RUSAGE_SELF, &ru_last);
+	cpu_sample(&cpu_last);
+	do {
+		ttcp_sample t;
+		double nbytes = 0.0;
+		unsigned long numCalls = 0;
+		int i;
+
+		next += run->interval_ns;
+		while (!(done = all_finished(run)) && (now = now_ns()) < next)
+			sleep_ns(next - now < TTCP_POLL_NS ?
+			    next - now : TTCP_POLL_NS);
+		now = now_ns();
+		getrusage(RUSAGE_SELF, &ru);
+		cpu_sample(&cpu);
+
+		for (i = 0; i < run->nstreams; ++i) {
+			ttcp_stream *s = &run->streams[i];
+
+			nbytes += atomic_load_explicit(&s->progress_bytes,
+			    memory_order_relaxed);
+			numCalls += atomic_load_explicit(&s->progress_calls,
+			    memory_order_relaxed);
+		}
+		t.start = (prev - start) / 1e9;
+		t.end = (now - start) / 1e9;
+		t.nbytes = nbytes - last_bytes;
+		t.numCalls = numCalls - last_calls;
+		t.cput = interval_cpu(run, &cpu_last, &cpu, &ru_last, &ru);
+		last_bytes = nbytes;
+		last_calls = numCalls;
+		ru_last = ru;
+		cpu_last = cpu;
+		prev = now;
+
+		/* The last interval is usually a partial one */
+		if (!done || t.nbytes > 0.0)
+			print_sample(run, "interval", &t, "");
+	} while (!done);
+}
+
+/*
+ * Runs the streams.  A single stream runs in the calling task, unless the
+ * calling task reports intervals.
+ */
+static void run_streams(ttcp_run *run)
+{
+	int i;
+
+	if (run->nstreams == 1 && run->interval_ns == 0) {
+		(void)stream_run(&run->streams[0]);
+		return;
+	}
+
+	run->threaded = 1;
+	for (i = 0; i < run->nstreams; ++i) {
+		ttcp_stream *s = &run->streams[i];
+		int eno;
+
+		eno = start_stream_thread(s, stream_thread, 0);
+		if (eno != 0) {
+			s->error = "pthread_create";
+			s->error_errno = eno;
+			break;
+		}
+	}
+
+	if (run->interval_ns != 0)
+		report_intervals(run);
+
+	for (i = 0; i < run->nstreams; ++i) {
+		ttcp_stream *s = &run->streams[i];
+
+		if (s->thread_started)
+			(void)pthread_join(s->thread, NULL);
+	}
+}
+
+/*
+ * Receiver of -S.  The daemon task accepts the connections and hands each one
+ * to a worker task, up to run.daemon connections at a time.  The results are
+ * logged, since the tasks have no shell to print to.  The run is the first
+ * member, so the stream of a worker leads to its daemon.  The daemon keeps
+ * the accepted socket and the worker uses a duplicate, so that a stop request
+ * may shut the connections down while the workers close their sockets.
+ */
+typedef struct ttcp_daemon {
+	ttcp_run run;
+	struct ttcp_daemon *next;
+	int fd;				/* listening socket */
+	int stop;
+	int active;
+	unsigned long connections;
+	ttcp_stream *workers[TTCP_MAX_STREAMS];
+	int sockets[TTCP_MAX_STREAMS];
+	pthread_cond_t changed;
+} ttcp_daemon;
+
+/* Protects the daemon list and the daemons */
+static pthread_mutex_t ttcp_daemon_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static ttcp_daemon *ttcp_daemons;
+
+static void daemon_log(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+#if defined(__rtems__)
+	vsyslog(LOG_INFO, fmt, ap);
+#else
+	vfprintf(stdout, fmt, ap);
+	fputc('\n', stdout);
+	fflush(stdout);
+#endif
+	va_end(ap);
+}
+
+static void daemon_release(ttcp_daemon *d, ttcp_stream *s)
+{
+	int i;
+
+	pthread_mutex_lock(&ttcp_daemon_mutex);
+	for (i = 0; i < d->run.daemon; ++i) {
+		if (d->workers[i] == s) {
+			close(d->sockets[i]);
+			d->sockets[i] = -1;
+			d->workers[i] = NULL;
+			--d->active;
+			break;
+		}
+	}
+	pthread_cond_broadcast(&d->changed);
+	pthread_mutex_unlock(&ttcp_daemon_mutex);
+
+	if (s->fd >= 0)
+		close(s->fd);
+	free(s->alloc_buf);
+	batch_free(s);
+	free(s);
+}
+
+static void *daemon_worker(void *arg)
+{
+	ttcp_stream *s = arg;
+	ttcp_daemon *d = (ttcp_daemon *)s->run;
+	char peer[INET_ADDRSTRLEN];
+	char obuf[50];
+
+	if (inet_ntop(AF_INET, &s->peer.sin_addr, peer, sizeof(peer)) == NULL)
+		strcpy(peer, "?");
+
+	if (stream_buffers(s) == 0 &&
+	    (!d->run.rr || !d->run.nodelay || set_nodelay(s) == 0))
+		(void)stream_transfer(s);
+
+	if (s->error != NULL)
+		daemon_log("ttcp-r: connection %d from %s: %s: %s", s->index,
+		    peer, s->error, strerror(s->error_errno));
+	else if (d->run.rr)
+		daemon_log("ttcp-r: connection %d from %s: %lu transactions "
+		    "in %.2f real seconds = %.2f trans/sec", s->index, peer,
+		    s->transactions, s->realt, s->transactions / s->realt);
+	else
+		daemon_log("ttcp-r: connection %d from %s: %.0f bytes in "
+		    "%.2f real seconds = %s/sec, %lu I/O calls", s->index,
+		    peer, s->nbytes, s->realt,
+		    outfmt(&d->run, s->nbytes / s->realt, obuf, sizeof(obuf)),
+		    s->numCalls);
+	if (s->error == NULL && d->run.verify && s->verify.corrupt != 0)
+		daemon_log("ttcp-r: connection %d from %s: %lu of %llu blocks "
+		    "corrupt, first at offset %llu", s->index, peer,
+		    s->verify.corrupt, (unsigned long long)s->verify.blocks,
+		    (unsigned long long)s->verify.offset);
+
+	daemon_release(d, s);
+	return NULL;
+}
+
+static void daemon_accept(ttcp_daemon *d)
+{
+	struct sockaddr_in peer;
+	socklen_t len = sizeof(peer);
+	ttcp_stream *s;
+	int fd, i, eno;
+
+	fd = accept(d->fd, (struct sockaddr *)&peer, &len);
+	if (fd < 0) {
+		daemon_log("ttcp-r: port %d: accept: %s", d->run.port,
+		    strerror(errno));
+		return;
+	}
+
+	s = calloc(1, sizeof(*s));
+	if (s == NULL) {
+		daemon_log("ttcp-r: port %d: not enough memory", d->run.port);
+		close(fd);
+		return;
+	}
+	s->run = &d->run;
+	s->index = (int)d->connections++;
+	s->peer = peer;
+	s->fd = dup(fd);
+	if (s->fd < 0) {
+		daemon_log("ttcp-r: port %d: dup: %s", d->run.port,
+		    strerror(errno));
+		close(fd);
+		free(s);
+		return;
+	}
+
+	pthread_mutex_lock(&ttcp_daemon_mutex);
+	for (i = 0; d->workers[i] != NULL; ++i)
+		;
+	d->workers[i] = s;
+	d->sockets[i] = fd;
+	++d->active;
+	pthread_mutex_unlock(&ttcp_daemon_mutex);
+
+	eno = start_stream_thread(s, daemon_worker, 1);
+	if (eno != 0) {
+		daemon_log("ttcp-r: port %d: pthread_create: %s", d->run.port,
+		    strerror(eno));
+		daemon_release(d, s);
+	}
+}
+
+static void daemon_loop(ttcp_daemon *d)
+{
+	int i;
+
+	for (;;) {
+		struct timeval tv;
+		fd_set set;
+		int stop;
+
+		pthread_mutex_lock(&ttcp_daemon_mutex);
+		while (d->active == d->run.daemon && !d->stop)
+			pthread_cond_wait(&d->changed, &ttcp_daemon_mutex);
+		stop = d->stop;
+		pthread_mutex_unlock(&ttcp_daemon_mutex);
+		if (stop)
+			break;
+
+		FD_ZERO(&set);
+		FD_SET(d->fd, &set);
+		tv.tv_sec = 0;
+		tv.tv_usec = TTCP_DAEMON_POLL_MS * 1000;
+		if (select(d->fd + 1, &set, NULL, NULL, &tv) > 0)
+			daemon_accept(d);
+	}
+
+	pthread_mutex_lock(&ttcp_daemon_mutex);
+	for (i = 0; i < d->run.daemon; ++i) {
+		if (d->workers[i] != NULL)
+			(void)shutdown(d->sockets[i], SHUT_RDWR);
+	}
+	while (d->active != 0)
+		pthread_cond_wait(&d->changed, &ttcp_daemon_mutex);
+	pthread_mutex_unlock(&ttcp_daemon_mutex);
+
+	close(d->fd);
+	daemon_log("ttcp-r: port %d: stopped after %lu connections",
+	    d->run.port, d->connections);
+	pthread_cond_destroy(&d->changed);
+	free(d);
+}
+
+#if defined(__rtems__)
+static void *daemon_task(void *arg)
+{
+	daemon_loop(arg);
+	return NULL;
+}
+#endif
+
+/* Requests the daemon on the port to stop, it stops within a poll period */
+static int daemon_stop_port(int port)
+{
+	ttcp_daemon **link, *d = NULL;
+
+	pthread_mutex_lock(&ttcp_daemon_mutex);
+	for (link = &ttcp_daemons; *link != NULL; link = &(*link)->next) {
+		if ((*link)->run.port == port) {
+			d = *link;
+			*link = d->next;
+			d->stop = 1;
+			pthread_cond_broadcast(&d->changed);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&ttcp_daemon_mutex);
+
+	return d != NULL ? 0 : -1;
+}
+
+static int daemon_start(const ttcp_run *run)
+{
+	struct sockaddr_in sinme;
+	ttcp_daemon *d;
+	int i;
+
+	d = calloc(1, sizeof(*d));
+	if (d == NULL) {
+		fprintf(stderr,"ttcp-r: not enough memory\n");
+		return 1;
+	}
+	d->run = *run;
+	d->run.threaded = 1;
+	for (i = 0; i < TTCP_MAX_STREAMS; ++i)
+		d->sockets[i] = -1;
+
+	memset(&sinme, 0, sizeof(sinme));
+	sinme.sin_family = AF_INET;
+	sinme.sin_port = htons(run->port);
+	if ((d->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+	    setsockopt(d->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+#if defined(SO_RCVBUF)
+	    (run->sockbufsize && setsockopt(d->fd, SOL_SOCKET, SO_RCVBUF,
+	    &run->sockbufsize, sizeof run->sockbufsize) < 0) ||
+#endif
+	    bind(d->fd, (struct sockaddr *)&sinme, sizeof(sinme)) < 0 ||
+	    listen(d->fd, run->daemon) < 0) {
+		fprintf(stderr,"ttcp-r: ");
+		perror("listen");
+		if (d->fd >= 0)
+			close(d->fd);
+		free(d);
+		return 1;
+	}
+
+	pthread_cond_init(&d->changed, NULL);
+	pthread_mutex_lock(&ttcp_daemon_mutex);
+	d->next = ttcp_daemons;
+	ttcp_daemons = d;
+	pthread_mutex_unlock(&ttcp_daemon_mutex);
+
+	fprintf(stdout,
+	    "ttcp-r: serving port %d, up to %d connections at a time\n",
+	    run->port, run->daemon);
+#if defined(__rtems__)
+	{
+		pthread_attr_t attr;
+		pthread_t thread;
+		int eno;
+
+		eno = pthread_attr_init(&attr);
+		if (eno == 0)
+			eno = pthread_attr_setstacksize(&attr,
+			    TTCP_STREAM_STACK_SIZE);
+		if (eno == 0)
+			eno = pthread_attr_setdetachstate(&attr,
+			    PTHREAD_CREATE_DETACHED);
+		if (eno == 0)
+			eno = pthread_create(&thread, &attr, daemon_task, d);
+		(void)pthread_attr_destroy(&attr);
+		if (eno != 0) {
+			fprintf(stderr, "ttcp-r: pthread_create: %s\n",
+			    strerror(eno));
+			d->stop = 1;
+			(void)daemon_stop_port(run->port);
+			daemon_loop(d);
+			return 1;
+		}
+	}
+#else
+	daemon_loop(d);
+#endif
+	return 0;
+}
+
+static int report_single(ttcp_run *run)
+{
+	ttcp_stream *s = &run->streams[0];
+	char obuf[50];
+
+	if (s->error != NULL) {
+		if (run->threaded)
+			fprintf(stderr, "ttcp%s: %s: %s\n",
+			    role(run), s->error, strerror(s->error_errno));
+		return 1;
+	}
+
+	fprintf(stdout,
+		"ttcp%s: %.0f bytes in %.2f real seconds = %s/sec +++\n",
+		role(run),
+		s->nbytes, s->realt, outfmt(run, s->nbytes/s->realt, obuf, sizeof(obuf)));
+	if (run->verbose || run->file != NULL || run->zerocopy) {
+	    fprintf(stdout,
+		"ttcp%s: %.0f bytes in %.2f CPU seconds = %s/cpu sec\n",
+		role(run),
+		s->nbytes, s->cput, outfmt(run, s->nbytes/s->cput, obuf, sizeof(obuf)));
+	}
+	if (s->zc_sends > 0) {
+	    fprintf(stdout,
+		"ttcp%s: zero-copy: %lu of %lu sends copied\n",
+		role(run), s->zc_copied, s->zc_sends);
+	}
+	fprintf(stdout,
+		"ttcp%s: %ld I/O calls, msec/call = %.2f, calls/sec = %.2f\n",
+		role(run),
+		s->numCalls,
+		1024.0 * s->realt/((double)s->numCalls),
+		((double)s->numCalls)/s->realt);
+	fprintf(stdout,"ttcp%s: %s\n", role(run), s->stats);
+	if (run->verbose) {
+	    fprintf(stdout,
+		"ttcp%s: buffer address %p\n",
+		role(run),
+		s->buf);
+	}
+	return 0;
+}
+
+static double tvdiff(const struct timeval *t1, const struct timeval *t0)
+{
+	return (t1->tv_sec - t0->tv_sec) +
+	    ((double)(t1->tv_usec - t0->tv_usec)) / 1000000;
+}
+
+/*
+ * The aggregate rate covers the time from the first stream start to the last
+ * stream end.  The CPU cost is the CPU time of all streams per byte.
+ */
+static int report_parallel(ttcp_run *run, const struct rusage *ru0,
+    const struct rusage *ru1)
+{
+	struct timeval first, last;
+	double nbytes = 0.0, realt, cput = 0.0;
+	unsigned long numCalls = 0;
+	int i, done = 0, failed = 0, cput_known = 1;
+	char obuf[50];
+
+	for (i = 0; i < run->nstreams; ++i) {
+		const ttcp_stream *s = &run->streams[i];
+
+		/* Not started after a thread creation error */
+		if (!s->thread_started && s->error == NULL) {
+			++failed;
+			continue;
+		}
+
+		if (s->error != NULL) {
+			fprintf(stderr, "ttcp%s: stream %d: %s: %s\n",
+			    role(run), i, s->error, strerror(s->error_errno));
+			++failed;
+			continue;
+		}
+
+		fprintf(stdout,
+		    "ttcp%s: stream %d: %.0f bytes in %.2f real seconds = %s/sec",
+		    role(run), i, s->nbytes, s->realt,
+		    outfmt(run, s->nbytes/s->realt, obuf, sizeof(obuf)));
+		if (s->thread_cput >= 0.0)
+			fprintf(stdout, ", %.2f CPU seconds", s->thread_cput);
+		if (!run->trans && !run->udp)
+			fprintf(stdout, ", from %s", inet_ntoa(s->peer.sin_addr));
+		fprintf(stdout, "\n");
+
+		if (done == 0 || timercmp(&s->time0, &first, <))
+			first = s->time0;
+		if (done == 0 || timercmp(&s->time1, &last, >))
+			last = s->time1;
+		nbytes += s->nbytes;
+		numCalls += s->numCalls;
+		if (s->thread_cput >= 0.0)
+			cput += s->thread_cput;
+		else
+			cput_known = 0;
+		++done;
+	}
+
+	if (done == 0)
+		return 1;
+
+	realt = tvdiff(&last, &first);
+	if( realt <= 0.0 )  realt = 0.001;
+	fprintf(stdout,
+		"ttcp%s: %.0f bytes in %.2f real seconds = %s/sec +++\n",
+		role(run),
+		nbytes, realt, outfmt(run, nbytes/realt, obuf, sizeof(obuf)));
+
+	/* Without the CPU time of the threads, use the one of the process */
+	if (!cput_known)
+		cput = rusage_cpu(ru1, ru0);
+	if( cput <= 0.0 )  cput = 0.001;
+	fprintf(stdout,
+		"ttcp%s: %d streams, %.2f CPU seconds = %s/cpu sec\n",
+		role(run), done, cput, outfmt(run, nbytes/cput, obuf, sizeof(obuf)));
+	fprintf(stdout,
+		"ttcp%s: %ld I/O calls, msec/call = %.2f, calls/sec = %.2f\n",
+		role(run),
+		numCalls,
+		1024.0 * realt/((double)numCalls),
+		((double)numCalls)/realt);
+
+	return failed != 0;
+}
+
+static void print_rtt(const ttcp_run *run, const ttcp_hist *h)
+{
+	fprintf(stdout,
+	    "ttcp%s: %s usec: min %.1f, mean %.1f, p50 %.1f, p90 %.1f, "
+	    "p99 %.1f, p99.9 %.1f, max %.1f\n",
+	    role(run), run->conn ? "connect" : "rtt", h->min / 1000.0, (double)h->sum / h->count / 1000.0,
+	    hist_percentile(h, 0.5) / 1000.0, hist_percentile(h, 0.9) / 1000.0,
+	    hist_percentile(h, 0.99) / 1000.0,
+	    hist_percentile(h, 0.999) / 1000.0, h->max / 1000.0);
+}
+
+/*
+ * Reports the transactions of the request/response mode or the connections
+ * of -C.  The round trip or connect times of all streams are merged into the
+ * histogram of the first stream.
+ */
+static int report_rr(ttcp_run *run)
+{
+	ttcp_hist *rtt = &run->streams[0].rtt;
+	struct timeval first, last;
+	unsigned long transactions = 0, lost = 0, numCalls = 0;
+	const char *what = run->conn ? "connections" : "transactions";
+	const char *unit = run->conn ? "conn" : "trans";
+	double realt;
+	int i, done = 0, failed = 0;
+
+	for (i = 0; i < run->nstreams; ++i) {
+		const ttcp_stream *s = &run->streams[i];
+
+		if (run->threaded && !s->thread_started && s->error == NULL) {
+			++failed;
+			continue;
+		}
+
+		if (s->error != NULL) {
+			if (run->threaded)
+				fprintf(stderr, "ttcp%s: stream %d: %s: %s\n",
+				    role(run), i, s->error,
+				    strerror(s->error_errno));
+			++failed;
+			continue;
+		}
+
+		if (run->nstreams > 1) {
+			fprintf(stdout,
+			    "ttcp%s: stream %d: %lu %s in %.2f real seconds = %.2f %s/sec",
+			    role(run), i, s->transactions, what, s->realt,
+			    s->transactions / s->realt, unit);
+			if (run->trans && s->rtt.count != 0)
+				fprintf(stdout, ", p99 %.1f usec",
+				    hist_percentile(&s->rtt, 0.99) / 1000.0);
+			if (!run->trans)
+				fprintf(stdout, ", from %s",
+				    inet_ntoa(s->peer.sin_addr));
+			fprintf(stdout, "\n");
+		}
+
+		if (done == 0 || timercmp(&s->time0, &first, <))
+			first = s->time0;
+		if (done == 0 || timercmp(&s->time1, &last, >))
+			last = s->time1;
+		transactions += s->transactions;
+		lost += s->lost;
+		numCalls += s->numCalls;
+		if (i > 0 && run->trans)
+			hist_merge(rtt, &s->rtt);
+		++done;
+	}
+
+	if (done == 0)
+		return 1;
+
+	realt = tvdiff(&last, &first);
+	if( realt <= 0.0 )  realt = 0.001;
+	fprintf(stdout,
+		"ttcp%s: %lu %s in %.2f real seconds = %.2f %s/sec +++\n",
+		role(run), transactions, what, realt, transactions / realt,
+		unit);
+	if (run->trans && rtt->count != 0)
+		print_rtt(run, rtt);
+	if (run->trans && run->udp)
+		fprintf(stdout, "ttcp%s: %lu lost after %d msec\n",
+		    role(run), lost, TTCP_RR_TIMEOUT_MS);
+	fprintf(stdout,
+		"ttcp%s: %ld I/O calls, msec/call = %.2f, calls/sec = %.2f\n",
+		role(run),
+		numCalls,
+		1024.0 * realt/((double)numCalls),
+		((double)numCalls)/realt);
+	if (run->nstreams == 1)
+		fprintf(stdout,"ttcp%s: %s\n", role(run), run->streams[0].stats);
+
+	return failed != 0;
+}
+
+static const char *const conn_error_names[TTCP_CONN_ERRORS] = {
+	"ports",		/* TTCP_CONN_PORTS */
+	"descriptors",		/* TTCP_CONN_FILES */
+	"buffers",		/* TTCP_CONN_BUFFERS */
+	"peer",			/* TTCP_CONN_PEER */
+	"other"			/* TTCP_CONN_OTHER */
+};
+
+/* Sums the failed connection attempts of the streams */
+static unsigned long conn_errors(const ttcp_run *run,
+    unsigned long errors[TTCP_CONN_ERRORS])
+{
+	unsigned long total = 0;
+	int i, j;
+
+	memset(errors, 0, TTCP_CONN_ERRORS * sizeof(errors[0]));
+	for (i = 0; i < run->nstreams; ++i) {
+		const ttcp_stream *s = &run->streams[i];
+
+		if (run->threaded && !s->thread_started)
+			continue;
+		for (j = 0; j < TTCP_CONN_ERRORS; ++j) {
+			errors[j] += s->conn_errors[j];
+			total += s->conn_errors[j];
+		}
+	}
+	return total;
+}
+
+/*
+ * Reports the failed connection attempts of -C.  Running out of ports means
+ * too many connections in TIME_WAIT, running out of descriptors or buffers
+ * means too few rtems_libio_number_iops or protocol control blocks.
+ */
+static void report_conn(const ttcp_run *run)
+{
+	unsigned long errors[TTCP_CONN_ERRORS];
+	int j;
+
+	if (conn_errors(run, errors) == 0) {
+		fprintf(stdout, "ttcp%s: no failed connections\n", role(run));
+		return;
+	}
+	fprintf(stdout, "ttcp%s: failed connections:", role(run));
+	for (j = 0; j < TTCP_CONN_ERRORS; ++j)
+		fprintf(stdout, "%s %lu %s", j == 0 ? "" : ",", errors[j],
+		    conn_error_names[j]);
+	fprintf(stdout, "\n");
+}
+
+/*
+ * Reports the datagrams of -u -s.  The jitter of a parallel run is the one
+ * of the worst stream.
+ */
+static void report_udp(const ttcp_run *run)
+{
+	unsigned long datagrams = 0, enobufs = 0, expected = 0, received = 0;
+	unsigned long duplicates = 0, reordered = 0, lost;
+	double jitter = 0.0;
+	int i;
+
+	for (i = 0; i < run->nstreams; ++i) {
+		const ttcp_stream *s = &run->streams[i];
+
+		if (s->error != NULL || (run->threaded && !s->thread_started))
+			continue;
+		datagrams += s->datagrams;
+		enobufs += s->enobufs;
+		expected += s->udp.next;
+		received += s->udp.received;
+		duplicates += s->udp.duplicates;
+		reordered += s->udp.reordered;
+		if (s->udp.jitter > jitter)
+			jitter = s->udp.jitter;
+	}
+
+	if (run->trans) {
+		fprintf(stdout,
+		    "ttcp%s: %lu datagrams, %d per call, %lu ENOBUFS\n",
+		    role(run), datagrams, run->batch, enobufs);
+		return;
+	}
+
+	lost = expected - received;
+	fprintf(stdout,
+	    "ttcp%s: %lu datagrams, %lu lost (%.2f%%), %lu duplicates, "
+	    "%lu reordered, jitter %.1f usec\n",
+	    role(run), received, lost,
+	    expected != 0 ? 100.0 * lost / expected : 0.0,
+	    duplicates, reordered, jitter / 1000.0);
+}
+
+/* Reports the achieved rate next to the one requested by -L */
+static void report_rate(const ttcp_run *run)
+{
+	struct timeval first, last;
+	double achieved = 0.0, realt;
+	char obuf[50], obuf2[50];
+	int i, done = 0;
+
+	for (i = 0; i < run->nstreams; ++i) {
+		const ttcp_stream *s = &run->streams[i];
+
+		if (s->error != NULL || (run->threaded && !s->thread_started))
+			continue;
+		if (run->rr)
+			achieved += run->rate_buffers ? s->transactions :
+			    (double)s->transactions * run->rr_request;
+		else if (run->udp && run->sinkmode)
+			achieved += run->rate_buffers ? s->datagrams :
+			    s->nbytes;
+		else if (run->conn)
+			achieved += run->rate_buffers ? s->transactions :
+			    s->nbytes;
+		else
+			achieved += run->rate_buffers ?
+			    s->nbytes / run->buflen : s->nbytes;
+		if (done == 0 || timercmp(&s->time0, &first, <))
+			first = s->time0;
+		if (done == 0 || timercmp(&s->time1, &last, >))
+			last = s->time1;
+		++done;
+	}
+	if (done == 0)
+		return;
+
+	realt = tvdiff(&last, &first);
+	if( realt <= 0.0 )  realt = 0.001;
+	if (run->rate_buffers)
+		fprintf(stdout,
+		    "ttcp%s: rate %.2f buffers/sec, requested %.2f buffers/sec\n",
+		    role(run), achieved / realt, run->rate);
+	else
+		fprintf(stdout,
+		    "ttcp%s: rate %s/sec, requested %s/sec\n", role(run),
+		    outfmt(run, achieved / realt, obuf, sizeof(obuf)),
+		    outfmt(run, run->rate / 8.0, obuf2, sizeof(obuf2)));
+}
+
+/*
+ * Returns why -F or -Z copies every byte on this system like the pattern
+ * mode does, or NULL if the mode avoids the copy.
+ */
+static const char *copy_fallback(const ttcp_run *run)
+{
+	if (run->file != NULL) {
+#if !defined(TTCP_HAVE_SENDFILE)
+		return "no sendfile(), the file is read and written";
+#endif
+	} else if (run->zerocopy && run->trans) {
+#if !defined(TTCP_HAVE_MSG_ZEROCOPY) && !RTEMS_NET_LWIP
+		return "no zero-copy send, the buffer is copied";
+#endif
+	} else if (run->zerocopy) {
+#if !defined(TTCP_HAVE_MSG_TRUNC)
+		return "no receive which discards the data, it is read";
+#endif
+	}
+	return NULL;
+}
+
+/* Returns 1 if the receiver found corrupt data */
+static int report_verify(const ttcp_run *run)
+{
+	uint64_t blocks = 0, offset = 0;
+	unsigned long corrupt = 0;
+	int i, first = -1;
+
+	for (i = 0; i < run->nstreams; ++i) {
+		const ttcp_stream *s = &run->streams[i];
+
+		if (run->threaded && !s->thread_started)
+			continue;
+		blocks += s->verify.blocks;
+		if (s->verify.corrupt != 0 && first < 0) {
+			first = i;
+			offset = s->verify.offset;
+		}
+		corrupt += s->verify.corrupt;
+	}
+
+	if (run->trans) {
+		fprintf(stdout, "ttcp%s: %llu blocks with CRC32C sent\n",
+		    role(run), (unsigned long long)blocks);
+		return 0;
+	}
 
-#if defined(ENABLE_NANOSLEEP_DELAY)
-#include <time.h>
-#endif
+	fprintf(stdout, "ttcp%s: %llu blocks verified, %lu corrupt",
+	    role(run), (unsigned long long)blocks, corrupt);
+	if (first >= 0 && run->nstreams > 1)
+		fprintf(stdout, ", first in stream %d at offset %llu", first,
+		    (unsigned long long)offset);
+	else if (first >= 0)
+		fprintf(stdout, ", first at offset %llu",
+		    (unsigned long long)offset);
+	fprintf(stdout, "\n");
+	return corrupt != 0;
+}
 
-#include <unistd.h>
-#include <stdlib.h>
+static void report_cpu(const ttcp_run *run, const ttcp_cpu *c0,
+    const ttcp_cpu *c1)
+{
+	ttcp_cpu_use u;
 
-#if defined(SYSV)
-#include <sys/times.h>
-#include <sys/param.h>
-struct rusage {
-    struct timeval ru_utime, ru_stime;
-};
-#define RUSAGE_SELF 0
-#else
-#include <sys/resource.h>
-#endif
+	if (cpu_use(run, c0, c1, &u) != 0 || u.elapsed <= 0.0)
+		return;
 
+	fprintf(stdout,
+	    "ttcp%s: cpu: %.2f of %.2f sec busy on %d processors (%.1f%%)",
+	    role(run), u.busy, u.elapsed, c1->processors,
+	    100.0 * u.busy / u.elapsed);
+	if (u.own >= 0.0)
+		fprintf(stdout,
+		    ", ttcp %.2f sec, stack and other tasks %.2f sec (%.1f%%)",
+		    u.own, u.stack,
+		    u.busy > 0.0 ? 100.0 * u.stack / u.busy : 0.0);
+	fprintf(stdout, "\n");
+	if (u.nbytes > 0.0 && u.packets > 0.0)
+		fprintf(stdout,
+		    "ttcp%s: cpu: %.2f nsec/byte, %.2f usec/%s\n",
+		    role(run), 1e9 * u.busy / u.nbytes,
+		    1e6 * u.busy / u.packets, u.packet);
+	if (run->verify && u.nbytes > 0.0)
+		fprintf(stdout,
+		    "ttcp%s: cpu: verification %.2f sec (%.1f%% of busy), "
+		    "%.2f nsec/byte\n", role(run), u.verify,
+		    u.busy > 0.0 ? 100.0 * u.verify / u.busy : 0.0,
+		    1e9 * u.verify / u.nbytes);
+}
 
-static struct sockaddr_in sinme;
-static struct sockaddr_in sinhim;
-static struct sockaddr_in frominet;
-
-/* these make it easier to avoid warnings */
-static struct sockaddr *sinhim_p = (struct sockaddr *) &sinhim;
-static struct sockaddr *sinme_p = (struct sockaddr *) &sinme;
-static struct sockaddr *frominet_p = (struct sockaddr *) &frominet;
-
-static int domain;
-static socklen_t fromlen;
-static int fd;				/* fd of network socket */
-
-static int buflen = 8 * 1024;		/* length of buffer */
-static char *buf;			/* ptr to dynamic buffer */
-static char *alloc_buf;			/* ptr to beginning of memory allocated for buf */
-static int nbuf = 2 * 1024;		/* number of buffers to send in sinkmode */
-
-static int bufoffset = 0;		/* align buffer to this */
-static int bufalign = 16*1024;		/* modulo this */
-
-static int udp = 0;			/* 0 = tcp, !0 = udp */
-static int options = 0;		/* socket options */
-static int one = 1;                    /* for 4.3 BSD style setsockopt() */
-static short port = 5001;		/* TCP port number */
-static char *host;			/* ptr to name of host */
-static int trans;			/* 0=receive, !0=transmit mode */
-static int sinkmode = 0;		/* 0=normal I/O, !0=sink/source mode */
-static int verbose = 0;		/* 0=print basic info, 1=print cpu rate, proc
-				 * resource usage. */
-static int nodelay = 0;		/* set TCP_NODELAY socket option */
-static int b_flag = 0;			/* use mread() */
-static int sockbufsize = 0;		/* socket buffer size to use */
-static char fmt = 'K';			/* output format: k = kilobits, K = kilobytes,
-				 *  m = megabits, M = megabytes,
-				 *  g = gigabits, G = gigabytes */
-static int touchdata = 0;		/* access data after reading */
-static long milliseconds = 0;          /* delay in milliseconds */
-
-static struct hostent *addr;
-static void initialize_vars(void)
+/* Returns the JSON members of the CPU usage */
+static size_t cpu_json(const ttcp_run *run, const ttcp_cpu *c0,
+    const ttcp_cpu *c1, char *buf, size_t size)
 {
-	memset(&sinme, 0, sizeof(sinme));
-	memset(&sinhim, 0, sizeof(sinhim));
-	memset(&frominet, 0, sizeof(frominet));
-
-	/* these make it easier to avoid warnings */
-	sinhim_p = (struct sockaddr *) &sinhim;
-	sinme_p = (struct sockaddr *) &sinme;
-	frominet_p = (struct sockaddr *) &frominet;
-
-	domain = 0;
-	fromlen = 0;
-	fd = 0;				/* fd of network socket */
-
-	buflen = 8 * 1024;		/* length of buffer */
-	buf = NULL;			/* ptr to dynamic buffer */
-	alloc_buf = NULL; /* ptr to beginning of memory allocated for buf */
-	nbuf = 2 * 1024;		/* number of buffers to send in sinkmode */
-
-	bufoffset = 0;		/* align buffer to this */
-	bufalign = 16*1024;		/* modulo this */
-
-	udp = 0;			/* 0 = tcp, !0 = udp */
-	options = 0;		/* socket options */
-	one = 1;			/* for 4.3 BSD style setsockopt() */
-	port = 5001;		/* TCP port number */
-	host = NULL;			/* ptr to name of host */
-	trans = 0;			/* 0=receive, !0=transmit mode */
-	sinkmode = 0;		/* 0=normal I/O, !0=sink/source mode */
-	verbose = 0;		/* 0=print basic info, 1=print cpu rate, proc
-									 * resource usage. */
-	nodelay = 0;		/* set TCP_NODELAY socket option */
-	b_flag = 0;			/* use mread() */
-	sockbufsize = 0;		/* socket buffer size to use */
-	fmt = 'K';			/* output format: k = kilobits, K = kilobytes,
-									 *  m = megabits, M = megabytes,
-									 *  g = gigabits, G = gigabytes */
-	touchdata = 0;		/* access data after reading */
-	milliseconds = 0;			/* delay in milliseconds */
-
-	addr = NULL;
+	ttcp_cpu_use u;
+	int n;
+
+	if (cpu_use(run, c0, c1, &u) != 0 || u.elapsed <= 0.0)
+		return 0;
+
+	n = snprintf(buf, size,
+	    ",\"cpu\":{\"processors\":%d,\"elapsed_seconds\":%.3f,"
+	    "\"busy_seconds\":%.3f,\"utilization\":%.4f",
+	    c1->processors, u.elapsed, u.busy, u.busy / u.elapsed);
+	if (u.own >= 0.0 && n >= 0 && (size_t)n < size)
+		n += snprintf(buf + n, size - n,
+		    ",\"ttcp_seconds\":%.3f,\"stack_seconds\":%.3f",
+		    u.own, u.stack);
+	if (u.nbytes > 0.0 && u.packets > 0.0 && n >= 0 && (size_t)n < size)
+		n += snprintf(buf + n, size - n,
+		    ",\"nsec_per_byte\":%.3f,\"usec_per_%s\":%.3f",
+		    1e9 * u.busy / u.nbytes, u.packet,
+		    1e6 * u.busy / u.packets);
+	if (run->verify && n >= 0 && (size_t)n < size)
+		n += snprintf(buf + n, size - n, ",\"verify_seconds\":%.3f",
+		    u.verify);
+	if (n >= 0 && (size_t)n < size)
+		n += snprintf(buf + n, size - n, "}");
+	return n >= 0 && (size_t)n < size ? (size_t)n : 0;
 }
 
-static const char Usage[] = "\
-Usage: ttcp -t [-options] host [ < in ]\n\
-       ttcp -r [-options > out]\n\
-Common options:\n\
-	-l ##	length of bufs read from or written to network (default 8192)\n\
-	-u	use UDP instead of TCP\n\
-	-p ##	port number to send to or listen at (default 5001)\n\
-	-s	-t: source a pattern to network\n\
-		-r: sink (discard) all data from network\n\
-	-A	align the start of buffers to this modulus (default 16384)\n\
-	-O	start buffers at this offset from the modulus (default 0)\n\
-	-v	verbose: print more statistics\n\
-	-d	set SO_DEBUG socket option\n\
-	-b ##	set socket buffer size (if supported)\n\
-	-f X	format for rate: k,K = kilo{bit,byte}; m,M = mega; g,G = giga\n\
-Options specific to -t:\n\
-	-n##	number of source bufs written to network (default 2048)\n\
-	-D	don't buffer TCP writes (sets TCP_NODELAY socket option)\n\
-Options specific to -r:\n\
-	-B	for -s, only output full blocks as specified by -l (for TAR)\n\
-	-T	\"touch\": access each byte as it's read\n\
-	-m ##	delay for specified milliseconds between each write\n\
-";
+/*
+ * Prints the summary of the run as JSON object or CSV row.  The JSON object
+ * has the results of the mode as additional members.
+ */
+static int report_machine(ttcp_run *run, const struct rusage *ru0,
+    const struct rusage *ru1, const ttcp_cpu *c0, const ttcp_cpu *c1)
+{
+	ttcp_hist *rtt = &run->streams[0].rtt;
+	struct timeval first, last;
+	ttcp_sample t;
+	unsigned long transactions = 0, lost = 0, datagrams = 0, enobufs = 0;
+	unsigned long expected = 0, received = 0, duplicates = 0, reordered = 0;
+	unsigned long corrupt = 0;
+	uint64_t blocks = 0, offset = 0;
+	double jitter = 0.0;
+	char extra[1024];
+	size_t n;
+	int i, done = 0, failed = 0, cput_known = 1;
+
+	memset(&t, 0, sizeof(t));
+	for (i = 0; i < run->nstreams; ++i) {
+		const ttcp_stream *s = &run->streams[i];
+
+		if (run->threaded && !s->thread_started && s->error == NULL) {
+			++failed;
+			continue;
+		}
 
-static char stats[128];
-static double nbytes;			/* bytes on net */
-static unsigned long numCalls;		/* # of I/O system calls */
-static double cput, realt;		/* user, real time (seconds) */
-
-static void err();
-static void mes();
-static void pattern();
-static void prep_timer();
-static double read_timer();
-static int Nread();
-static int Nwrite();
-static void delay();
-static int mread();
-static char *outfmt();
+		if (s->error != NULL) {
+			fprintf(stderr, "ttcp%s: stream %d: %s: %s\n",
+			    role(run), i, s->error, strerror(s->error_errno));
+			++failed;
+			continue;
+		}
 
-static void millisleep(long msec)
-{
-#if defined(ENABLE_NANOSLEEP_DELAY)
-  struct timespec req;
+		if (done == 0 || timercmp(&s->time0, &first, <))
+			first = s->time0;
+		if (done == 0 || timercmp(&s->time1, &last, >))
+			last = s->time1;
+		t.nbytes += s->nbytes;
+		t.numCalls += s->numCalls;
+		if (s->thread_cput >= 0.0)
+			t.cput += s->thread_cput;
+		else
+			cput_known = 0;
+		transactions += s->transactions;
+		lost += s->lost;
+		datagrams += s->datagrams;
+		enobufs += s->enobufs;
+		expected += s->udp.next;
+		received += s->udp.received;
+		duplicates += s->udp.duplicates;
+		reordered += s->udp.reordered;
+		if (s->udp.jitter > jitter)
+			jitter = s->udp.jitter;
+		blocks += s->verify.blocks;
+		if (s->verify.corrupt != 0 && corrupt == 0)
+			offset = s->verify.offset;
+		corrupt += s->verify.corrupt;
+		if (i > 0 && (run->rr || run->conn) && run->trans)
+			hist_merge(rtt, &s->rtt);
+		++done;
+	}
 
-  req.tv_sec = msec / 1000;
-  req.tv_nsec = (msec % 1000) * 1000000;
+	if (done == 0)
+		return 1;
 
-  nanosleep( &req, NULL );
-#endif
+	t.end = tvdiff(&last, &first);
+	if (!cput_known)
+		t.cput = rusage_cpu(ru1, ru0);
+
+	n = (size_t)snprintf(extra, sizeof(extra),
+	    ",\"protocol\":\"%s\",\"streams\":%d,\"failed\":%d",
+	    run->udp ? "udp" : "tcp", done, failed);
+	if (run->rr || run->conn) {
+		n += (size_t)snprintf(extra + n, sizeof(extra) - n,
+		    ",\"%s\":%lu", run->conn ? "connections" : "transactions",
+		    transactions);
+		if (run->trans && rtt->count != 0)
+			n += (size_t)snprintf(extra + n, sizeof(extra) - n,
+			    ",\"%s_usec\":{\"min\":%.1f,\"mean\":%.1f,"
+			    "\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,"
+			    "\"p99.9\":%.1f,\"max\":%.1f}",
+			    run->conn ? "connect" : "rtt", rtt->min / 1000.0,
+			    (double)rtt->sum / rtt->count / 1000.0,
+			    hist_percentile(rtt, 0.5) / 1000.0,
+			    hist_percentile(rtt, 0.9) / 1000.0,
+			    hist_percentile(rtt, 0.99) / 1000.0,
+			    hist_percentile(rtt, 0.999) / 1000.0,
+			    rtt->max / 1000.0);
+		if (run->trans && run->udp)
+			n += (size_t)snprintf(extra + n, sizeof(extra) - n,
+			    ",\"lost\":%lu", lost);
+		if (run->conn) {
+			unsigned long errors[TTCP_CONN_ERRORS];
+			int j;
+
+			(void)conn_errors(run, errors);
+			for (j = 0; j < TTCP_CONN_ERRORS && n < sizeof(extra);
+			    ++j)
+				n += (size_t)snprintf(extra + n,
+				    sizeof(extra) - n, "%s\"%s\":%lu",
+				    j == 0 ? ",\"failed_connections\":{" : ",",
+				    conn_error_names[j], errors[j]);
+			if (n < sizeof(extra))
+				n += (size_t)snprintf(extra + n,
+				    sizeof(extra) - n, "}");
+		}
+	} else if (run->udp && run->sinkmode) {
+		if (run->trans)
+			n += (size_t)snprintf(extra + n, sizeof(extra) - n,
+			    ",\"datagrams\":%lu,\"enobufs\":%lu",
+			    datagrams, enobufs);
+		else
+			n += (size_t)snprintf(extra + n, sizeof(extra) - n,
+			    ",\"datagrams\":%lu,\"lost\":%lu,"
+			    "\"duplicates\":%lu,\"reordered\":%lu,"
+			    "\"jitter_usec\":%.1f",
+			    received, expected - received, duplicates,
+			    reordered, jitter / 1000.0);
+	}
+	if (run->verify && n < sizeof(extra)) {
+		n += (size_t)snprintf(extra + n, sizeof(extra) - n,
+		    ",\"blocks\":%llu", (unsigned long long)blocks);
+		if (!run->trans && n < sizeof(extra))
+			n += (size_t)snprintf(extra + n, sizeof(extra) - n,
+			    ",\"corrupt\":%lu", corrupt);
+		if (corrupt != 0 && n < sizeof(extra))
+			n += (size_t)snprintf(extra + n, sizeof(extra) - n,
+			    ",\"corrupt_offset\":%llu",
+			    (unsigned long long)offset);
+	}
+	if (run->trans && run->rate > 0.0 && n < sizeof(extra))
+		n += (size_t)snprintf(extra + n, sizeof(extra) - n,
+		    ",\"rate_requested\":%.0f,\"rate_unit\":\"%s\"",
+		    run->rate, run->rate_buffers ? "buffers" : "bits");
+	if (copy_fallback(run) != NULL && n < sizeof(extra))
+		n += (size_t)snprintf(extra + n, sizeof(extra) - n,
+		    ",\"copy_fallback\":\"%s\"", copy_fallback(run));
+	if (n < sizeof(extra))
+		(void)cpu_json(run, c0, c1, extra + n, sizeof(extra) - n);
+
+	print_sample(run, "summary", &t, extra);
+	return failed != 0 || corrupt != 0;
+}
+
+static void print_config(const ttcp_run *run)
+{
+	if (run->rr)
+		fprintf(stdout, "ttcp%s: request=%d, response=%d, ",
+		    role(run), run->rr_request, run->rr_response);
+	else if (run->conn)
+		fprintf(stdout, "ttcp%s: exchange=%d, ", role(run),
+		    run->conn_bytes);
+	else
+		fprintf(stdout, "ttcp%s: buflen=%d, ", role(run), run->buflen);
+	if (run->trans && run->duration > 0)
+		fprintf(stdout, "duration=%lds, ", run->duration);
+	else
+		fprintf(stdout, "nbuf=%d, ", run->nbuf);
+	fprintf(stdout, "align=%d/%d, port=%d",
+	    run->bufalign, run->bufoffset, run->port);
+	if (run->sockbufsize)
+		fprintf(stdout, ", sockbufsize=%d", run->sockbufsize);
+	if (run->nstreams > 1)
+		fprintf(stdout, ", streams=%d", run->nstreams);
+	if (run->trans)
+		fprintf(stdout, "  %s  -> %s\n", run->udp?"udp":"tcp", run->host);
+	else
+		fprintf(stdout, "  %s\n", run->udp?"udp":"tcp");
 }
 
 #if (defined (__rtems__))
-int rtems_shell_main_ttcp(argc,argv)
+int rtems_shell_main_ttcp(int argc, char **argv)
 #else
-int main(argc,argv)
+int main(int argc, char **argv)
 #endif
-int argc;
-char **argv;
 {
-	initialize_vars();
+	ttcp_run run_storage;
+	ttcp_run *run = &run_storage;
+	struct rusage ru0, ru1;
+	ttcp_cpu cpu0, cpu1;
+	struct hostent *addr;
 	unsigned long addr_tmp;
+	int rv = 1;
+	int stop = 0;
 	int c;
+	int i;
+
+	initialize_run(run);
 
 	if (argc < 2) goto usage;
 
@@ -256,381 +3270,318 @@ char **argv;
 #define optopt getopt.reent.optopt
 	memset(&getopt_reent, 0, sizeof(getopt_data));
 	while ((c = getopt_r(argc, argv,
-					"drstuvBDTb:f:l:m:n:p:A:O:",
+					"drstuvBDKTVZa:b:f:i:k:l:m:n:o:p:w:A:C:F:L:O:P:R:S:",
 					&getopt_reent)) != -1) {
 #else
-	while ((c = getopt(argc, argv, "drstuvBDTb:f:l:m:n:p:A:O:")) != -1) {
+	while ((c = getopt(argc, argv, "drstuvBDKTVZa:b:f:i:k:l:m:n:o:p:w:A:C:F:L:O:P:R:S:")) != -1) {
 #endif
 		switch (c) {
 
 		case 'B':
-			b_flag = 1;
+			run->b_flag = 1;
 			break;
 		case 't':
-			trans = 1;
+			run->trans = 1;
 			break;
 		case 'r':
-			trans = 0;
+			run->trans = 0;
 			break;
 		case 'd':
-			options |= SO_DEBUG;
+			run->options |= SO_DEBUG;
 			break;
 		case 'D':
 #ifdef TCP_NODELAY
-			nodelay = 1;
+			run->nodelay = 1;
 #else
 			fprintf(stderr,
 	"ttcp: -D option ignored: TCP_NODELAY socket option not supported\n");
 #endif
 			break;
 		case 'm':
-			milliseconds = atoi(optarg);
+			run->milliseconds = atoi(optarg);
 			#if !defined(ENABLE_NANOSLEEP_DELAY)
 				fprintf(stderr, "millisecond delay disabled\n");
 			#endif
 			break;
 		case 'n':
-			nbuf = atoi(optarg);
+			run->nbuf = atoi(optarg);
 			break;
 		case 'l':
-			buflen = atoi(optarg);
+			run->buflen = atoi(optarg);
 			break;
 		case 's':
-			sinkmode = !sinkmode;
+			run->sinkmode = !run->sinkmode;
 			break;
 		case 'p':
-			port = atoi(optarg);
+			run->port = atoi(optarg);
 			break;
 		case 'u':
-			udp = 1;
+			run->udp = 1;
 			break;
 		case 'v':
-			verbose = 1;
+			run->verbose = 1;
 			break;
 		case 'A':
-			bufalign = atoi(optarg);
+			run->bufalign = atoi(optarg);
 			break;
 		case 'O':
-			bufoffset = atoi(optarg);
+			run->bufoffset = atoi(optarg);
 			break;
 		case 'b':
 #if defined(SO_SNDBUF) || defined(SO_RCVBUF)
-			sockbufsize = atoi(optarg);
+			run->sockbufsize = atoi(optarg);
 #else
 			fprintf(stderr,
 "ttcp: -b option ignored: SO_SNDBUF/SO_RCVBUF socket options not supported\n");
 #endif
 			break;
 		case 'f':
-			fmt = *optarg;
+			run->fmt = *optarg;
 			break;
 		case 'T':
-			touchdata = 1;
+			run->touchdata = 1;
+			break;
+		case 'P':
+			run->nstreams = atoi(optarg);
+			if (run->nstreams < 1 || run->nstreams > TTCP_MAX_STREAMS)
+				goto usage;
+			break;
+		case 'R':
+			if (parse_rr(run, optarg) != 0)
+				goto usage;
+			break;
+		case 'w':
+			run->duration = atol(optarg);
+			break;
+		case 'S':
+			run->daemon = atoi(optarg);
+			if (run->daemon < 1 || run->daemon > TTCP_MAX_STREAMS)
+				goto usage;
+			break;
+		case 'K':
+			stop = 1;
+			break;
+		case 'F':
+			run->file = optarg;
+			break;
+		case 'Z':
+			run->zerocopy = 1;
+			break;
+		case 'V':
+			run->verify = 1;
+			break;
+		case 'C':
+			run->conn = 1;
+			run->conn_bytes = atoi(optarg);
+			if (run->conn_bytes < 0)
+				goto usage;
+			break;
+		case 'i':
+			run->interval_ns = (uint64_t)(atof(optarg) * 1e9);
+			if (run->interval_ns == 0)
+				goto usage;
+			break;
+		case 'o':
+			if (strcmp(optarg, "json") == 0)
+				run->output = 'j';
+			else if (strcmp(optarg, "csv") == 0)
+				run->output = 'c';
+			else if (strcmp(optarg, "text") == 0)
+				run->output = 't';
+			else
+				goto usage;
+			break;
+		case 'L':
+			if (parse_rate(run, optarg) != 0)
+				goto usage;
+			break;
+		case 'k':
+			run->batch = atoi(optarg);
+			if (run->batch < 1 || run->batch > TTCP_MAX_BATCH)
+				goto usage;
+			break;
+		case 'a':
+			if (parse_cpus(run, optarg) != 0)
+				goto usage;
+#if !defined(TTCP_HAVE_AFFINITY)
+			fprintf(stderr,
+	"ttcp: -a option ignored: thread affinity not supported\n");
+#endif
 			break;
 
 		default:
 			goto usage;
 		}
 	}
-	if(trans)  {
+
+	/* The file and zero-copy modes replace the pattern over TCP */
+	if (run->file != NULL || run->zerocopy) {
+		if (run->udp || run->rr || (run->file != NULL && !run->trans))
+			goto usage;
+		run->sinkmode = 1;
+	}
+
+	/* The block needs a pattern word and the CRC */
+	if (run->verify) {
+		if (run->udp || run->rr || run->file != NULL || run->zerocopy ||
+		    !run->sinkmode || run->buflen < TTCP_VERIFY_MIN)
+			goto usage;
+		crc32c_init();
+	}
+
+	/* Only connections over TCP */
+	if (run->conn && (run->udp || run->rr || run->file != NULL ||
+	    run->zerocopy || run->verify))
+		goto usage;
+
+	/* Parallel streams cannot share stdin or stdout */
+	if (run->nstreams > 1 && !run->sinkmode && !run->rr && !run->conn)
+		goto usage;
+
+	if(run->trans)  {
 		/* xmitr */
 		if (optind == argc)
 			goto usage;
-		bzero((char *)&sinhim, sizeof(sinhim));
-		host = argv[optind];
-		sinme.sin_family = AF_INET;
-		if (atoi(host) > 0 )  {
+		run->host = argv[optind];
+		if (atoi(run->host) > 0 )  {
 			/* Numeric */
-			sinhim.sin_family = AF_INET;
+			run->sinhim.sin_family = AF_INET;
 #if defined(cray)
-			addr_tmp = inet_addr(host);
-			sinhim.sin_addr = addr_tmp;
+			addr_tmp = inet_addr(run->host);
+			run->sinhim.sin_addr = addr_tmp;
 #else
-			sinhim.sin_addr.s_addr = inet_addr(host);
+			run->sinhim.sin_addr.s_addr = inet_addr(run->host);
 #endif
 		} else {
-			if ((addr=gethostbyname(host)) == NULL)  {
-				err("bad hostname");
-#ifdef __rtems__
+			if ((addr=gethostbyname(run->host)) == NULL)  {
+				fprintf(stderr,"ttcp-t: ");
+				perror("bad hostname");
+				fprintf(stderr,"errno=%d\n",errno);
 				return 1;
-#endif
 			}
-			sinhim.sin_family = addr->h_addrtype;
+			run->sinhim.sin_family = addr->h_addrtype;
 			bcopy(addr->h_addr,(char*)&addr_tmp, addr->h_length);
 #if defined(cray)
-			sinhim.sin_addr = addr_tmp;
+			run->sinhim.sin_addr = addr_tmp;
 #else
-			sinhim.sin_addr.s_addr = addr_tmp;
+			run->sinhim.sin_addr.s_addr = addr_tmp;
 #endif /* cray */
 		}
-		sinhim.sin_port = htons(port);
-		sinme.sin_port = 0;		/* free choice */
-	} else {
-		/* rcvr */
-		sinme.sin_family = AF_INET;
-		sinme.sin_port =  htons(port);
-	}
-
-
-	if (udp && buflen < 5) {
-	    buflen = 5;		/* send more than the sentinel size */
-	}
-
-	if ( (buf = (char *)malloc(buflen+bufalign)) == (char *)NULL)  {
-		err("malloc");
-#ifdef __rtems__
-		return 1;
-#endif
-	}
-	alloc_buf = buf;
-	if (bufalign != 0)
-		buf +=(bufalign - ((intptr_t)buf % bufalign) + bufoffset) % bufalign;
-
-	if (trans) {
-	    fprintf(stdout,
-	    "ttcp-t: buflen=%d, nbuf=%d, align=%d/%d, port=%d",
-		buflen, nbuf, bufalign, bufoffset, port);
-	    if (sockbufsize)
-		fprintf(stdout, ", sockbufsize=%d", sockbufsize);
-	    fprintf(stdout, "  %s  -> %s\n", udp?"udp":"tcp", host);
-	} else {
-	    fprintf(stdout,
-	    "ttcp-r: buflen=%d, nbuf=%d, align=%d/%d, port=%d",
-		buflen, nbuf, bufalign, bufoffset, port);
-	    if (sockbufsize)
-		fprintf(stdout, ", sockbufsize=%d", sockbufsize);
-	    fprintf(stdout, "  %s\n", udp?"udp":"tcp");
 	}
 
-	if ((fd = socket(AF_INET, udp?SOCK_DGRAM:SOCK_STREAM, 0)) < 0)  {
-		err("socket");
-#ifdef __rtems__
-		return 1;
-#endif
+	if (run->udp && run->buflen < 5) {
+	    run->buflen = 5;		/* send more than the sentinel size */
 	}
-	mes("socket");
-
-	if (bind(fd, sinme_p, sizeof(sinme)) < 0)  {
-		err("bind");
-#ifdef __rtems__
-		return 1;
-#endif
+	if (run->udp && run->sinkmode &&
+	    run->buflen < (int)sizeof(ttcp_udp_header)) {
+	    run->buflen = sizeof(ttcp_udp_header);
 	}
-
-#if defined(SO_SNDBUF) || defined(SO_RCVBUF)
-	if (sockbufsize) {
-	    if (trans) {
-		if (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sockbufsize,
-		    sizeof sockbufsize) < 0)  {
-			err("setsockopt: sndbuf");
-#ifdef __rtems__
-			return 1;
-#endif
-		}
-		mes("sndbuf");
-	    } else {
-		if (setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &sockbufsize,
-		    sizeof sockbufsize) < 0)  {
-			err("setsockopt: rcvbuf");
-#ifdef __rtems__
-			return 1;
-#endif
-		}
-		mes("rcvbuf");
-	    }
+	if (run->rr) {
+		if (run->udp && run->rr_request < 5)
+			run->rr_request = 5;
+		run->buflen = run->rr_request > run->rr_response ?
+		    run->rr_request : run->rr_response;
+		if (run->buflen < (int)sizeof(uint32_t))
+			run->buflen = sizeof(uint32_t);	/* request number */
 	}
-#endif
-
-	if (!udp)  {
-#if 0
-	    signal(SIGPIPE, sigpipe);
-#endif
-	    if (trans) {
-		/* We are the client if transmitting */
-		if (options)  {
-#if defined(BSD42)
-			if( setsockopt(fd, SOL_SOCKET, options, 0, 0) < 0)  {
-#else /* BSD43 */
-			if( setsockopt(fd, SOL_SOCKET, options, &one, sizeof(one)) < 0)  {
-#endif
-				err("setsockopt");
-#ifdef __rtems__
-				return 1;
-#endif
-			}
-		}
-#ifdef TCP_NODELAY
-		if (nodelay) {
-			struct protoent *p;
-			p = getprotobyname("tcp");
-			if( p && setsockopt(fd, p->p_proto, TCP_NODELAY,
-			    &one, sizeof(one)) < 0)  {
-				err("setsockopt: nodelay");
-#ifdef __rtems__
-				return 1;
-#endif
-			}
-			mes("nodelay");
+	if (run->conn && run->conn_bytes > run->buflen)
+		run->buflen = run->conn_bytes;
+
+	if (stop || run->daemon) {
+		if (stop) {
+			rv = daemon_stop_port(run->port);
+			if (rv == 0)
+				fprintf(stdout, "ttcp-r: stopping port %d\n",
+				    run->port);
+			else
+				fprintf(stderr, "ttcp-r: not serving port %d\n",
+				    run->port);
+		} else if (run->trans || run->udp || run->nstreams > 1 ||
+		    run->conn || (!run->sinkmode && !run->rr)) {
+			goto usage;
+		} else {
+			rv = daemon_start(run);
 		}
-#endif
-		if(connect(fd, sinhim_p, sizeof(sinhim) ) < 0)  {
-			err("connect");
 #ifdef __rtems__
-			return 1;
-#endif
-		}
-		mes("connect");
-	    } else {
-		/* otherwise, we are the server and
-	         * should listen for the connections
-	         */
-#if defined(ultrix) || defined(sgi)
-		listen(fd,1);   /* workaround for alleged u4.2 bug */
+		return rv != 0;
 #else
-		listen(fd,0);   /* allow a queue of 0 */
-#endif
-		if(options)  {
-#if defined(BSD42)
-			if( setsockopt(fd, SOL_SOCKET, options, 0, 0) < 0)  {
-#else /* BSD43 */
-			if( setsockopt(fd, SOL_SOCKET, options, &one, sizeof(one)) < 0)  {
-#endif
-				err("setsockopt");
-#ifdef __rtems__
-				return 1;
-#endif
-			}
-		}
-		fromlen = sizeof(frominet);
-		domain = AF_INET;
-		int fd_list = fd;
-		if((fd=accept(fd_list, frominet_p, &fromlen) ) < 0)  {
-			err("accept");
-#ifdef __rtems__
-			return 1;
-#endif
-		}
-
-		if(close(fd_list) < 0)  {
-			err("close");
-#ifdef __rtems__
-			return 1;
+		exit(rv != 0);
 #endif
-		}
+	}
 
-		{ struct sockaddr_in peer;
-		  socklen_t peerlen = sizeof(peer);
-		  if (getpeername(fd, (struct sockaddr *) &peer,
-				&peerlen) < 0) {
-			err("getpeername");
-#ifdef __rtems__
-			return 1;
-#endif
-		  }
-		  fprintf(stderr,"ttcp-r: accept from %s\n",
-			inet_ntoa(peer.sin_addr));
-		}
-	    }
+	run->streams = calloc(run->nstreams, sizeof(*run->streams));
+	if (run->streams == NULL) {
+		fprintf(stderr,"ttcp%s: not enough memory\n", role(run));
+		return 1;
 	}
-	prep_timer();
-	errno = 0;
-	if (sinkmode) {
-		register int cnt;
-		if (trans)  {
-			pattern( buf, buflen );
-			if(udp)  (void)Nwrite( fd, buf, 4 ); /* rcvr start */
-			while (nbuf-- && Nwrite(fd,buf,buflen) == buflen) {
-				nbytes += buflen;
-				millisleep( milliseconds );
-                        }
-			if(udp)  (void)Nwrite( fd, buf, 4 ); /* rcvr end */
-		} else {
-			if (udp) {
-			    while ((cnt=Nread(fd,buf,buflen)) > 0)  {
-				    static int going = 0;
-				    if( cnt <= 4 )  {
-					    if( going )
-						    break;	/* "EOF" */
-					    going = 1;
-					    prep_timer();
-				    } else {
-					    nbytes += cnt;
-				    }
-			    }
-			} else {
-			    while ((cnt=Nread(fd,buf,buflen)) > 0)  {
-				    nbytes += cnt;
-			    }
+	for (i = 0; i < run->nstreams; ++i) {
+		run->streams[i].run = run;
+		run->streams[i].index = i;
+		run->streams[i].fd = -1;
+		if ((run->rr || run->conn) && run->trans) {
+			run->streams[i].rtt.counts = calloc(TTCP_HIST_BUCKETS,
+			    sizeof(*run->streams[i].rtt.counts));
+			if (run->streams[i].rtt.counts == NULL) {
+				fprintf(stderr,"ttcp%s: not enough memory\n",
+				    role(run));
+				rv = 1;
+				goto out;
 			}
 		}
-	} else {
-		register int cnt;
-		if (trans)  {
-			while((cnt=read(0,buf,buflen)) > 0 &&
-			    Nwrite(fd,buf,cnt) == cnt)
-				nbytes += cnt;
-		}  else  {
-			while((cnt=Nread(fd,buf,buflen)) > 0 &&
-			    write(1,buf,cnt) == cnt)
-				nbytes += cnt;
-		}
-	}
-	if(errno)  {
-		err("IO");
-#ifdef __rtems__
-		return 1;
-#endif
-	}
-	(void)read_timer(stats,sizeof(stats));
-	if(udp&&trans)  {
-		(void)Nwrite( fd, buf, 4 ); /* rcvr end */
-		(void)Nwrite( fd, buf, 4 ); /* rcvr end */
-		(void)Nwrite( fd, buf, 4 ); /* rcvr end */
-		(void)Nwrite( fd, buf, 4 ); /* rcvr end */
 	}
 
-	if(close(fd) < 0)  {
-		err("close");
-#ifdef __rtems__
-		return 1;
-#endif
-	}
+	if (run->output == 'c')
+		fprintf(stdout, "type,role,start,end,bytes,bytes_per_sec,"
+		    "calls,calls_per_sec,cpu_seconds\n");
+	else if (run->output == 't')
+		print_config(run);
 
-	if( cput <= 0.0 )  cput = 0.001;
-	if( realt <= 0.0 )  realt = 0.001;
-	fprintf(stdout,
-		"ttcp%s: %.0f bytes in %.2f real seconds = %s/sec +++\n",
-		trans?"-t":"-r",
-		nbytes, realt, outfmt(nbytes/realt));
-	if (verbose) {
-	    fprintf(stdout,
-		"ttcp%s: %.0f bytes in %.2f CPU seconds = %s/cpu sec\n",
-		trans?"-t":"-r",
-		nbytes, cput, outfmt(nbytes/cput));
-	}
-	fprintf(stdout,
-		"ttcp%s: %ld I/O calls, msec/call = %.2f, calls/sec = %.2f\n",
-		trans?"-t":"-r",
-		numCalls,
-		1024.0 * realt/((double)numCalls),
-		((double)numCalls)/realt);
-	fprintf(stdout,"ttcp%s: %s\n", trans?"-t":"-r", stats);
-	if (verbose) {
-	    fprintf(stdout,
-		"ttcp%s: buffer address %p\n",
-		trans?"-t":"-r",
-		buf);
+	getrusage(RUSAGE_SELF, &ru0);
+	cpu_sample(&cpu0);
+	run_streams(run);
+	cpu_sample(&cpu1);
+	getrusage(RUSAGE_SELF, &ru1);
+
+	if (run->output != 't')
+		rv = report_machine(run, &ru0, &ru1, &cpu0, &cpu1);
+	else if (run->rr || run->conn)
+		rv = report_rr(run);
+	else if (run->nstreams == 1)
+		rv = report_single(run);
+	else
+		rv = report_parallel(run, &ru0, &ru1);
+	if (run->output == 't' && run->udp && run->sinkmode && !run->rr)
+		report_udp(run);
+	if (run->output == 't' && run->conn)
+		report_conn(run);
+	if (run->output == 't' && run->verify && report_verify(run) != 0)
+		rv = 1;
+	if (run->output == 't' && run->trans && run->rate > 0.0)
+		report_rate(run);
+	if (run->output == 't' && copy_fallback(run) != NULL)
+		fprintf(stdout, "ttcp%s: copying fallback: %s\n", role(run),
+		    copy_fallback(run));
+	if (run->output == 't' && (run->verbose || run->nstreams > 1 ||
+	    run->file != NULL || run->zerocopy || run->verify))
+		report_cpu(run, &cpu0, &cpu1);
+
+out:
+	for (i = 0; i < run->nstreams; ++i) {
+		if (run->streams[i].fd >= 0)
+			close(run->streams[i].fd);
+		free(run->streams[i].alloc_buf);
+		free(run->streams[i].rtt.counts);
+		batch_free(&run->streams[i]);
 	}
-	free(alloc_buf);
+	free(run->streams);
 #ifdef __rtems__
-	return 0;
+	return rv;
 #else
-	exit(0);
+	exit(rv);
 #endif
 
 usage:
-	fprintf(stderr,Usage);
-	free(alloc_buf);
+	fprintf(stderr, Usage, TTCP_UDP_BATCH, TTCP_MAX_BATCH);
 #ifdef __rtems__
 	return 1;
 #else
@@ -639,35 +3590,35 @@ usage:
 #endif
 }
 
-void
-err(s)
-char *s;
+/*
+ * Records the failed operation.  The stream of a single stream run prints it
+ * right away.
+ */
+static void
+err(ttcp_stream *s, const char *what)
 {
-	fprintf(stderr,"ttcp%s: ", trans?"-t":"-r");
-	perror(s);
-	fprintf(stderr,"errno=%d\n",errno);
-	free(alloc_buf);
-	if (fd != 0)
+	s->error = what;
+	s->error_errno = errno;
+	if (can_print(s)) {
+		fprintf(stderr,"ttcp%s: ", role(s->run));
+		perror(what);
+		fprintf(stderr,"errno=%d\n",errno);
+	}
+	if (s->fd >= 0)
 	{
-		close(fd);
+		close(s->fd);
+		s->fd = -1;
 	}
-#ifdef __rtems__
-	return;
-#else
-	exit(1);
-#endif
 }
 
-void
-mes(s)
-char *s;
+static void
+mes(const ttcp_stream *s, const char *what)
 {
-	fprintf(stderr,"ttcp%s: %s\n", trans?"-t":"-r", s);
+	if (can_print(s))
+		fprintf(stderr,"ttcp%s: %s\n", role(s->run), what);
 }
 
-void pattern( cp, cnt )
-register char *cp;
-register int cnt;
+static void pattern( register char *cp, register int cnt )
 {
 	register char c;
 	c = 0;
@@ -677,38 +3628,33 @@ register int cnt;
 	}
 }
 
-char *
-outfmt(b)
-double b;
+static char *
+outfmt(const ttcp_run *run, double b, char *obuf, size_t size)
 {
-    static char obuf[50];
-    switch (fmt) {
+    switch (run->fmt) {
 	case 'G':
-	    sprintf(obuf, "%.2f GB", b / 1024.0 / 1024.0 / 1024.0);
+	    snprintf(obuf, size, "%.2f GB", b / 1024.0 / 1024.0 / 1024.0);
 	    break;
 	default:
 	case 'K':
-	    sprintf(obuf, "%.2f KB", b / 1024.0);
+	    snprintf(obuf, size, "%.2f KB", b / 1024.0);
 	    break;
 	case 'M':
-	    sprintf(obuf, "%.2f MB", b / 1024.0 / 1024.0);
+	    snprintf(obuf, size, "%.2f MB", b / 1024.0 / 1024.0);
 	    break;
 	case 'g':
-	    sprintf(obuf, "%.2f Gbit", b * 8.0 / 1024.0 / 1024.0 / 1024.0);
+	    snprintf(obuf, size, "%.2f Gbit", b * 8.0 / 1024.0 / 1024.0 / 1024.0);
 	    break;
 	case 'k':
-	    sprintf(obuf, "%.2f Kbit", b * 8.0 / 1024.0);
+	    snprintf(obuf, size, "%.2f Kbit", b * 8.0 / 1024.0);
 	    break;
 	case 'm':
-	    sprintf(obuf, "%.2f Mbit", b * 8.0 / 1024.0 / 1024.0);
+	    snprintf(obuf, size, "%.2f Mbit", b * 8.0 / 1024.0 / 1024.0);
 	    break;
     }
     return obuf;
 }
 
-static struct	timeval time0;	/* Time at which timing started */
-static struct	rusage ru0;	/* Resource utilization at the start */
-
 #ifndef __rtems__
 static void prusage();
 static void psecs();
@@ -745,51 +3691,75 @@ gettimeofday(tp, zp)
 }
 #endif /* SYSV */
 
+/* Returns 0 and the CPU time of the executing thread if it is available */
+static int
+thread_cputime(struct timespec *ts)
+{
+#if defined(__rtems__)
+	ttcp_cpu_executing(ts);
+	return 0;
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+	return clock_gettime(CLOCK_THREAD_CPUTIME_ID, ts);
+#else
+	return -1;
+#endif
+}
+
 /*
  *			P R E P _ T I M E R
  */
-void
-prep_timer()
+static void
+prep_timer(ttcp_stream *s)
 {
-	gettimeofday(&time0, (struct timezone *)0);
-	getrusage(RUSAGE_SELF, &ru0);
+	gettimeofday(&s->time0, (struct timezone *)0);
+	getrusage(RUSAGE_SELF, &s->ru0);
+	if (thread_cputime(&s->cpu0) != 0)
+		s->cpu0.tv_sec = -1;
 }
 
 /*
  *			R E A D _ T I M E R
  *
  */
-double
-read_timer(str,len)
-char *str;
-int len;
+static double
+read_timer(ttcp_stream *s)
 {
 	struct timeval timedol;
 	struct rusage ru1;
 	struct timeval td;
 	struct timeval tend, tstart;
+	struct timespec cpu1;
 	char line[132];
 
 	getrusage(RUSAGE_SELF, &ru1);
 	gettimeofday(&timedol, (struct timezone *)0);
+	if (s->cpu0.tv_sec >= 0 && thread_cputime(&cpu1) == 0)
+		s->thread_cput = (cpu1.tv_sec - s->cpu0.tv_sec) +
+		    ((double)(cpu1.tv_nsec - s->cpu0.tv_nsec)) / 1000000000;
+	else
+		s->thread_cput = -1.0;
 #ifndef __rtems__
-	prusage(&ru0, &ru1, &timedol, &time0, line);
+	prusage(&s->ru0, &ru1, &timedol, &s->time0, line);
 #else
 	line[0] = '\0';
 #endif
-	(void)strncpy( str, line, len );
+	(void)strncpy( s->stats, line, sizeof(s->stats) );
+	s->stats[sizeof(s->stats) - 1] = '\0';
 
 	/* Get real time */
-	tvsub( &td, &timedol, &time0 );
-	realt = td.tv_sec + ((double)td.tv_usec) / 1000000;
+	s->time1 = timedol;
+	tvsub( &td, &timedol, &s->time0 );
+	s->realt = td.tv_sec + ((double)td.tv_usec) / 1000000;
 
 	/* Get CPU time (user+sys) */
 	tvadd( &tend, &ru1.ru_utime, &ru1.ru_stime );
-	tvadd( &tstart, &ru0.ru_utime, &ru0.ru_stime );
+	tvadd( &tstart, &s->ru0.ru_utime, &s->ru0.ru_stime );
 	tvsub( &td, &tend, &tstart );
-	cput = td.tv_sec + ((double)td.tv_usec) / 1000000;
-	if( cput < 0.00001 )  cput = 0.00001;
-	return( cput );
+	s->cput = td.tv_sec + ((double)td.tv_usec) / 1000000;
+	if (s->thread_cput >= 0.0)
+		s->cput = s->thread_cput;	/* only the stream */
+	if( s->cput < 0.00001 )  s->cput = 0.00001;
+	return( s->cput );
 }
 
 #ifndef __rtems__
@@ -960,26 +3930,24 @@ register char *cp;
 /*
  *			N R E A D
  */
-int Nread( fd, buf, count )
-int fd;
-void *buf;
-int count;
+static int Nread( ttcp_stream *s, void *buf, int count )
 {
+	const ttcp_run *run = s->run;
 	struct sockaddr_in from;
 	socklen_t len = sizeof(from);
 	register int cnt;
-	if( udp )  {
-		cnt = recvfrom( fd, buf, count, 0, (struct sockaddr *)&from, &len );
-		numCalls++;
+	if( run->udp )  {
+		cnt = recvfrom( s->fd, buf, count, 0, (struct sockaddr *)&from, &len );
+		s->numCalls++;
 	} else {
-		if( b_flag )
-			cnt = mread( fd, buf, count );	/* fill buf */
+		if( run->b_flag )
+			cnt = mread( s, buf, count );	/* fill buf */
 		else {
-			cnt = read( fd, buf, count );
-			numCalls++;
+			cnt = read( s->fd, buf, count );
+			s->numCalls++;
 		}
-		if (touchdata && cnt > 0) {
-			register int c = cnt, sum;
+		if (run->touchdata && cnt > 0) {
+			register int c = cnt, sum = 0;
 			register char *b = buf;
 			while (c--)
 				sum += *b++;
@@ -991,30 +3959,28 @@ int count;
 /*
  *			N W R I T E
  */
-int Nwrite( fd, buf, count )
-int fd;
-void *buf;
-int count;
+static int Nwrite( ttcp_stream *s, void *buf, int count )
 {
 	register int cnt;
-	if( udp )  {
+	if( s->run->udp )  {
+		pace(s);
 again:
-		cnt = sendto( fd, buf, count, 0, sinhim_p, sizeof(sinhim) );
-		numCalls++;
+		cnt = sendto( s->fd, buf, count, 0, (struct sockaddr *)&s->sinhim,
+		    sizeof(s->sinhim) );
+		s->numCalls++;
 		if( cnt<0 && errno == ENOBUFS )  {
-			printf("ttcp: out of buffers -- delaying\n"); /*JRS*/
-			delay(18000);
+			pace_backoff(s);
 			errno = 0;
 			goto again;
 		}
 	} else {
-		cnt = write( fd, buf, count );
-		numCalls++;
+		cnt = write( s->fd, buf, count );
+		s->numCalls++;
 	}
 	return(cnt);
 }
 
-void
+static void
 delay(int us)
 {
 	struct timeval tv;
@@ -1033,20 +3999,18 @@ delay(int us)
  * network connections don't deliver data with the same
  * grouping as it is written with.  Written by Robert S. Miles, BRL.
  */
-int
-mread(fd, bufp, n)
-int fd;
-register char	*bufp;
-unsigned	n;
+static int
+mread(ttcp_stream *s, register char *bufp, unsigned n)
 {
 	register unsigned	count = 0;
 	register int		nread;
 
 	do {
-		nread = read(fd, bufp, n-count);
-		numCalls++;
+		nread = read(s->fd, bufp, n-count);
+		s->numCalls++;
 		if(nread < 0)  {
-			perror("ttcp_mread");
+			if (can_print(s))
+				perror("ttcp_mread");
 			return(-1);
 		}
 		if(nread == 0)